@@ -0,0 +1,150 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLTexture2D.h"
+#include "GLES2/gl2ext.h"
+#include "math/Vector2.h"
+#include "math/Vector4.h"
+#include "math/Mathf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#ifndef SGL_TEXTURE_LINEAR
+#define SGL_TEXTURE_LINEAR 0
+#endif
+
+using namespace Viry3D;
+using namespace sgl;
+
+// texture sampling over a screen filling quad rotated in steps, timing GLTexture2D::Sample one
+// sample at a time, pixel after pixel along the rows. app_bench_texture samples the morton
+// tiled levels, app_bench_texture_linear is the same code built with SGL_TEXTURE_LINEAR=1
+
+static const int g_screen_size = 1024;
+static const int g_runs = 15;
+
+struct Case
+{
+    const char* name;
+    GLenum format;
+    GLenum min_filter;
+    int size;
+    // texels per pixel
+    float scale;
+};
+
+static void Upload(GLTexture2D* tex, const Case& c)
+{
+    srand(1);
+
+    if (c.format == GL_ETC1_RGB8_OES)
+    {
+        int size = (c.size / 4) * (c.size / 4) * 8;
+        std::vector<unsigned char> blocks(size);
+        for (int i = 0; i < size; ++i)
+        {
+            blocks[i] = (unsigned char) rand();
+        }
+        tex->CompressedTexImage2D(0, c.format, c.size, c.size, size, &blocks[0]);
+    }
+    else
+    {
+        std::vector<unsigned char> pixels(c.size * c.size * 4);
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            pixels[i] = (unsigned char) rand();
+        }
+        tex->TexImage2D(0, GL_RGBA, c.size, c.size, GL_RGBA, GL_UNSIGNED_BYTE, 4, &pixels[0]);
+        tex->GenerateMipmap();
+    }
+
+    tex->SetParameter(GL_TEXTURE_MIN_FILTER, c.min_filter);
+    tex->SetParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    tex->SetParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+    tex->SetParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+// one frame of the quad turned by deg, returns the sum of the colors so no sample is left out
+static float DrawQuad(const GLTexture2D* tex, const Case& c, float deg)
+{
+    float rad = deg * Mathf::Deg2Rad;
+    float cos = cosf(rad);
+    float sin = sinf(rad);
+    float step = c.scale / c.size;
+
+    // uv moves along the turned axes of the quad from pixel to pixel, the quad centre is the texture centre
+    Vector2 ddx(cos * step, sin * step);
+    Vector2 ddy(-sin * step, cos * step);
+    float half = g_screen_size * 0.5f;
+
+    float sum = 0;
+    for (int y = 0; y < g_screen_size; ++y)
+    {
+        float dy = y + 0.5f - half;
+        for (int x = 0; x < g_screen_size; ++x)
+        {
+            float dx = x + 0.5f - half;
+            Vector2 uv(0.5f + ddx.x * dx + ddy.x * dy, 0.5f + ddx.y * dx + ddy.y * dy);
+            Vector4 color = tex->Sample(uv, ddx, ddy);
+            sum += color.x + color.w;
+        }
+    }
+
+    return sum;
+}
+
+int main(int argc, char** argv)
+{
+    const Case cases[] = {
+        { "rgba8 1024 bilinear", GL_RGBA, GL_LINEAR, 1024, 1 },
+        { "rgba8 2048 trilinear", GL_RGBA, GL_LINEAR_MIPMAP_LINEAR, 2048, 2 },
+        { "etc1 1024 bilinear", GL_ETC1_RGB8_OES, GL_LINEAR, 1024, 1 },
+    };
+    const float degs[] = { 0, 30, 45, 60, 90 };
+
+    printf("%s layout, %dx%d samples per frame, best of %d\n", SGL_TEXTURE_LINEAR ? "linear" : "tiled", g_screen_size, g_screen_size, g_runs);
+
+    float check = 0;
+    for (const Case& c : cases)
+    {
+        GLTexture2D* tex = new GLTexture2D(1);
+        Upload(tex, c);
+
+        printf("%-22s", c.name);
+        for (float deg : degs)
+        {
+            double best = 0;
+            for (int i = 0; i < g_runs; ++i)
+            {
+                auto start = std::chrono::steady_clock::now();
+                check += DrawQuad(tex, c, deg);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best = i == 0 ? ms : Mathf::Min(best, ms);
+            }
+            printf(" %3.0f deg %6.2f ms", deg, best);
+        }
+        printf("\n");
+
+        delete tex;
+    }
+
+    printf("check %g\n", check);
+
+    return 0;
+}
@@ -15,8 +15,13 @@
 * limitations under the License.
 */
 
+#if VR_WINDOWS
 #include <Windows.h>
 #include "display/DisplayWindows.h"
+#else
+#include "display/DisplayHeadless.h"
+#include <stdlib.h>
+#endif
 #include "GLES2/gl2.h"
 #include "Debug.h"
 #include "math/Vector2.h"
@@ -142,7 +147,28 @@ void main()\n\
         int height;
         int bpp;
         ByteBuffer image = Image::LoadPNG(File::ReadAllBytes("Assets/texture/girl.png"), width, height, bpp);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.Bytes());
+
+        // upload in the channel count of the png, no expansion to rgba
+        GLenum format = GL_RGBA;
+        if (bpp == 24)
+        {
+            format = GL_RGB;
+        }
+        else if (bpp == 16)
+        {
+            format = GL_LUMINANCE_ALPHA;
+        }
+        else if (bpp == 8)
+        {
+            format = GL_LUMINANCE;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, image.Bytes());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
         glDeleteShader(vs);
         glDeleteShader(fs);
@@ -214,9 +240,18 @@ void main()\n\
     float m_deg;
 };
 
+#if VR_WINDOWS
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd)
 {
     DisplayWindows* display = new DisplayWindows("soft-gles2", g_win_width, g_win_height);
+#else
+// app [frame_count [save_interval]], 360 frames saving every 60th by default
+int main(int argc, char** argv)
+{
+    int frame_count = argc > 1 ? atoi(argv[1]) : 360;
+    int save_interval = argc > 2 ? atoi(argv[2]) : 60;
+    DisplayHeadless* display = new DisplayHeadless("soft-gles2", g_win_width, g_win_height, frame_count, save_interval);
+#endif
     Renderer* renderer = new Renderer();
 
     while(display->ProcessSystemEvents())
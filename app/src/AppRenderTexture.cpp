@@ -0,0 +1,260 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#if VR_WINDOWS
+#include <Windows.h>
+#include "display/DisplayWindows.h"
+#else
+#include "display/DisplayHeadless.h"
+#include <stdlib.h>
+#endif
+#include "GLES2/gl2.h"
+#include "Debug.h"
+#include "math/Vector2.h"
+#include "math/Vector3.h"
+#include "math/Vector4.h"
+#include "math/Matrix4x4.h"
+
+using namespace Viry3D;
+
+// renders quads into a texture through a framebuffer with only a color attachment,
+// then draws the texture spinning in the window
+
+struct Vertex
+{
+    Vector3 pos;
+    Vector2 uv;
+};
+
+static const int g_win_width = 720;
+static const int g_win_height = 720;
+static const int g_target_size = 256;
+
+class Renderer
+{
+public:
+    Renderer()
+    {
+        // shader
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        const char* vs_src = "\
+uniform mat4 u_mvp;\n\
+attribute vec4 a_position;\n\
+attribute vec2 a_uv;\n\
+varying vec2 v_uv;\n\
+void main()\n\
+{\n\
+    gl_Position = u_mvp * a_position;\n\
+    v_uv = a_uv;\n\
+}";
+        glShaderSource(vs, 1, (const GLchar* const*) &vs_src, nullptr);
+        glCompileShader(vs);
+
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        const char* fs_src = "\
+precision highp float;\n\
+uniform sampler2D u_tex;\n\
+uniform vec4 u_color;\n\
+varying vec2 v_uv;\n\
+void main()\n\
+{\n\
+    gl_FragColor = texture2D(u_tex, v_uv) * u_color;\n\
+}";
+        glShaderSource(fs, 1, (const GLchar* const*) &fs_src, nullptr);
+        glCompileShader(fs);
+
+        m_program = glCreateProgram();
+
+        glAttachShader(m_program, vs);
+        glAttachShader(m_program, fs);
+
+        glBindAttribLocation(m_program, 0, "a_position");
+        glBindAttribLocation(m_program, 1, "a_uv");
+
+        glLinkProgram(m_program);
+
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+
+        // vb
+        glGenBuffers(1, &m_vb);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+
+        Vertex vertices[] = {
+            { Vector3(-0.5f, 0.5f, 0), Vector2(0, 1) },
+            { Vector3(-0.5f, -0.5f, 0), Vector2(0, 0) },
+            { Vector3(0.5f, -0.5f, 0), Vector2(1, 0) },
+            { Vector3(0.5f, 0.5f, 0), Vector2(1, 1) },
+        };
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices[0], GL_STATIC_DRAW);
+
+        // ib
+        glGenBuffers(1, &m_ib);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+
+        unsigned short indices[] = {
+            0, 1, 2, 0, 2, 3,
+        };
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), &indices[0], GL_STATIC_DRAW);
+
+        // the quads drawn into the target are tinted white
+        glGenTextures(1, &m_white);
+        glBindTexture(GL_TEXTURE_2D, m_white);
+
+        unsigned char white[4] = { 255, 255, 255, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // target, no depth or stencil attachment
+        glGenTextures(1, &m_target);
+        glBindTexture(GL_TEXTURE_2D, m_target);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, g_target_size, g_target_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &m_fb);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fb);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_target, 0);
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            Log("color only framebuffer incomplete: 0x%x", status);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // the depth test stays on, without a depth buffer it passes and later quads cover earlier ones
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+
+        m_deg = 0;
+    }
+
+    virtual ~Renderer()
+    {
+        glDeleteProgram(m_program);
+        glDeleteBuffers(1, &m_vb);
+        glDeleteBuffers(1, &m_ib);
+        glDeleteTextures(1, &m_white);
+        glDeleteTextures(1, &m_target);
+        glDeleteFramebuffers(1, &m_fb);
+    }
+
+    void Draw()
+    {
+        glUseProgram(m_program);
+
+        int loc_a_position = glGetAttribLocation(m_program, "a_position");
+        int loc_a_uv = glGetAttribLocation(m_program, "a_uv");
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+        glVertexAttribPointer(loc_a_position, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*) 0);
+        glVertexAttribPointer(loc_a_uv, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*) sizeof(Vector3));
+        glEnableVertexAttribArray(loc_a_position);
+        glEnableVertexAttribArray(loc_a_uv);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+
+        int loc_u_tex = glGetUniformLocation(m_program, "u_tex");
+        glActiveTexture(GL_TEXTURE0);
+
+        // target, three quads going away from the camera in draw order, a depth buffer would reject the later ones
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fb);
+        glViewport(0, 0, g_target_size, g_target_size);
+        glClearColor(0.2f, 0.2f, 0.2f, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glBindTexture(GL_TEXTURE_2D, m_white);
+        glUniform1i(loc_u_tex, 0);
+
+        const Vector4 colors[] = {
+            Vector4(1, 0, 0, 1),
+            Vector4(0, 1, 0, 1),
+            Vector4(0, 0, 1, 1),
+        };
+        for (int i = 0; i < 3; ++i)
+        {
+            Matrix4x4 model = Matrix4x4::Translation(Vector3((i - 1) * 0.4f, (i - 1) * 0.4f, (i - 1) * 0.5f)) *
+                Matrix4x4::Rotation(Quaternion::Euler(0, 0, m_deg * (i + 1)));
+            this->DrawQuad(model, colors[i]);
+        }
+
+        // window, the target spinning
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, g_win_width, g_win_height);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        glBindTexture(GL_TEXTURE_2D, m_target);
+        glUniform1i(loc_u_tex, 0);
+
+        Matrix4x4 model = Matrix4x4::Rotation(Quaternion::Euler(0, 0, -m_deg)) * Matrix4x4::Scaling(Vector3(1.2f, 1.2f, 1));
+        this->DrawQuad(model, Vector4(1, 1, 1, 1));
+
+        glDisableVertexAttribArray(loc_a_position);
+        glDisableVertexAttribArray(loc_a_uv);
+
+        m_deg += 1;
+    }
+
+    void DrawQuad(const Matrix4x4& model, const Vector4& color)
+    {
+        glUniformMatrix4fv(glGetUniformLocation(m_program, "u_mvp"), 1, true, (const GLfloat*) &model);
+        glUniform4fv(glGetUniformLocation(m_program, "u_color"), 1, (const GLfloat*) &color);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (const void*) 0);
+    }
+
+    GLuint m_program;
+    GLuint m_vb;
+    GLuint m_ib;
+    GLuint m_white;
+    GLuint m_target;
+    GLuint m_fb;
+    float m_deg;
+};
+
+#if VR_WINDOWS
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd)
+{
+    DisplayWindows* display = new DisplayWindows("soft-gles2-rtt", g_win_width, g_win_height);
+#else
+// app_rtt [frame_count [save_interval]], 360 frames saving every 60th by default
+int main(int argc, char** argv)
+{
+    int frame_count = argc > 1 ? atoi(argv[1]) : 360;
+    int save_interval = argc > 2 ? atoi(argv[2]) : 60;
+    DisplayHeadless* display = new DisplayHeadless("soft-gles2-rtt", g_win_width, g_win_height, frame_count, save_interval);
+#endif
+    Renderer* renderer = new Renderer();
+
+    while(display->ProcessSystemEvents())
+    {
+        renderer->Draw();
+        display->SwapBuffers();
+    }
+
+    delete renderer;
+    delete display;
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLTexture2D.h"
+#include "GLES2/gl2ext.h"
+#include "math/Vector2.h"
+#include "math/Vector4.h"
+#include "math/Mathf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace Viry3D;
+using namespace sgl;
+
+// regression check of GLTexture2D::SampleBatch against Sample, fragment by fragment, over every
+// upload format, filter, wrap mode and a range of lods. the batch takes the simd path in groups
+// of 4 and the scalar one for the rest, both have to give the colors of a single sample. batches
+// with derivatives per fragment, as the rasterizer's spans sample, mix lods across levels
+
+static const float g_max_difference = 1.0e-5f;
+
+struct Format
+{
+    const char* name;
+    GLenum format;
+    GLenum type;
+    int texel_size;
+};
+
+static float Random(float min, float max)
+{
+    return min + (max - min) * (rand() / (float) RAND_MAX);
+}
+
+static void Upload(GLTexture2D* tex, const Format& format, int width, int height)
+{
+    if (format.type == 0)
+    {
+        // random etc1 blocks, compressed levels have no mipmaps
+        int size = ((width + 3) >> 2) * ((height + 3) >> 2) * 8;
+        std::vector<unsigned char> blocks(size);
+        for (int i = 0; i < size; ++i)
+        {
+            blocks[i] = (unsigned char) rand();
+        }
+        tex->CompressedTexImage2D(0, format.format, width, height, size, &blocks[0]);
+        return;
+    }
+
+    std::vector<unsigned char> pixels(width * height * format.texel_size);
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = (unsigned char) rand();
+    }
+    tex->TexImage2D(0, format.format, width, height, format.format, format.type, 1, &pixels[0]);
+    tex->GenerateMipmap();
+}
+
+// returns the largest difference of any channel between the batch and the single samples.
+// shared takes the derivatives of the first fragment for all, else each fragment has its own
+static float Compare(const GLTexture2D* tex, int count, const Vector2* ddx, const Vector2* ddy, bool shared)
+{
+    float u[GLTexture2D::BATCH_SIZE];
+    float v[GLTexture2D::BATCH_SIZE];
+    float rgba[4][GLTexture2D::BATCH_SIZE];
+    for (int i = 0; i < count; ++i)
+    {
+        u[i] = Random(-1.5f, 2.5f);
+        v[i] = Random(-1.5f, 2.5f);
+    }
+
+    if (shared)
+    {
+        tex->SampleBatch(count, u, v, ddx[0], ddy[0], rgba[0], rgba[1], rgba[2], rgba[3]);
+    }
+    else
+    {
+        tex->SampleBatch(count, u, v, ddx, ddy, rgba[0], rgba[1], rgba[2], rgba[3]);
+    }
+
+    float difference = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        Vector4 c = tex->Sample(Vector2(u[i], v[i]), ddx[shared ? 0 : i], ddy[shared ? 0 : i]);
+        float channels[4] = { c.x, c.y, c.z, c.w };
+        for (int j = 0; j < 4; ++j)
+        {
+            difference = Mathf::Max(difference, fabsf(rgba[j][i] - channels[j]));
+        }
+    }
+
+    return difference;
+}
+
+int main()
+{
+    const Format formats[] = {
+        { "rgba8", GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+        { "rgb8", GL_RGB, GL_UNSIGNED_BYTE, 3 },
+        { "rgb565", GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 2 },
+        { "rgba4444", GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, 2 },
+        { "rgba5551", GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, 2 },
+        { "luminance_alpha8", GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, 2 },
+        { "luminance8", GL_LUMINANCE, GL_UNSIGNED_BYTE, 1 },
+        { "alpha8", GL_ALPHA, GL_UNSIGNED_BYTE, 1 },
+        { "etc1", GL_ETC1_RGB8_OES, 0, 0 },
+    };
+    const GLenum min_filters[] = {
+        GL_NEAREST,
+        GL_LINEAR,
+        GL_NEAREST_MIPMAP_NEAREST,
+        GL_LINEAR_MIPMAP_NEAREST,
+        GL_NEAREST_MIPMAP_LINEAR,
+        GL_LINEAR_MIPMAP_LINEAR,
+    };
+    const GLenum mag_filters[] = {
+        GL_NEAREST,
+        GL_LINEAR,
+    };
+    const GLenum wraps[] = {
+        GL_REPEAT,
+        GL_CLAMP_TO_EDGE,
+        GL_MIRRORED_REPEAT,
+    };
+    // texels per pixel along x, from magnified to several levels down
+    const float scales[] = { 0, 0.25f, 1, 1.5f, 3, 10, 100 };
+    const int width = 64;
+    const int height = 32;
+
+    srand(1);
+
+    int cases = 0;
+    int failures = 0;
+    float max_difference = 0;
+
+    for (const Format& format : formats)
+    {
+        GLTexture2D* tex = new GLTexture2D(1);
+        Upload(tex, format, width, height);
+
+        for (GLenum min_filter : min_filters)
+        {
+            for (GLenum mag_filter : mag_filters)
+            {
+                for (GLenum wrap : wraps)
+                {
+                    tex->SetParameter(GL_TEXTURE_MIN_FILTER, min_filter);
+                    tex->SetParameter(GL_TEXTURE_MAG_FILTER, mag_filter);
+                    tex->SetParameter(GL_TEXTURE_WRAP_S, wrap);
+                    tex->SetParameter(GL_TEXTURE_WRAP_T, wrap);
+
+                    for (float scale : scales)
+                    {
+                        Vector2 ddx(scale / width, 0);
+                        Vector2 ddy(0, scale * 0.5f / height);
+
+                        for (int count = 1; count <= GLTexture2D::BATCH_SIZE; ++count)
+                        {
+                            float difference = Compare(tex, count, &ddx, &ddy, true);
+                            max_difference = Mathf::Max(max_difference, difference);
+                            cases += 1;
+
+                            if (difference > g_max_difference)
+                            {
+                                failures += 1;
+                                printf("%s min 0x%x mag 0x%x wrap 0x%x scale %g count %d: difference %g\n",
+                                    format.name, min_filter, mag_filter, wrap, scale, count, difference);
+                            }
+                        }
+                    }
+
+                    // runs of a few fragments at one of the scales, each a little off so trilinear fractions differ
+                    for (int count = 1; count <= GLTexture2D::BATCH_SIZE; ++count)
+                    {
+                        Vector2 ddx[GLTexture2D::BATCH_SIZE];
+                        Vector2 ddy[GLTexture2D::BATCH_SIZE];
+                        float scale = 0;
+                        for (int i = 0; i < count; ++i)
+                        {
+                            if (i % 3 == 0)
+                            {
+                                scale = scales[rand() % (sizeof(scales) / sizeof(scales[0]))];
+                            }
+                            float jitter = Random(0.8f, 1.25f);
+                            ddx[i] = Vector2(scale * jitter / width, 0);
+                            ddy[i] = Vector2(0, scale * jitter * 0.5f / height);
+                        }
+
+                        float difference = Compare(tex, count, ddx, ddy, false);
+                        max_difference = Mathf::Max(max_difference, difference);
+                        cases += 1;
+
+                        if (difference > g_max_difference)
+                        {
+                            failures += 1;
+                            printf("%s min 0x%x mag 0x%x wrap 0x%x mixed scales count %d: difference %g\n",
+                                format.name, min_filter, mag_filter, wrap, count, difference);
+                        }
+                    }
+                }
+            }
+        }
+
+        delete tex;
+    }
+
+    printf("sample batch: %d cases, %d failed, max difference %g\n", cases, failures, max_difference);
+
+    return failures == 0 ? 0 : 1;
+}
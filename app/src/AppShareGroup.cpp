@@ -0,0 +1,135 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLES2/gl2.h"
+#include "SGL/sgl.h"
+#include <stdio.h>
+
+// destroys the contexts of a share group while they still name objects of every kind and have
+// them bound, the last context to go takes the group and its objects with it. run it under a leak
+// or address checker to see them released, it exits with 1 when the group loses objects too early
+
+static int g_failed = 0;
+
+static void Check(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        printf("failed: %s\n", what);
+        g_failed += 1;
+    }
+}
+
+struct Objects
+{
+    GLuint vs;
+    GLuint program;
+    GLuint vb;
+    GLuint tex;
+    GLuint depth;
+    GLuint fb;
+};
+
+static Objects CreateObjects()
+{
+    Objects objects;
+
+    const char* source = "void main() { gl_Position = vec4(0.0); }";
+    objects.vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(objects.vs, 1, &source, nullptr);
+    objects.program = glCreateProgram();
+    glAttachShader(objects.program, objects.vs);
+
+    const float vertices[] = { 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+    glGenBuffers(1, &objects.vb);
+    glBindBuffer(GL_ARRAY_BUFFER, objects.vb);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    unsigned char pixels[16 * 16 * 4] = { 0 };
+    glGenTextures(1, &objects.tex);
+    glBindTexture(GL_TEXTURE_2D, objects.tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 16, 16, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    glGenRenderbuffers(1, &objects.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, objects.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, 16, 16);
+
+    glGenFramebuffers(1, &objects.fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, objects.fb);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, objects.tex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, objects.depth);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    return objects;
+}
+
+// the shared objects are named in every context of the group
+static void CheckShared(const Objects& objects, const char* context)
+{
+    char what[128];
+    snprintf(what, sizeof(what), "shared objects named in %s", context);
+    Check(glIsShader(objects.vs) && glIsProgram(objects.program) && glIsBuffer(objects.vb) &&
+        glIsTexture(objects.tex) && glIsRenderbuffer(objects.depth), what);
+}
+
+int main()
+{
+    GLint surface_attribs[] = { SGL_WIDTH, 64, SGL_HEIGHT, 64, SGL_NONE };
+    GLint deferred_attribs[] = { SGL_DEFERRED, GL_TRUE, SGL_NONE };
+
+    SGLSurface surface = sglCreatePbufferSurface(surface_attribs);
+    SGLContext first = sglCreateContext(SGL_NO_CONTEXT, nullptr);
+    SGLContext second = sglCreateContext(first, deferred_attribs);
+    SGLContext third = sglCreateContext(first, nullptr);
+    Check(surface != SGL_NO_SURFACE && first != SGL_NO_CONTEXT && second != SGL_NO_CONTEXT && third != SGL_NO_CONTEXT, "contexts created");
+
+    sglMakeCurrent(surface, first);
+    Objects first_objects = CreateObjects();
+
+    sglMakeCurrent(SGL_NO_SURFACE, second);
+    CheckShared(first_objects, "the second context");
+    Objects second_objects = CreateObjects();
+    glBindTexture(GL_TEXTURE_2D, first_objects.tex);
+    glBindBuffer(GL_ARRAY_BUFFER, first_objects.vb);
+
+    // a context that is not current goes at once, its framebuffer with it
+    Check(sglDestroyContext(first) == GL_TRUE, "first context destroyed");
+    CheckShared(first_objects, "the second context after the first is gone");
+    CheckShared(second_objects, "the second context after the first is gone");
+
+    sglMakeCurrent(surface, third);
+    CheckShared(first_objects, "the third context");
+    CheckShared(second_objects, "the third context");
+    Objects third_objects = CreateObjects();
+
+    // a current context goes when it is released, the last of the group releases the objects
+    sglMakeCurrent(SGL_NO_SURFACE, second);
+    Check(sglDestroyContext(second) == GL_TRUE, "current context destroyed");
+    sglMakeCurrent(SGL_NO_SURFACE, third);
+    CheckShared(third_objects, "the third context after the second is gone");
+    Check(sglDestroyContext(third) == GL_TRUE, "last context destroyed");
+    sglMakeCurrent(SGL_NO_SURFACE, SGL_NO_CONTEXT);
+    sglDestroySurface(surface);
+
+    if (g_failed > 0)
+    {
+        printf("share group teardown: %d checks failed\n", g_failed);
+        return 1;
+    }
+    printf("share group teardown: passed\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "DisplayHeadless.h"
+#include "GLES2/gl2ext.h"
+
+DisplayHeadless::DisplayHeadless(const std::string& name, int width, int height, int frame_count, int save_interval):
+    m_name(name),
+    m_width(width),
+    m_height(height),
+    m_frame_count(frame_count),
+    m_frame(0),
+    m_context(SGL_NO_CONTEXT),
+    m_surface(SGL_NO_SURFACE)
+{
+    // depth and stencil share one buffer of 24_8 words, the frame being saved or
+    // read from the ring stays unchanged while the next one is drawn
+    const GLint surface_attribs[] = {
+        SGL_WIDTH, width,
+        SGL_HEIGHT, height,
+        SGL_DEPTH_FORMAT, GL_DEPTH24_STENCIL8_OES,
+        SGL_BUFFER_COUNT, 2,
+        SGL_NONE
+    };
+
+    m_context = sglCreateContext(SGL_NO_CONTEXT, nullptr);
+    m_surface = sglCreatePbufferSurface(surface_attribs);
+
+    sglAddFrameRing(m_surface, ("/" + name).c_str(), 3);
+    if (save_interval > 0)
+    {
+        sglAddFrameWriter(m_surface, (name + "_%u.ppm").c_str(), save_interval);
+    }
+
+    sglMakeCurrent(m_surface, m_context);
+}
+
+DisplayHeadless::~DisplayHeadless()
+{
+    sglMakeCurrent(SGL_NO_SURFACE, SGL_NO_CONTEXT);
+    sglDestroySurface(m_surface);
+    sglDestroyContext(m_context);
+}
+
+bool DisplayHeadless::ProcessSystemEvents()
+{
+    return m_frame_count == 0 || m_frame < m_frame_count;
+}
+
+void DisplayHeadless::SwapBuffers()
+{
+    sglSwapBuffers(m_surface);
+    m_frame += 1;
+}
@@ -0,0 +1,42 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "SGL/sgl.h"
+#include <string>
+
+// renders into a pbuffer surface without a window. frames are published to the shared
+// memory ring /name, and every save_interval-th frame is saved as name_<serial>.ppm
+class DisplayHeadless
+{
+public:
+    // frame_count 0 runs until the process is stopped
+    DisplayHeadless(const std::string& name, int width, int height, int frame_count, int save_interval);
+    virtual ~DisplayHeadless();
+    bool ProcessSystemEvents();
+    void SwapBuffers();
+
+protected:
+    std::string m_name;
+    int m_width;
+    int m_height;
+    int m_frame_count;
+    int m_frame;
+    SGLContext m_context;
+    SGLSurface m_surface;
+};
@@ -21,11 +21,13 @@
 #include <android/log.h>
 #elif VR_WINDOWS
 #include <Windows.h>
+#elif VR_LINUX
+#include <stdio.h>
 #endif
 
 namespace Viry3D
 {
-#if VR_ANDROID || VR_WINDOWS
+#if VR_ANDROID || VR_WINDOWS || VR_LINUX
 	void Debug::LogString(const String& str, bool end_line)
 	{
 #if VR_ANDROID
@@ -39,6 +41,12 @@ namespace Viry3D
 		{
 			OutputDebugString(str.CString());
 		}
+#elif VR_LINUX
+		fputs(str.CString(), stderr);
+		if (end_line)
+		{
+			fputc('\n', stderr);
+		}
 #endif
 	}
 #endif
@@ -17,14 +17,41 @@
 
 #include "GLBuffer.h"
 #include "memory/Memory.h"
+#include "container/Map.h"
+#include <mutex>
 
 using namespace Viry3D;
 
 namespace sgl
 {
+    template<class T>
+    static void ScanIndices(const T* indices, GLsizei count, GLuint& min_index, GLuint& max_index)
+    {
+        T min = (T) ~0;
+        T max = 0;
+
+        for (int i = 0; i < count; ++i)
+        {
+            T index = indices[i];
+            min = index < min ? index : min;
+            max = index > max ? index : max;
+        }
+
+        min_index = min;
+        max_index = max;
+    }
+
     class GLBufferPrivate
     {
     public:
+        struct IndexRange
+        {
+            GLenum type;
+            GLsizei count;
+            GLuint min_index;
+            GLuint max_index;
+        };
+
         GLBufferPrivate(GLBuffer* p):
             m_p(p),
             m_data(nullptr),
@@ -40,6 +67,9 @@ namespace sgl
         GLBuffer* m_p;
         GLbyte* m_data;
         int m_data_size;
+        Map<GLintptr, IndexRange> m_index_ranges;
+        // contexts of a share group draw from the same buffer on their own threads and fill the ranges together
+        std::mutex m_index_ranges_mutex;
     };
 
     GLBuffer::GLBuffer(GLuint id):
@@ -78,6 +108,9 @@ namespace sgl
         {
             Memory::Copy(m_private->m_data, data, size);
         }
+
+        std::lock_guard<std::mutex> lock(m_private->m_index_ranges_mutex);
+        m_private->m_index_ranges.Clear();
     }
 
     void GLBuffer::BufferSubData(GLintptr offset, GLsizeiptr size, const void* data)
@@ -88,10 +121,78 @@ namespace sgl
         }
 
         Memory::Copy(&m_private->m_data[offset], data, size);
+
+        std::lock_guard<std::mutex> lock(m_private->m_index_ranges_mutex);
+        m_private->m_index_ranges.Clear();
     }
 
     void* GLBuffer::GetData() const
     {
         return m_private->m_data;
     }
+
+    int GLBuffer::GetSize() const
+    {
+        return m_private->m_data_size;
+    }
+
+    void GLBuffer::GetIndexRange(GLenum type, GLintptr offset, GLsizei count, GLuint& min_index, GLuint& max_index) const
+    {
+        // ranges are cached per offset until the buffer data changes
+        std::lock_guard<std::mutex> lock(m_private->m_index_ranges_mutex);
+
+        GLBufferPrivate::IndexRange* find;
+        if (m_private->m_index_ranges.TryGet(offset, &find))
+        {
+            if (find->type == type && find->count == count)
+            {
+                min_index = find->min_index;
+                max_index = find->max_index;
+                return;
+            }
+        }
+
+        GLBuffer::ScanIndexRange(type, &m_private->m_data[offset], count, min_index, max_index);
+
+        GLBufferPrivate::IndexRange range;
+        range.type = type;
+        range.count = count;
+        range.min_index = min_index;
+        range.max_index = max_index;
+
+        if (find)
+        {
+            *find = range;
+        }
+        else
+        {
+            m_private->m_index_ranges.Add(offset, range);
+        }
+    }
+
+    void GLBuffer::ScanIndexRange(GLenum type, const void* indices, GLsizei count, GLuint& min_index, GLuint& max_index)
+    {
+        min_index = 0;
+        max_index = 0;
+
+        if (count <= 0)
+        {
+            return;
+        }
+
+        switch (type)
+        {
+            case GL_UNSIGNED_BYTE:
+                ScanIndices((const GLubyte*) indices, count, min_index, max_index);
+                break;
+            case GL_UNSIGNED_SHORT:
+                ScanIndices((const GLushort*) indices, count, min_index, max_index);
+                break;
+            case GL_UNSIGNED_INT:
+                ScanIndices((const GLuint*) indices, count, min_index, max_index);
+                break;
+            default:
+                break;
+        }
+    }
 }
@@ -31,6 +31,9 @@ namespace sgl
         void BufferData(GLsizeiptr size, const void* data, GLenum usage);
         void BufferSubData(GLintptr offset, GLsizeiptr size, const void* data);
         void* GetData() const;
+        int GetSize() const;
+        void GetIndexRange(GLenum type, GLintptr offset, GLsizei count, GLuint& min_index, GLuint& max_index) const;
+        static void ScanIndexRange(GLenum type, const void* indices, GLsizei count, GLuint& min_index, GLuint& max_index);
 
     private:
         friend class GLBufferPrivate;
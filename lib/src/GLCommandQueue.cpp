@@ -0,0 +1,221 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLCommandQueue.h"
+#include "memory/Memory.h"
+#include "math/Mathf.h"
+
+using namespace Viry3D;
+
+namespace sgl
+{
+    GLCommandQueue::GLCommandQueue(void* context):
+        m_context(context),
+        m_ring(nullptr),
+        m_record_pos(0),
+        m_write_pos(0),
+        m_read_pos(0),
+        m_command(nullptr),
+        m_arena_block(0),
+        m_arena_offset(0),
+        m_arena_size(0),
+        m_arena_pending(false),
+        m_idle(false),
+        m_quit(false)
+    {
+        m_ring = Memory::Alloc<char>(RING_SIZE);
+        m_thread = std::thread(&GLCommandQueue::Run, this);
+    }
+
+    GLCommandQueue::~GLCommandQueue()
+    {
+        this->Finish();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+
+        for (int i = 0; i < m_arena.Size(); ++i)
+        {
+            Memory::Free(m_arena[i].data);
+        }
+        Memory::SafeFree(m_ring);
+    }
+
+    void* GLCommandQueue::Copy(const void* data, int size)
+    {
+        void* copy = this->Alloc(size);
+        Memory::Copy(copy, data, size);
+        return copy;
+    }
+
+    void* GLCommandQueue::Alloc(int size)
+    {
+        size = Align(size);
+
+        // the first copy of a call can wait for the queue to drain, later ones would lose the earlier copies
+        if (!m_arena_pending && m_arena_size > 0 && m_arena_size + size > ARENA_LIMIT)
+        {
+            this->Finish();
+        }
+        m_arena_pending = true;
+
+        while (m_arena_block < m_arena.Size() && m_arena_offset + size > m_arena[m_arena_block].size)
+        {
+            ++m_arena_block;
+            m_arena_offset = 0;
+        }
+        if (m_arena_block == m_arena.Size())
+        {
+            ArenaBlock block;
+            block.size = Mathf::Max((int) ARENA_BLOCK_SIZE, size);
+            block.data = Memory::Alloc<char>(block.size);
+            m_arena.Add(block);
+        }
+
+        void* p = &m_arena[m_arena_block].data[m_arena_offset];
+        m_arena_offset += size;
+        m_arena_size += size;
+        return p;
+    }
+
+    void GLCommandQueue::Finish()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_drained.wait(lock, [this]() { return m_read_pos.load() == m_record_pos; });
+        }
+
+        if (!m_arena_pending)
+        {
+            this->ResetArena();
+        }
+    }
+
+    void* GLCommandQueue::BeginCommand(ExecuteFunc execute, int size)
+    {
+        int command_size = Align(sizeof(Command)) + Align(size);
+
+        // a command is never split, the rest of the ring is skipped instead
+        int tail = RING_SIZE - (int) (m_record_pos & (RING_SIZE - 1));
+        if (command_size > tail)
+        {
+            this->WaitForSpace(tail);
+
+            Command* padding = (Command*) &m_ring[m_record_pos & (RING_SIZE - 1)];
+            padding->execute = nullptr;
+            padding->size = tail;
+            m_record_pos += tail;
+        }
+
+        this->WaitForSpace(command_size);
+
+        m_command = (Command*) &m_ring[m_record_pos & (RING_SIZE - 1)];
+        m_command->execute = execute;
+        m_command->size = command_size;
+
+        return (char*) m_command + Align(sizeof(Command));
+    }
+
+    void GLCommandQueue::EndCommand()
+    {
+        m_record_pos += m_command->size;
+        m_arena_pending = false;
+        this->Publish();
+    }
+
+    void GLCommandQueue::Publish()
+    {
+        // pairs with the render thread setting m_idle before it checks m_write_pos, one of them sees the other
+        m_write_pos.store(m_record_pos);
+        if (m_idle.load())
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wake.notify_one();
+        }
+    }
+
+    void GLCommandQueue::WaitForSpace(int size)
+    {
+        if (RING_SIZE - (int) (m_record_pos - m_read_pos.load()) >= size)
+        {
+            return;
+        }
+
+        // a full ring waits for the render thread to catch up with everything recorded
+        this->Publish();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_drained.wait(lock, [this]() { return m_read_pos.load() == m_record_pos; });
+    }
+
+    void GLCommandQueue::ResetArena()
+    {
+        // blocks made for single large copies are not kept
+        for (int i = m_arena.Size() - 1; i >= 0; --i)
+        {
+            if (m_arena[i].size > ARENA_BLOCK_SIZE)
+            {
+                Memory::Free(m_arena[i].data);
+                m_arena.Remove(i);
+            }
+        }
+
+        m_arena_block = 0;
+        m_arena_offset = 0;
+        m_arena_size = 0;
+    }
+
+    void GLCommandQueue::Run()
+    {
+        size_t read = 0;
+
+        for (;;)
+        {
+            size_t write = m_write_pos.load();
+            if (read == write)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_idle.store(true);
+                m_drained.notify_all();
+                m_wake.wait(lock, [this, read]() { return m_quit || m_write_pos.load() != read; });
+                m_idle.store(false);
+
+                if (m_write_pos.load() == read)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            while (read != write)
+            {
+                Command* command = (Command*) &m_ring[read & (RING_SIZE - 1)];
+                if (command->execute)
+                {
+                    command->execute(m_context, (char*) command + Align(sizeof(Command)));
+                }
+
+                read += command->size;
+                m_read_pos.store(read);
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "container/Vector.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace sgl
+{
+    // calls recorded on the application thread and replayed in order on a render thread. a call is
+    // packed into a ring buffer as its member function and arguments by value, client memory it reads
+    // is copied into a linear arena first, which is reset whenever the queue has drained. after Finish
+    // the render thread is idle and the context can be used from the application thread directly
+    class GLCommandQueue
+    {
+    public:
+        enum
+        {
+            RING_SIZE = 1 << 20,
+            ARENA_BLOCK_SIZE = 1 << 20,
+            // copies since the last drain past this wait for the render thread before more are made
+            ARENA_LIMIT = 64 << 20,
+        };
+
+        // context is the object the recorded member functions are called on
+        GLCommandQueue(void* context);
+        // runs the recorded calls, then stops the render thread
+        ~GLCommandQueue();
+        // pointer arguments have to be null, buffer offsets or copies from Copy
+        template<class T, class... Params, class... Args>
+        void Record(void (T::*func)(Params...), Args... args)
+        {
+            typedef Call<T, Params...> CallType;
+            static_assert(alignof(CallType) <= ALIGNMENT, "call is over aligned");
+
+            void* data = this->BeginCommand(&CallType::Execute, sizeof(CallType));
+            new (data) CallType(func, args...);
+            this->EndCommand();
+        }
+        // a copy of size bytes living until the next recorded call has run
+        void* Copy(const void* data, int size);
+        void* Alloc(int size);
+        // waits for the render thread to run every recorded call
+        void Finish();
+
+    private:
+        enum
+        {
+            ALIGNMENT = 16,
+        };
+
+        typedef void (*ExecuteFunc)(void* context, void* data);
+
+        // size includes the header and the padding, a null execute pads the end of the ring
+        struct Command
+        {
+            ExecuteFunc execute;
+            int size;
+        };
+
+        template<class T, class... Params>
+        struct Call
+        {
+            typedef void (T::*Func)(Params...);
+
+            template<class... Args>
+            Call(Func func, Args... args):
+                func(func),
+                args(args...)
+            {
+            }
+
+            static void Execute(void* context, void* data)
+            {
+                Call* call = (Call*) data;
+                call->Invoke((T*) context, std::index_sequence_for<Params...>());
+                call->~Call();
+            }
+
+            template<size_t... I>
+            void Invoke(T* context, std::index_sequence<I...>)
+            {
+                (context->*func)(std::get<I>(args)...);
+            }
+
+            Func func;
+            std::tuple<typename std::decay<Params>::type...> args;
+        };
+
+        struct ArenaBlock
+        {
+            char* data;
+            int size;
+        };
+
+        static int Align(int size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+        void* BeginCommand(ExecuteFunc execute, int size);
+        void EndCommand();
+        void Publish();
+        void WaitForSpace(int size);
+        void ResetArena();
+        void Run();
+
+    private:
+        void* m_context;
+        char* m_ring;
+        // positions count bytes from the start and wrap around the ring by RING_SIZE
+        size_t m_record_pos;
+        std::atomic<size_t> m_write_pos;
+        std::atomic<size_t> m_read_pos;
+        Command* m_command;
+        Viry3D::Vector<ArenaBlock> m_arena;
+        int m_arena_block;
+        int m_arena_offset;
+        int m_arena_size;
+        // copies made for a call not recorded yet, they keep the arena from being reset
+        bool m_arena_pending;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_drained;
+        std::atomic<bool> m_idle;
+        bool m_quit;
+        std::thread m_thread;
+    };
+}
@@ -15,36 +15,93 @@
 * limitations under the License.
 */
 
+#if VR_WINDOWS
 #define GL_APICALL __declspec(dllexport)
+#define SGL_APICALL __declspec(dllexport)
+#else
+#define GL_APICALL __attribute__((visibility("default")))
+#define SGL_APICALL __attribute__((visibility("default")))
+#endif
+#define GL_GLEXT_PROTOTYPES
 
 #include "GLES2/gl2.h"
 #include "GLES2/gl2ext.h"
+#include "GLES2/gl2ext_sgl.h"
+#include "SGL/sgl.h"
 #include "Debug.h"
 #include "math/Mathf.h"
-#include "container/Map.h"
 #include "math/Vector2.h"
 #include "math/Vector3.h"
 #include "math/Vector4.h"
 #include "GLObject.h"
+#include "GLHandleTable.h"
 #include "GLFramebuffer.h"
 #include "GLRenderbuffer.h"
 #include "GLShader.h"
 #include "GLProgram.h"
 #include "GLBuffer.h"
 #include "GLRasterizer.h"
+#include "GLTileBuffer.h"
+#include "GLOutputMerger.h"
 #include "GLTexture.h"
 #include "GLTexture2D.h"
+#include "GLCommandQueue.h"
+#include "GLSurface.h"
+#include <atomic>
 #include <functional>
+#include <mutex>
 
 using namespace Viry3D;
 
+#if VR_WINDOWS
 const char* g_vs_path = "C:\\Program Files (x86)\\Microsoft Visual Studio\\2019\\Community";
 const char* vc_version = "14.22.27905";
 const char* win_sdk_inc = "C:\\Program Files (x86)\\Windows Kits\\10\\Include\\10.0.18362.0\\ucrt";
 const char* win_sdk_lib = "C:\\Program Files (x86)\\Windows Kits\\10\\lib\\10.0.18362.0";
+#else
+// the system compiler, found on the path
+const char* g_cxx = "c++";
+#endif
 
 namespace sgl
 {
+    // the objects contexts share, a context made without a group to share starts its own.
+    // framebuffers are container objects and stay with the context that made them
+    class GLShareGroup
+    {
+    public:
+        // handle table tags, names of different object types never equal
+        enum
+        {
+            FRAMEBUFFER_TAG = 1,
+            RENDERBUFFER_TAG,
+            SHADER_TAG,
+            PROGRAM_TAG,
+            BUFFER_TAG,
+            TEXTURE_TAG,
+        };
+
+        GLShareGroup():
+            renderbuffers(RENDERBUFFER_TAG),
+            shaders(SHADER_TAG),
+            programs(PROGRAM_TAG),
+            buffers(BUFFER_TAG),
+            textures(TEXTURE_TAG),
+            changes(0)
+        {
+        }
+
+        // objects still named when the last context of the group goes are released with the tables
+        GLHandleTable<GLRenderbuffer> renderbuffers;
+        GLHandleTable<GLShader> shaders;
+        GLHandleTable<GLProgram> programs;
+        GLHandleTable<GLBuffer> buffers;
+        GLHandleTable<GLTexture> textures;
+        // counts storage changes of shared objects, a context seeing another count than at its
+        // last draw rebuilds its draw state, which points into buffer data and attachments
+        std::atomic<unsigned int> changes;
+    };
+
     class GLContext
     {
     public:
@@ -57,13 +114,235 @@ namespace sgl
             GLboolean normalized;
             GLsizei stride;
             const GLvoid* pointer;
-            WeakRef<GLBuffer> vb;
+            Ref<GLBuffer> vb;
+        };
+
+        struct DrawTarget
+        {
+            unsigned char* color_buffer;
+            void* depth_buffer;
+            // a GLTileBuffer depth format
+            GLenum depth_format;
+            // the depth buffer itself when the stencil is packed with depth
+            unsigned char* stencil_buffer;
+            int width;
+            int height;
+            int samples;
+        };
+
+        struct VertexInput
+        {
+            GLuint index;
+            const char* data;
+            int stride;
+            int size;
+        };
+
+        struct DrawState;
+        typedef void (GLContext::*DrawBinsFunc)(const DrawState& state);
+
+        // everything a draw call derives from the gl state, kept between draws and rebuilt
+        // a group at a time when the state of the group changes, see ValidateDrawState
+        struct DrawState
+        {
+            // framebuffer
+            DrawTarget target;
+            // a texture color attachment, its render buffer is taken again by every draw
+            GLTexture2D* target_texture;
+            // program
+            GLProgram* program;
+            // vertex input
+            Vector<VertexInput> inputs;
+            GLBuffer* index_buffer;
+            // raster, the window rect of the target and the scissor that triangles are clipped to
+            int clip_min_x;
+            int clip_min_y;
+            int clip_max_x;
+            int clip_max_y;
+            // whether culling keeps a triangle, by the sign of its cross product: cw, zero area, ccw
+            bool keep_faces[3];
+            // output, tests without their buffer always pass
+            bool depth_test;
+            bool depth_write;
+            bool stencil_enable;
+            bool color_write;
+            int tile_buffers;
+            // per stencil face, whether a failing depth test would still change the stencil
+            bool stencil_writes_on_depth_fail[2];
+            // the rasterizer's output stage for the program, the color write and the samples
+            DrawBinsFunc draw_bins;
+        };
+
+        // state groups a draw derives from, marked by the gl calls that change them
+        enum
+        {
+            DIRTY_FRAMEBUFFER = 1 << 0,
+            DIRTY_PROGRAM = 1 << 1,
+            DIRTY_VERTEX_INPUT = 1 << 2,
+            DIRTY_RASTER = 1 << 3,
+            // depth, stencil, blend and color mask
+            DIRTY_OUTPUT = 1 << 4,
+
+            DIRTY_ALL = (1 << 5) - 1,
+        };
+
+        // stencil state of one face, front and back are set apart by the Separate functions
+        struct StencilFace
+        {
+            GLenum func;
+            GLint ref;
+            GLuint value_mask;
+            GLuint write_mask;
+            GLenum fail_op;
+            GLenum depth_fail_op;
+            GLenum depth_pass_op;
+        };
+
+        // a triangle of the current draw, its bounds are clipped to the viewport, the target and the scissor
+        struct BinnedTriangle
+        {
+            int vertices[3];
+            int min_x;
+            int min_y;
+            int max_x;
+            int max_y;
+            bool ccw;
+            // window depth range of the vertices, a fragment's depth lies within it
+            float min_depth;
+            float max_depth;
+        };
+
+        // output stage of the rasterizer, one instantiation per place of the tests and color write,
+        // and for multisampled targets
+        template<bool early_tests, bool color_write, bool multisample>
+        struct FragmentOutput
+        {
+            enum
+            {
+                EARLY_TESTS = early_tests,
+                // a fragment that may discard is shaded even without color, its tests wait for the fs
+                SHADE = color_write || !early_tests,
+                SAMPLES = multisample ? GLTileBuffer::MAX_SAMPLES : 1,
+            };
+
+            GLContext* context;
+            GLTileBuffer::Tile* tile;
+            const StencilFace* stencil;
+            // colors of a triangle's samples in the tile, blended together by Flush
+            int indices[GLTileBuffer::TILE_PIXELS * SAMPLES];
+            unsigned int colors[GLTileBuffer::TILE_PIXELS * SAMPLES];
+            int count;
+
+            bool EarlyTest(const Vector2i& p, float depth)
+            {
+                return context->FragmentTests(tile, GLTileBuffer::PixelIndex(p.x, p.y), depth, stencil);
+            }
+
+            void SetFragment(const Vector2i& p, const Vector4& c, float depth)
+            {
+                int index = GLTileBuffer::PixelIndex(p.x, p.y);
+
+                if (!early_tests && !context->FragmentTests(tile, index, depth, stencil))
+                {
+                    return;
+                }
+
+                if (color_write)
+                {
+                    indices[count] = index;
+                    colors[count] = GLOutputMerger::PackColor(c);
+                    ++count;
+                }
+            }
+
+            // each covered sample is tested on its own
+            int EarlyTestSamples(const Vector2i& p, const float* depths, int mask)
+            {
+                int index = GLTileBuffer::PixelIndex(p.x, p.y);
+
+                for (int i = 0; i < SAMPLES; ++i)
+                {
+                    if ((mask & (1 << i)) && !context->FragmentTests(tile, GLTileBuffer::SampleIndex(index, i), depths[i], stencil))
+                    {
+                        mask &= ~(1 << i);
+                    }
+                }
+
+                return mask;
+            }
+
+            // the pixel's color goes to every covered sample that passes
+            void SetFragmentSamples(const Vector2i& p, const Vector4& c, const float* depths, int mask)
+            {
+                if (!early_tests)
+                {
+                    mask = this->EarlyTestSamples(p, depths, mask);
+                }
+
+                if (color_write && mask != 0)
+                {
+                    int index = GLTileBuffer::PixelIndex(p.x, p.y);
+                    unsigned int color = GLOutputMerger::PackColor(c);
+
+                    for (int i = 0; i < SAMPLES; ++i)
+                    {
+                        if (mask & (1 << i))
+                        {
+                            indices[count] = GLTileBuffer::SampleIndex(index, i);
+                            colors[count] = color;
+                            ++count;
+                        }
+                    }
+                }
+            }
+
+            void Flush()
+            {
+                if (count > 0)
+                {
+                    context->m_output_merger.Colors(tile->color, indices, colors, count);
+                    count = 0;
+                }
+            }
         };
 
+        // GL_DEPTH_COMPONENT32_OES for float depth, GL_DEPTH_COMPONENT16, or GL_DEPTH24_STENCIL8_OES
+        // whose depth buffer also holds the stencil. takes effect with the next default buffers
+        void SetDefaultDepthFormat(GLenum format)
+        {
+            m_dirty |= DIRTY_FRAMEBUFFER;
+            if (format == GL_DEPTH_COMPONENT32_OES || format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH24_STENCIL8_OES)
+            {
+                m_default_depth_format = format;
+            }
+        }
+
+        // 1, or GLTileBuffer::MAX_SAMPLES to multisample the default buffers, which stay single
+        // sampled and get the resolved colors. takes effect with the next default buffers
+        void SetDefaultSamples(int samples)
+        {
+            m_dirty |= DIRTY_FRAMEBUFFER;
+            if (samples == 1 || samples == GLTileBuffer::MAX_SAMPLES)
+            {
+                m_default_samples = samples;
+            }
+        }
+
         void SetDefaultBuffers(void* color_buffer, void* depth_buffer, void* stencil_buffer, int width, int height)
         {
+            m_dirty |= DIRTY_FRAMEBUFFER | DIRTY_RASTER;
+            if (m_default_depth_format == GL_DEPTH24_STENCIL8_OES)
+            {
+                stencil_buffer = depth_buffer;
+            }
+
+            if (m_default_color_buffer && m_tiles.IsBound(m_default_color_buffer))
+            {
+                m_tiles.Swap((unsigned char*) color_buffer, depth_buffer, m_default_depth_format, (unsigned char*) stencil_buffer, width, height, m_default_samples);
+            }
+
             m_default_color_buffer = (unsigned char*) color_buffer;
-            m_default_depth_buffer = (float*) depth_buffer;
+            m_default_depth_buffer = depth_buffer;
             m_default_stencil_buffer = (unsigned char*) stencil_buffer;
             m_default_buffer_width = width;
             m_default_buffer_height = height;
@@ -75,110 +354,123 @@ namespace sgl
                 m_viewport_width = width;
                 m_viewport_height = height;
             }
+
+            if (m_scissor_x < 0)
+            {
+                m_scissor_x = 0;
+                m_scissor_y = 0;
+                m_scissor_width = width;
+                m_scissor_height = height;
+            }
         }
 
-        template<class T>
-        void GenObjects(GLsizei n, GLuint* objs)
+        // the context draws to nothing until it gets default buffers again, the tiles are stored first
+        void ReleaseDefaultBuffers()
         {
-            for (int i = 0; i < n; ++i)
+            m_dirty |= DIRTY_FRAMEBUFFER | DIRTY_RASTER;
+            if (m_default_color_buffer && m_tiles.IsBound(m_default_color_buffer))
             {
-                GLuint id = ++m_gen_id;
-                m_objects.Add(id, RefMake<T>(id));
-                objs[i] = id;
+                m_tiles.Unbind();
             }
+
+            m_default_color_buffer = nullptr;
+            m_default_depth_buffer = nullptr;
+            m_default_stencil_buffer = nullptr;
+            m_default_buffer_width = 0;
+            m_default_buffer_height = 0;
         }
 
-        typedef std::function<void(const Ref<GLObject>&)> OnRemoveObject;
+        const Ref<GLShareGroup>& GetShareGroup() const
+        {
+            return m_share_group;
+        }
 
         template<class T>
-        void DeleteObjects(GLsizei n, const GLuint* objs, OnRemoveObject on_remove = nullptr)
+        void GenObjects(GLHandleTable<T>& objects, GLsizei n, GLuint* objs)
         {
             for (int i = 0; i < n; ++i)
             {
-                Ref<GLObject>* find;
-                GLuint id = objs[i];
-                if (m_objects.TryGet(id, &find))
-                {
-                    Ref<T> obj = RefCast<T>(*find);
-                    if (obj)
-                    {
-                        m_objects.Remove(id);
-
-                        if (on_remove)
-                        {
-                            on_remove(obj);
-                        }
-                    }
-                }
+                objs[i] = objects.Create();
             }
         }
 
+        // called before the object is removed from its table, to drop the bindings to it
+        typedef std::function<void(GLObject*)> OnRemoveObject;
+
         template<class T>
-        GLboolean ObjectIs(GLuint obj)
+        void DeleteObjects(GLHandleTable<T>& objects, GLsizei n, const GLuint* objs, OnRemoveObject on_remove = nullptr)
         {
-            if (obj > 0)
+            for (int i = 0; i < n; ++i)
             {
-                Ref<GLObject>* find;
-                if (m_objects.TryGet(obj, &find))
+                T* obj = objects.Get(objs[i]);
+                if (obj)
                 {
-                    if (RefCast<T>(*find))
+                    if (on_remove)
                     {
-                        return GL_TRUE;
+                        on_remove(obj);
                     }
+
+                    objects.Remove(objs[i]);
                 }
             }
-
-            return GL_FALSE;
         }
 
         template<class T>
-        Ref<T> ObjectGet(GLuint obj)
+        GLboolean ObjectIs(const GLHandleTable<T>& objects, GLuint obj)
         {
-            if (obj > 0)
+            return objects.Get(obj) ? GL_TRUE : GL_FALSE;
+        }
+
+        // a name of a texture that has been bound as 2d
+        Ref<GLTexture2D> GetTexture2D(GLuint texture)
+        {
+            Ref<GLTexture> tex = m_textures.GetRef(texture);
+            if (tex && tex->GetTarget() == GL_TEXTURE_2D)
             {
-                Ref<GLObject>* find;
-                if (m_objects.TryGet(obj, &find))
-                {
-                    return RefCast<T>(*find);
-                }
+                return std::static_pointer_cast<GLTexture2D>(tex);
             }
 
-            return Ref<T>();
+            return Ref<GLTexture2D>();
+        }
+
+        // an attachment never outlives its object, whichever framebuffer holds it
+        void DetachFromFramebuffers(GLObject* obj)
+        {
+            m_framebuffers.ForEach([obj](GLFramebuffer* fb) {
+                fb->Detach(obj);
+            });
         }
 
         void GenFramebuffers(GLsizei n, GLuint* framebuffers)
         {
-            this->GenObjects<GLFramebuffer>(n, framebuffers);
+            this->GenObjects(m_framebuffers, n, framebuffers);
         }
 
         void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
         {
-            this->DeleteObjects<GLFramebuffer>(n, framebuffers, [this](const Ref<GLObject>& obj) {
-                if (!m_current_fb.expired() && m_current_fb.lock() == obj)
+            this->StoreFramebufferTiles();
+            m_dirty |= DIRTY_FRAMEBUFFER;
+            this->DeleteObjects(m_framebuffers, n, framebuffers, [this](GLObject* obj) {
+                if (m_current_fb == obj)
                 {
-                    m_current_fb.reset();
+                    m_current_fb = nullptr;
                 }
             });
         }
 
         GLboolean IsFramebuffer(GLuint framebuffer)
         {
-            return this->ObjectIs<GLFramebuffer>(framebuffer);
+            return this->ObjectIs(m_framebuffers, framebuffer);
         }
 
         void BindFramebuffer(GLenum target, GLuint framebuffer)
         {
             if (target == GL_FRAMEBUFFER)
             {
-                Ref<GLFramebuffer> fb = this->ObjectGet<GLFramebuffer>(framebuffer);
-                if (fb)
-                {
-                    m_current_fb = fb;
-                }
-                else
-                {
-                    m_current_fb.reset();
-                }
+                this->StoreFramebufferTiles();
+
+                m_current_fb = m_framebuffers.Get(framebuffer);
+                m_dirty |= DIRTY_FRAMEBUFFER;
             }
         }
 
@@ -188,15 +480,41 @@ namespace sgl
             {
                 if (renderbuffertarget == GL_RENDERBUFFER)
                 {
-                    if (!m_current_fb.expired())
+                    if (m_current_fb)
                     {
-                        Ref<GLFramebuffer> fb = m_current_fb.lock();
-                        Ref<GLRenderbuffer> rb = this->ObjectGet<GLRenderbuffer>(renderbuffer);
+                        GLFramebuffer* fb = m_current_fb;
+                        Ref<GLRenderbuffer> rb = m_renderbuffers.GetRef(renderbuffer);
 
                         GLFramebuffer::Attachment attach = fb->GetAttachment(attachment);
                         if (attach != GLFramebuffer::Attachment::None)
                         {
+                            this->StoreFramebufferTiles();
                             fb->SetAttachment(attach, rb);
+                            m_dirty |= DIRTY_FRAMEBUFFER;
+                        }
+                    }
+                }
+            }
+        }
+
+        void FramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+        {
+            if (target == GL_FRAMEBUFFER)
+            {
+                // only level 0 of a 2d texture, as in gles2
+                if (textarget == GL_TEXTURE_2D && level == 0)
+                {
+                    if (m_current_fb)
+                    {
+                        GLFramebuffer* fb = m_current_fb;
+                        Ref<GLTexture2D> tex = this->GetTexture2D(texture);
+
+                        GLFramebuffer::Attachment attach = fb->GetAttachment(attachment);
+                        if (attach != GLFramebuffer::Attachment::None)
+                        {
+                            this->StoreFramebufferTiles();
+                            fb->SetAttachment(attach, tex);
+                            m_dirty |= DIRTY_FRAMEBUFFER;
                         }
                     }
                 }
@@ -207,9 +525,9 @@ namespace sgl
         {
             if (target == GL_FRAMEBUFFER)
             {
-                if (!m_current_fb.expired())
+                if (m_current_fb)
                 {
-                    Ref<GLFramebuffer> fb = m_current_fb.lock();
+                    GLFramebuffer* fb = m_current_fb;
                     
                     GLFramebuffer::Attachment attach = fb->GetAttachment(attachment);
                     if (attach != GLFramebuffer::Attachment::None)
@@ -224,9 +542,9 @@ namespace sgl
         {
             if (target == GL_FRAMEBUFFER)
             {
-                if (!m_current_fb.expired())
+                if (m_current_fb)
                 {
-                    Ref<GLFramebuffer> fb = m_current_fb.lock();
+                    GLFramebuffer* fb = m_current_fb;
                     return fb->CheckStatus();
                 }
             }
@@ -234,6 +552,25 @@ namespace sgl
             return 0;
         }
 
+        void Finish()
+        {
+            m_tiles.Store(GLTileBuffer::COLOR);
+        }
+
+        // drawing is synchronous, flushing makes the color buffer current as finishing does
+        void Flush()
+        {
+            this->Finish();
+        }
+
+        // the back buffer of the surface goes to its outputs, drawing goes on in its next color buffer
+        void SwapBuffers(GLSurface* surface)
+        {
+            this->Finish();
+            surface->Present();
+            this->SetDefaultBuffers(surface->GetColorBuffer(), surface->GetDepthBuffer(), surface->GetStencilBuffer(), surface->GetWidth(), surface->GetHeight());
+        }
+
         void ReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels)
         {
             unsigned char* color_buffer = m_default_color_buffer;
@@ -260,38 +597,105 @@ namespace sgl
                     return;
             }
 
-            if (!m_current_fb.expired())
+            if (m_current_fb)
             {
-                color_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Color0, buffer_width, buffer_height);
+                GLenum depth_format;
+                color_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Color0, buffer_width, buffer_height, depth_format);
             }
 
-            int* dest = (int*) pixels;
+            // only the bound target can have pixels left in tiles
+            m_tiles.Store(GLTileBuffer::COLOR);
+
+            int dest_pitch = (width * 4 + m_pack_alignment - 1) / m_pack_alignment * m_pack_alignment;
+            unsigned char* dest = (unsigned char*) pixels;
             int* src = (int*) color_buffer;
             for (int i = 0; i < height; ++i)
             {
-                Memory::Copy(&dest[i * width], &src[(buffer_height - 1 - y - i) * buffer_width + x], width * 4);
+                Memory::Copy(&dest[i * dest_pitch], &src[(buffer_height - 1 - y - i) * buffer_width + x], width * 4);
+            }
+        }
+
+        // color_texture is the texture the color is rendered to, null for a renderbuffer or the default buffer
+        void GetDrawTarget(DrawTarget& target, GLTexture2D*& color_texture)
+        {
+            color_texture = nullptr;
+
+            target.color_buffer = m_default_color_buffer;
+            target.depth_buffer = m_default_depth_buffer;
+            target.depth_format = m_default_depth_format;
+            target.stencil_buffer = m_default_stencil_buffer;
+            target.width = m_default_buffer_width;
+            target.height = m_default_buffer_height;
+            target.samples = m_default_samples;
+
+            if (m_current_fb)
+            {
+                GLenum color_format;
+                GLenum stencil_format;
+                // framebuffer objects are single sampled
+                target.samples = 1;
+                target.color_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Color0, target.width, target.height, color_format);
+                target.depth_buffer = this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Depth, target.width, target.height, target.depth_format);
+                target.stencil_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Stencil, target.width, target.height, stencil_format);
+
+                // attachments of the wrong kind are left out, a packed stencil is only read through its depth attachment
+                if (color_format != 0)
+                {
+                    target.color_buffer = nullptr;
+                }
+                if (target.color_buffer)
+                {
+                    color_texture = m_current_fb->GetTexture2D(GLFramebuffer::Attachment::Color0);
+                }
+                if (target.depth_format == 0)
+                {
+                    target.depth_buffer = nullptr;
+                }
+                if (stencil_format != 0 && (void*) target.stencil_buffer != target.depth_buffer)
+                {
+                    target.stencil_buffer = nullptr;
+                }
+            }
+        }
+
+        void BindTiles(const DrawTarget& target)
+        {
+            m_tiles.Bind(target.color_buffer, target.depth_buffer, target.depth_format, target.stencil_buffer, target.width, target.height, target.samples);
+        }
+
+        // the tiles may hold pixels of an attachment of the current framebuffer that is about to change
+        void StoreFramebufferTiles()
+        {
+            if (m_current_fb)
+            {
+                m_tiles.Unbind();
             }
         }
 
-        void* GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment attachment, int& width, int& height)
+        // depth_format is the renderbuffer's GLTileBuffer depth format, 0 if it holds no depth
+        void* GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment attachment, int& width, int& height, GLenum& depth_format)
         {
             void* buffer = nullptr;
+            depth_format = 0;
 
-            Ref<GLFramebuffer> fb = m_current_fb.lock();
-            GLint attached_type;
-            GLint attached_obj;
-            fb->GetAttachmentParameteriv(attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &attached_type);
-            fb->GetAttachmentParameteriv(attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &attached_obj);
-            if (attached_type == GL_RENDERBUFFER)
+            GLRenderbuffer* rb = m_current_fb->GetRenderbuffer(attachment);
+            GLTexture2D* tex = m_current_fb->GetTexture2D(attachment);
+            if (rb)
             {
-                Ref<GLRenderbuffer> rb = this->ObjectGet<GLRenderbuffer>(attached_obj);
                 buffer = rb->GetBuffer();
                 width = rb->GetWidth();
                 height = rb->GetHeight();
+                depth_format = rb->GetDepthFormat();
             }
-            else if (attached_type == GL_TEXTURE)
+            else if (tex)
             {
-                //TODO: render to texture
+                // textures can only be rendered as color, the texture resolves its render buffer when it is sampled
+                if (attachment == GLFramebuffer::Attachment::Color0)
+                {
+                    buffer = tex->GetRenderBuffer();
+                    width = tex->GetWidth();
+                    height = tex->GetHeight();
+                }
             }
 
             return buffer;
@@ -299,37 +703,32 @@ namespace sgl
 
         void GenRenderbuffers(GLsizei n, GLuint* renderbuffers)
         {
-            this->GenObjects<GLRenderbuffer>(n, renderbuffers);
+            this->GenObjects(m_renderbuffers, n, renderbuffers);
         }
 
         void DeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
         {
-            this->DeleteObjects<GLRenderbuffer>(n, renderbuffers, [this](const Ref<GLObject>& obj) {
-                if (!m_current_rb.expired() && m_current_rb.lock() == obj)
+            this->StoreFramebufferTiles();
+            m_dirty |= DIRTY_FRAMEBUFFER;
+            this->DeleteObjects(m_renderbuffers, n, renderbuffers, [this](GLObject* obj) {
+                if (m_current_rb.get() == obj)
                 {
-                    m_current_rb.reset();
+                    m_current_rb = nullptr;
                 }
+                this->DetachFromFramebuffers(obj);
             });
         }
 
         GLboolean IsRenderbuffer(GLuint renderbuffer)
         {
-            return this->ObjectIs<GLRenderbuffer>(renderbuffer);
+            return this->ObjectIs(m_renderbuffers, renderbuffer);
         }
 
         void BindRenderbuffer(GLenum target, GLuint renderbuffer)
         {
             if (target == GL_RENDERBUFFER)
             {
-                Ref<GLRenderbuffer> rb = this->ObjectGet<GLRenderbuffer>(renderbuffer);
-                if (rb)
-                {
-                    m_current_rb = rb;
-                }
-                else
-                {
-                    m_current_rb.reset();
-                }
+                m_current_rb = m_renderbuffers.GetRef(renderbuffer);
             }
         }
 
@@ -337,10 +736,13 @@ namespace sgl
         {
             if (target == GL_RENDERBUFFER)
             {
-                if (!m_current_rb.expired())
+                if (m_current_rb)
                 {
-                    Ref<GLRenderbuffer> rb = m_current_rb.lock();
+                    GLRenderbuffer* rb = m_current_rb.get();
+                    this->StoreFramebufferTiles();
                     rb->Storage(internalformat, width, height);
+                    m_dirty |= DIRTY_FRAMEBUFFER;
+                    this->ChangeSharedObject();
                 }
             }
         }
@@ -349,9 +751,9 @@ namespace sgl
         {
             if (target == GL_RENDERBUFFER)
             {
-                if (!m_current_rb.expired())
+                if (m_current_rb)
                 {
-                    Ref<GLRenderbuffer> rb = m_current_rb.lock();
+                    GLRenderbuffer* rb = m_current_rb.get();
 
                     switch (pname)
                     {
@@ -396,6 +798,16 @@ namespace sgl
             m_viewport_y = y;
             m_viewport_width = width;
             m_viewport_height = height;
+            m_dirty |= DIRTY_RASTER;
+        }
+
+        void Scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+        {
+            m_scissor_x = x;
+            m_scissor_y = y;
+            m_scissor_width = width;
+            m_scissor_height = height;
+            m_dirty |= DIRTY_RASTER;
         }
 
         void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
@@ -415,72 +827,88 @@ namespace sgl
 
         void Clear(GLbitfield mask)
         {
-            int x = m_viewport_x;
-            int y = m_viewport_y;
-            int width = m_viewport_width;
-            int height = m_viewport_height;
+            this->ValidateDrawState();
+            const DrawTarget& target = m_draw_state.target;
 
-            unsigned char* color_buffer = m_default_color_buffer;
-            float* depth_buffer = m_default_depth_buffer;
-            unsigned char* stencil_buffer = m_default_stencil_buffer;
-            int buffer_width = m_default_buffer_width;
-            int buffer_height = m_default_buffer_height;
+            // the viewport does not apply to clears, the scissor and the write masks do
+            int min_x = 0;
+            int min_y = 0;
+            int max_x = target.width - 1;
+            int max_y = target.height - 1;
+            if (m_scissor_test_enable)
+            {
+                min_x = Mathf::Max(min_x, m_scissor_x);
+                min_y = Mathf::Max(min_y, m_scissor_y);
+                max_x = Mathf::Min(max_x, m_scissor_x + m_scissor_width - 1);
+                max_y = Mathf::Min(max_y, m_scissor_y + m_scissor_height - 1);
+            }
+            if (min_x > max_x || min_y > max_y)
+            {
+                return;
+            }
 
-            if (!m_current_fb.expired())
+            GLTileBuffer::ClearValue write_mask;
+            for (int i = 0; i < 4; ++i)
             {
-                color_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Color0, buffer_width, buffer_height);
-                depth_buffer = (float*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Depth, buffer_width, buffer_height);
-                stencil_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Stencil, buffer_width, buffer_height);
+                write_mask.color[i] = m_color_mask[i] ? 0xff : 0;
             }
+            write_mask.depth = 0;
+            // the front write mask applies to stencil clears
+            write_mask.stencil = (unsigned char) m_stencil[0].write_mask;
 
-            if (mask & GL_COLOR_BUFFER_BIT)
+            int buffers = 0;
+            int masked_buffers = 0;
+            if ((mask & GL_COLOR_BUFFER_BIT) && target.color_buffer)
             {
-                if (color_buffer)
+                unsigned int color_mask;
+                Memory::Copy(&color_mask, write_mask.color, 4);
+                if (color_mask == 0xffffffff)
                 {
-                    unsigned char r = FloatToColorByte(m_clear_color.x);
-                    unsigned char g = FloatToColorByte(m_clear_color.y);
-                    unsigned char b = FloatToColorByte(m_clear_color.z);
-                    unsigned char a = FloatToColorByte(m_clear_color.w);
-
-                    for (int i = y; i < y + height && i < buffer_height; ++i)
-                    {
-                        for (int j = x; j < x + width && j < buffer_width; ++j)
-                        {
-                            color_buffer[i * buffer_width * 4 + j * 4 + 0] = r;
-                            color_buffer[i * buffer_width * 4 + j * 4 + 1] = g;
-                            color_buffer[i * buffer_width * 4 + j * 4 + 2] = b;
-                            color_buffer[i * buffer_width * 4 + j * 4 + 3] = a;
-                        }
-                    }
+                    buffers |= GLTileBuffer::COLOR;
+                }
+                else if (color_mask != 0)
+                {
+                    masked_buffers |= GLTileBuffer::COLOR;
                 }
             }
-
-            if (mask & GL_DEPTH_BUFFER_BIT)
+            if ((mask & GL_DEPTH_BUFFER_BIT) && m_depth_mask && target.depth_buffer)
+            {
+                buffers |= GLTileBuffer::DEPTH;
+            }
+            if ((mask & GL_STENCIL_BUFFER_BIT) && target.stencil_buffer)
             {
-                if (m_depth_mask && depth_buffer)
+                if (write_mask.stencil == 0xff)
                 {
-                    for (int i = y; i < y + height && i < buffer_height; ++i)
-                    {
-                        for (int j = x; j < x + width && j < buffer_width; ++j)
-                        {
-                            depth_buffer[i * buffer_width + j] = m_clear_depth;
-                        }
-                    }
+                    buffers |= GLTileBuffer::STENCIL;
+                }
+                else if (write_mask.stencil != 0)
+                {
+                    masked_buffers |= GLTileBuffer::STENCIL;
                 }
             }
 
-            if (mask & GL_STENCIL_BUFFER_BIT)
+            if (buffers == 0 && masked_buffers == 0)
             {
-                if (stencil_buffer)
-                {
-                    for (int i = y; i < y + height && i < buffer_height; ++i)
-                    {
-                        for (int j = x; j < x + width && j < buffer_width; ++j)
-                        {
-                            stencil_buffer[i * buffer_width + j] = (unsigned char) m_clear_stencil;
-                        }
-                    }
-                }
+                return;
+            }
+
+            this->BindTiles(target);
+
+            GLTileBuffer::ClearValue value;
+            value.color[0] = this->FloatToColorByte(m_clear_color.x);
+            value.color[1] = this->FloatToColorByte(m_clear_color.y);
+            value.color[2] = this->FloatToColorByte(m_clear_color.z);
+            value.color[3] = this->FloatToColorByte(m_clear_color.w);
+            value.depth = m_clear_depth;
+            value.stencil = (unsigned char) m_clear_stencil;
+
+            if (buffers != 0)
+            {
+                m_tiles.Clear(buffers, value, min_x, min_y, max_x, max_y);
+            }
+            if (masked_buffers != 0)
+            {
+                m_tiles.ClearMasked(masked_buffers, value, write_mask, min_x, min_y, max_x, max_y);
             }
         }
 
@@ -490,9 +918,12 @@ namespace sgl
 
             if (type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER)
             {
-                this->GenObjects<GLShader>(1, &shader);
-                Ref<GLShader> obj = this->ObjectGet<GLShader>(shader);
-                obj->SetType(type);
+                this->GenObjects(m_shaders, 1, &shader);
+                GLShader* obj = m_shaders.Get(shader);
+                if (obj)
+                {
+                    obj->SetType(type);
+                }
             }
 
             return shader;
@@ -500,17 +931,17 @@ namespace sgl
 
         void DeleteShader(GLuint shader)
         {
-            this->DeleteObjects<GLShader>(1, &shader);
+            this->DeleteObjects(m_shaders, 1, &shader);
         }
 
         GLboolean IsShader(GLuint shader)
         {
-            return this->ObjectIs<GLShader>(shader);
+            return this->ObjectIs(m_shaders, shader);
         }
 
         void ShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)
         {
-            Ref<GLShader> obj = this->ObjectGet<GLShader>(shader);
+            GLShader* obj = m_shaders.Get(shader);
             if (obj)
             {
                 obj->SetSource(count, string, length);
@@ -519,7 +950,7 @@ namespace sgl
 
         void GetShaderSource(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* source)
         {
-            Ref<GLShader> obj = this->ObjectGet<GLShader>(shader);
+            GLShader* obj = m_shaders.Get(shader);
             if (obj)
             {
                 obj->GetSource(bufSize, length, source);
@@ -528,7 +959,7 @@ namespace sgl
 
         void CompileShader(GLuint shader)
         {
-            Ref<GLShader> obj = this->ObjectGet<GLShader>(shader);
+            GLShader* obj = m_shaders.Get(shader);
             if (obj)
             {
                 obj->Compile();
@@ -538,26 +969,33 @@ namespace sgl
         GLuint CreateProgram()
         {
             GLuint program = 0;
-            this->GenObjects<GLProgram>(1, &program);
+            this->GenObjects(m_programs, 1, &program);
             return program;
         }
 
         void DeleteProgram(GLuint program)
         {
-            this->DeleteObjects<GLProgram>(1, &program);
+            m_dirty |= DIRTY_PROGRAM;
+            this->DeleteObjects(m_programs, 1, &program, [this](GLObject* obj) {
+                if (m_using_program.get() == obj)
+                {
+                    m_using_program = nullptr;
+                }
+            });
         }
 
         GLboolean IsProgram(GLuint program)
         {
-            return this->ObjectIs<GLProgram>(program);
+            return this->ObjectIs(m_programs, program);
         }
 
         void AttachShader(GLuint program, GLuint shader)
         {
-            Ref<GLProgram> p = this->ObjectGet<GLProgram>(program);
+            GLProgram* p = m_programs.Get(program);
             if (p)
             {
-                Ref<GLShader> s = this->ObjectGet<GLShader>(shader);
+                // the program owns its shaders, a deleted shader lives on until it is detached
+                Ref<GLShader> s = m_shaders.GetRef(shader);
                 if (s)
                 {
                     p->AttachShader(s);
@@ -567,7 +1005,7 @@ namespace sgl
 
         void DetachShader(GLuint program, GLuint shader)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            GLProgram* obj = m_programs.Get(program);
             if (obj)
             {
                 obj->DetachShader(shader);
@@ -576,7 +1014,7 @@ namespace sgl
 
         void GetAttachedShaders(GLuint program, GLsizei maxCount, GLsizei* count, GLuint* shaders)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            GLProgram* obj = m_programs.Get(program);
             if (obj)
             {
                 obj->GetAttachedShaders(maxCount, count, shaders);
@@ -585,7 +1023,7 @@ namespace sgl
 
         void BindAttribLocation(GLuint program, GLuint index, const GLchar* name)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            GLProgram* obj = m_programs.Get(program);
             if (obj)
             {
                 obj->BindAttribLocation(index, name);
@@ -594,16 +1032,18 @@ namespace sgl
 
         void LinkProgram(GLuint program)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            GLProgram* obj = m_programs.Get(program);
             if (obj)
             {
                 obj->Link();
+                m_dirty |= DIRTY_PROGRAM;
+                this->ChangeSharedObject();
             }
         }
 
         GLint GetAttribLocation(GLuint program, const GLchar* name)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            GLProgram* obj = m_programs.Get(program);
             if (obj)
             {
                 return obj->GetAttribLocation(name);
@@ -614,7 +1054,7 @@ namespace sgl
 
         GLint GetUniformLocation(GLuint program, const GLchar* name)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            GLProgram* obj = m_programs.Get(program);
             if (obj)
             {
                 return obj->GetUniformLocation(name);
@@ -625,33 +1065,26 @@ namespace sgl
 
         void UseProgram(GLuint program)
         {
-            Ref<GLProgram> obj = this->ObjectGet<GLProgram>(program);
+            Ref<GLProgram> obj = m_programs.GetRef(program);
             if (obj)
             {
-                m_using_program = obj;
                 obj->Use();
             }
-            else
-            {
-                m_using_program.reset();
-            }
+            m_using_program = obj;
+            m_dirty |= DIRTY_PROGRAM;
         }
 
         void Uniform1i(GLint location, GLint v0)
         {
-            if (!m_using_program.expired())
+            if (m_using_program)
             {
-                Ref<GLProgram> program = m_using_program.lock();
+                GLProgram* program = m_using_program.get();
                 if (program->IsUniformSampler2D(location))
                 {
-                    WeakRef<GLTexture> tex = m_texture_units[m_active_texture_unit - GL_TEXTURE0];
-                    if (!tex.expired())
+                    GLTexture2D* tex2d = m_texture_units[m_active_texture_unit - GL_TEXTURE0].get();
+                    if (tex2d)
                     {
-                        Ref<GLTexture2D> tex2d = RefCast<GLTexture2D>(tex.lock());
-                        if (tex2d)
-                        {
-                            program->UniformSampler2D(location, tex2d);
-                        }
+                        program->UniformSampler2D(location, tex2d);
                     }
                 }
                 else
@@ -663,61 +1096,65 @@ namespace sgl
 
         void Uniform4fv(GLint location, GLsizei count, const GLfloat* value)
         {
-            if (!m_using_program.expired())
+            if (m_using_program)
             {
-                Ref<GLProgram> program = m_using_program.lock();
+                GLProgram* program = m_using_program.get();
                 program->Uniformv(location, count * sizeof(Vector4), value);
             }
         }
 
         void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
         {
-            if (!m_using_program.expired())
+            if (m_using_program)
             {
-                Ref<GLProgram> program = m_using_program.lock();
+                GLProgram* program = m_using_program.get();
                 program->UniformMatrix4fv(location, count, transpose, value);
             }
         }
         
         void GenBuffers(GLsizei n, GLuint* buffers)
         {
-            this->GenObjects<GLBuffer>(n, buffers);
+            this->GenObjects(m_buffers, n, buffers);
         }
 
         void DeleteBuffers(GLsizei n, const GLuint* buffers)
         {
-            this->DeleteObjects<GLBuffer>(n, buffers);
+            m_dirty |= DIRTY_VERTEX_INPUT;
+            this->DeleteObjects(m_buffers, n, buffers, [this](GLObject* obj) {
+                if (m_current_vb.get() == obj)
+                {
+                    m_current_vb = nullptr;
+                }
+                if (m_current_ib.get() == obj)
+                {
+                    m_current_ib = nullptr;
+                }
+                for (int i = 0; i < m_vertex_attrib_arrays.Size(); ++i)
+                {
+                    if (m_vertex_attrib_arrays[i].vb.get() == obj)
+                    {
+                        m_vertex_attrib_arrays[i].vb = nullptr;
+                    }
+                }
+            });
         }
 
         GLboolean IsBuffer(GLuint buffer)
         {
-            return this->ObjectIs<GLBuffer>(buffer);
+            return this->ObjectIs(m_buffers, buffer);
         }
 
         void BindBuffer(GLenum target, GLuint buffer)
         {
-            Ref<GLBuffer> obj = this->ObjectGet<GLBuffer>(buffer);
+            Ref<GLBuffer> obj = m_buffers.GetRef(buffer);
             switch (target)
             {
                 case GL_ARRAY_BUFFER:
-                    if (obj)
-                    {
-                        m_current_vb = obj;
-                    }
-                    else
-                    {
-                        m_current_vb.reset();
-                    }
+                    m_current_vb = obj;
                     break;
                 case GL_ELEMENT_ARRAY_BUFFER:
-                    if (obj)
-                    {
-                        m_current_ib = obj;
-                    }
-                    else
-                    {
-                        m_current_ib.reset();
-                    }
+                    m_current_ib = obj;
+                    m_dirty |= DIRTY_VERTEX_INPUT;
                     break;
                 default:
                     break;
@@ -726,18 +1163,22 @@ namespace sgl
 
         void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
         {
+            // the data of a buffer moves with its size, vertex inputs point into it
+            m_dirty |= DIRTY_VERTEX_INPUT;
+            this->ChangeSharedObject();
+
             switch (target)
             {
                 case GL_ARRAY_BUFFER:
-                    if (!m_current_vb.expired())
+                    if (m_current_vb)
                     {
-                        m_current_vb.lock()->BufferData(size, data, usage);
+                        m_current_vb->BufferData(size, data, usage);
                     }
                     break;
                 case GL_ELEMENT_ARRAY_BUFFER:
-                    if (!m_current_ib.expired())
+                    if (m_current_ib)
                     {
-                        m_current_ib.lock()->BufferData(size, data, usage);
+                        m_current_ib->BufferData(size, data, usage);
                     }
                     break;
                 default:
@@ -750,15 +1191,15 @@ namespace sgl
             switch (target)
             {
                 case GL_ARRAY_BUFFER:
-                    if (!m_current_vb.expired())
+                    if (m_current_vb)
                     {
-                        m_current_vb.lock()->BufferSubData(offset, size, data);
+                        m_current_vb->BufferSubData(offset, size, data);
                     }
                     break;
                 case GL_ELEMENT_ARRAY_BUFFER:
-                    if (!m_current_ib.expired())
+                    if (m_current_ib)
                     {
-                        m_current_ib.lock()->BufferSubData(offset, size, data);
+                        m_current_ib->BufferSubData(offset, size, data);
                     }
                     break;
                 default:
@@ -768,6 +1209,8 @@ namespace sgl
 
         void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
         {
+            m_dirty |= DIRTY_VERTEX_INPUT;
+
             VertexAttribArray va;
             va.enable = false;
             va.index = index;
@@ -801,6 +1244,8 @@ namespace sgl
 
         void EnableVertexAttribArray(GLuint index)
         {
+            m_dirty |= DIRTY_VERTEX_INPUT;
+
             int exist_index = -1;
             for (int i = 0; i < m_vertex_attrib_arrays.Size(); ++i)
             {
@@ -825,6 +1270,7 @@ namespace sgl
                 va.normalized = 0;
                 va.stride = 0;
                 va.pointer = 0;
+                va.vb = nullptr;
 
                 m_vertex_attrib_arrays.Add(va);
             }
@@ -832,6 +1278,8 @@ namespace sgl
 
         void DisableVertexAttribArray(GLuint index)
         {
+            m_dirty |= DIRTY_VERTEX_INPUT;
+
             int exist_index = -1;
             for (int i = 0; i < m_vertex_attrib_arrays.Size(); ++i)
             {
@@ -845,688 +1293,1870 @@ namespace sgl
             if (exist_index >= 0)
             {
                 m_vertex_attrib_arrays[exist_index].enable = false;
-                m_vertex_attrib_arrays[exist_index].vb.reset();
+                m_vertex_attrib_arrays[exist_index].vb = nullptr;
             }
         }
 
         void DrawArrays(GLenum mode, GLint first, GLsizei count)
         {
-            switch (mode)
-            {
-                case GL_TRIANGLES:
-                    this->DrawArraysTriangles(first, count / 3);
-                    break;
-                default:
-                    break;
-            }
+            this->MultiDrawArraysEXT(mode, &first, &count, 1);
         }
 
         void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
         {
-            switch (mode)
+            this->MultiDrawElementsEXT(mode, &count, type, &indices, 1);
+        }
+
+        void MultiDrawArraysEXT(GLenum mode, const GLint* first, const GLsizei* count, GLsizei primcount)
+        {
+            const DrawState* state = this->BeginDraw(mode);
+            if (state == nullptr)
             {
-                case GL_TRIANGLES:
-                    this->DrawElementsTriangles(count / 3, type, indices);
-                    break;
-                default:
-                    break;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(state->program->GetDrawMutex());
+
+            for (int i = 0; i < primcount; ++i)
+            {
+                this->DrawArraysTriangles(*state, first[i], count[i] / 3);
             }
         }
 
-        void ApplyVertexAttribs(const Ref<GLProgram>& program, unsigned int index)
+        void MultiDrawElementsEXT(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices, GLsizei primcount)
         {
-            for (int k = 0; k < m_vertex_attrib_arrays.Size(); ++k) // attrib
+            const DrawState* state = this->BeginDraw(mode);
+            if (state == nullptr)
             {
-                const VertexAttribArray& va = m_vertex_attrib_arrays[k];
-                if (va.enable)
-                {
-                    int size = 0;
-                    switch (va.type)
-                    {
-                        case GL_BYTE:
-                        case GL_UNSIGNED_BYTE:
-                            size = va.size * 1;
-                            break;
-                        case GL_SHORT:
-                        case GL_UNSIGNED_SHORT:
-                        case GL_FIXED:
-                            size = va.size * 2;
-                            break;
-                        case GL_FLOAT:
-                            size = va.size * 4;
-                            break;
-                        default:
-                            break;
-                    }
+                return;
+            }
+            std::lock_guard<std::mutex> lock(state->program->GetDrawMutex());
 
-                    if (!va.vb.expired())
-                    {
-                        Ref<GLBuffer> vb = va.vb.lock();
-                        char* p = (char*) vb->GetData();
-                        int offset = (int) (size_t) va.pointer;
-                        program->SetVertexAttrib(va.index, &p[index * va.stride + offset], size);
-                    }
-                    else
-                    {
-                        char* p = (char*) va.pointer;
-                        program->SetVertexAttrib(va.index, &p[index * va.stride], size);
-                    }
-                }
+            if (this->GetIndexTypeSize(type) == 0)
+            {
+                return;
+            }
+
+            for (int i = 0; i < primcount; ++i)
+            {
+                this->DrawElementsTriangles(*state, count[i] / 3, type, indices[i]);
             }
         }
 
-        Vector3 BlendColorFactor(const Vector3& src_color, float src_alpha, const Vector3& dest_color, float dest_alpha, GLenum factor)
+        void DrawArraysBatchSGL(GLenum mode, const GLDrawCommandSGL* commands, GLsizei drawcount)
         {
-            switch (factor)
+            const DrawState* state = this->BeginDraw(mode);
+            if (state == nullptr)
             {
-                case GL_ZERO:
-                    return Vector3(0, 0, 0);
-                case GL_ONE:
-                    return Vector3(1, 1, 1);
-                case GL_SRC_COLOR:
-                    return src_color;
-                case GL_ONE_MINUS_SRC_COLOR:
-                    return Vector3(1 - src_color.x, 1 - src_color.y, 1 - src_color.z);
-                case GL_DST_COLOR:
-                    return dest_color;
-                case GL_ONE_MINUS_DST_COLOR:
-                    return Vector3(1 - dest_color.x, 1 - dest_color.y, 1 - dest_color.z);
-                case GL_SRC_ALPHA:
-                    return Vector3(src_alpha, src_alpha, src_alpha);
-                case GL_ONE_MINUS_SRC_ALPHA:
-                    return Vector3(1 - src_alpha, 1 - src_alpha, 1 - src_alpha);
-                case GL_DST_ALPHA:
-                    return Vector3(dest_alpha, dest_alpha, dest_alpha);
-                case GL_ONE_MINUS_DST_ALPHA:
-                    return Vector3(1 - dest_alpha, 1 - dest_alpha, 1 - dest_alpha);
-                case GL_CONSTANT_COLOR:
-                    return Vector3(m_blend_color.x, m_blend_color.y, m_blend_color.z);
-                case GL_ONE_MINUS_CONSTANT_COLOR:
-                    return Vector3(1 - m_blend_color.x, 1 - m_blend_color.y, 1 - m_blend_color.z);
-                case GL_CONSTANT_ALPHA:
-                    return Vector3(m_blend_color.w, m_blend_color.w, m_blend_color.w);
-                case GL_ONE_MINUS_CONSTANT_ALPHA:
-                    return Vector3(1 - m_blend_color.w, 1 - m_blend_color.w, 1 - m_blend_color.w);
-                case GL_SRC_ALPHA_SATURATE:
-                {
-                    float i = Mathf::Min(src_alpha, 1 - dest_alpha);
-                    return Vector3(i, i, i);
-                }
+                return;
             }
+            std::lock_guard<std::mutex> lock(state->program->GetDrawMutex());
 
-            return Vector3(0, 0, 0);
+            for (int i = 0; i < drawcount; ++i)
+            {
+                const GLDrawCommandSGL& cmd = commands[i];
+                this->ApplyDrawCommandUniform(*state, cmd);
+                this->DrawArraysTriangles(*state, cmd.first, cmd.count / 3);
+            }
         }
 
-        float BlendAlphaFactor(const Vector3& src_color, float src_alpha, const Vector3& dest_color, float dest_alpha, GLenum factor)
+        void DrawElementsBatchSGL(GLenum mode, GLenum type, const GLDrawCommandSGL* commands, GLsizei drawcount)
         {
-            switch (factor)
+            const DrawState* state = this->BeginDraw(mode);
+            if (state == nullptr)
             {
-                case GL_ZERO:
-                    return 0;
-                case GL_ONE:
-                    return 1;
-                case GL_SRC_COLOR:
-                    return src_alpha;
-                case GL_ONE_MINUS_SRC_COLOR:
-                    return 1 - src_alpha;
-                case GL_DST_COLOR:
-                    return dest_alpha;
-                case GL_ONE_MINUS_DST_COLOR:
-                    return 1 - dest_alpha;
-                case GL_SRC_ALPHA:
-                    return src_alpha;
-                case GL_ONE_MINUS_SRC_ALPHA:
-                    return 1 - src_alpha;
-                case GL_DST_ALPHA:
-                    return dest_alpha;
-                case GL_ONE_MINUS_DST_ALPHA:
-                    return 1 - dest_alpha;
-                case GL_CONSTANT_COLOR:
-                    return m_blend_color.w;
-                case GL_ONE_MINUS_CONSTANT_COLOR:
-                    return 1 - m_blend_color.w;
-                case GL_CONSTANT_ALPHA:
-                    return m_blend_color.w;
-                case GL_ONE_MINUS_CONSTANT_ALPHA:
-                    return 1 - m_blend_color.w;
-                case GL_SRC_ALPHA_SATURATE:
-                    return 1;
+                return;
             }
+            std::lock_guard<std::mutex> lock(state->program->GetDrawMutex());
 
-            return 0;
+            if (this->GetIndexTypeSize(type) == 0)
+            {
+                return;
+            }
+
+            for (int i = 0; i < drawcount; ++i)
+            {
+                const GLDrawCommandSGL& cmd = commands[i];
+                this->ApplyDrawCommandUniform(*state, cmd);
+                this->DrawElementsTriangles(*state, cmd.count / 3, type, cmd.indices);
+            }
         }
 
-        Vector4 DoBlend(const Vector3& src_color, float src_alpha, const Vector3& dest_color, float dest_alpha)
+        // the validated draw state shared by every draw of a call, null if nothing can be drawn
+        const DrawState* BeginDraw(GLenum mode)
         {
-            Vector3 src_factor_c = BlendColorFactor(src_color, src_alpha, dest_color, dest_alpha, m_blend_src_factor_c);
-            float src_factor_a = BlendAlphaFactor(src_color, src_alpha, dest_color, dest_alpha, m_blend_src_factor_a);
-            Vector3 dest_factor_c = BlendColorFactor(src_color, src_alpha, dest_color, dest_alpha, m_blend_dest_factor_c);
-            float dest_factor_a = BlendAlphaFactor(src_color, src_alpha, dest_color, dest_alpha, m_blend_dest_factor_a);
+            if (mode != GL_TRIANGLES)
+            {
+                return nullptr;
+            }
 
-            Vector3 color = src_color;
-            float alpha = src_alpha;
+            this->ValidateDrawState();
 
-            switch (m_blend_equation_c)
+            const DrawState& state = m_draw_state;
+            if (state.program == nullptr)
             {
-                case GL_FUNC_ADD:
-                    color = src_color * src_factor_c + dest_color * dest_factor_c;
-                    break;
-                case GL_FUNC_SUBTRACT:
-                    color = src_color * src_factor_c - dest_color * dest_factor_c;
-                    break;
-                case GL_FUNC_REVERSE_SUBTRACT:
-                    color = dest_color * dest_factor_c - src_color * src_factor_c;
-                    break;
+                return nullptr;
             }
-
-            switch (m_blend_equation_a)
+            // depth and stencil are optional, their tests pass without a buffer
+            if (state.target.color_buffer == nullptr)
             {
-                case GL_FUNC_ADD:
-                    alpha = src_alpha * src_factor_a + dest_alpha * dest_factor_a;
-                    break;
-                case GL_FUNC_SUBTRACT:
-                    alpha = src_alpha * src_factor_a - dest_alpha * dest_factor_a;
-                    break;
-                case GL_FUNC_REVERSE_SUBTRACT:
-                    alpha = dest_alpha * dest_factor_a - src_alpha * src_factor_a;
-                    break;
+                return nullptr;
             }
 
-            return Vector4(color.x, color.y, color.z, alpha);
+            this->BindTiles(state.target);
+            m_bins.Resize(m_tiles.GetTilesX() * m_tiles.GetTilesY());
+
+            // after the tiles of a texture left as target were stored to its render buffer
+            state.program->ResolveSamplerTextures();
+
+            return &state;
         }
 
-        void Rasterize(unsigned char* color_buffer, float* depth_buffer, int buffer_width, int buffer_height, const Ref<GLProgram>& program,
-            const Vector4* positions, const Vector<GLProgram::Varying>* varyings)
+        // rebuilds the groups of the draw state whose gl state changed since the last draw or clear
+        void ValidateDrawState()
         {
-            float cross = (positions[1].x - positions[0].x) * (positions[2].y - positions[1].y)
-                - (positions[2].x - positions[1].x) * (positions[1].y - positions[0].y);
+            DrawState& state = m_draw_state;
 
-            if (m_cull_face_enable == false || this->CullFaceTest(cross))
+            unsigned int changes = m_share_group->changes.load();
+            if (changes != m_share_changes)
             {
-                auto set_fragment = [=](const Vector2i& p, const Vector4& c, float depth) {
-                    if (p.x >= 0 && p.x <= buffer_width - 1 &&
-                        p.y >= 0 && p.y <= buffer_height - 1)
-                    {
-                        float old_depth = depth_buffer[p.y * buffer_width + p.x];
-                        float mapped_depth = m_depth_range.x + (depth + 1) / 2 * (m_depth_range.y - m_depth_range.x);
-
-                        if (m_depth_test_enable == false || DepthTest(mapped_depth, old_depth))
-                        {
-                            if (m_blend_enable)
-                            {
-                                Vector3 src_color(c.x, c.y, c.z);
-                                float src_alpha = c.w;
-                                Vector3 dest_color(
-                                    color_buffer[p.y * buffer_width * 4 + p.x * 4 + 0] / 255.0f,
-                                    color_buffer[p.y * buffer_width * 4 + p.x * 4 + 1] / 255.0f,
-                                    color_buffer[p.y * buffer_width * 4 + p.x * 4 + 2] / 255.0f);
-                                float dest_alpha = color_buffer[p.y * buffer_width * 4 + p.x * 4 + 3] / 255.0f;
-
-                                Vector4 color = this->DoBlend(src_color, src_alpha, dest_color, dest_alpha);
-
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 0] = this->FloatToColorByte(color.x);
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 1] = this->FloatToColorByte(color.y);
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 2] = this->FloatToColorByte(color.z);
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 3] = this->FloatToColorByte(color.w);
-                            }
-                            else
-                            {
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 0] = this->FloatToColorByte(c.x);
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 1] = this->FloatToColorByte(c.y);
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 2] = this->FloatToColorByte(c.z);
-                                color_buffer[p.y * buffer_width * 4 + p.x * 4 + 3] = this->FloatToColorByte(c.w);
-                            }
-
-                            if (m_depth_mask)
-                            {
-                                depth_buffer[p.y * buffer_width + p.x] = mapped_depth;
-                            }
-                        }
-                    }
-                };
-
-                GLRasterizer rasterizer(positions, varyings, program.get(), set_fragment, m_viewport_x, m_viewport_y, m_viewport_width, m_viewport_height, cross > 0);
-                rasterizer.Run();
+                m_share_changes = changes;
+                m_dirty = DIRTY_ALL;
             }
-        }
 
-        void DrawArraysTriangles(GLint first, GLsizei count)
-        {
-            unsigned char* color_buffer = m_default_color_buffer;
-            float* depth_buffer = m_default_depth_buffer;
-            unsigned char* stencil_buffer = m_default_stencil_buffer;
-            int buffer_width = m_default_buffer_width;
-            int buffer_height = m_default_buffer_height;
+            if (m_dirty & DIRTY_FRAMEBUFFER)
+            {
+                this->GetDrawTarget(state.target, state.target_texture);
+            }
+            else if (state.target_texture)
+            {
+                // a draw sampling the texture since the last one took its rendered pixels back
+                state.target.color_buffer = state.target_texture->GetRenderBuffer();
+            }
 
-            if (!m_current_fb.expired())
+            if (m_dirty & DIRTY_PROGRAM)
             {
-                color_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Color0, buffer_width, buffer_height);
-                depth_buffer = (float*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Depth, buffer_width, buffer_height);
-                stencil_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Stencil, buffer_width, buffer_height);
+                state.program = m_using_program.get();
             }
 
-            Ref<GLProgram> program = m_using_program.lock();
+            if (m_dirty & DIRTY_VERTEX_INPUT)
+            {
+                state.inputs.Clear();
+                this->GetVertexInputs(state.inputs);
+                state.index_buffer = m_current_ib.get();
+            }
 
-            for (int i = 0; i < count; ++i) // triangle
+            if (m_dirty & (DIRTY_FRAMEBUFFER | DIRTY_RASTER))
             {
-                Vector4 positions[3];
-                Vector<GLProgram::Varying> varyings[3];
+                state.clip_min_x = 0;
+                state.clip_min_y = 0;
+                state.clip_max_x = state.target.width - 1;
+                state.clip_max_y = state.target.height - 1;
+                // pixels outside the scissor are never visited
+                if (m_scissor_test_enable)
+                {
+                    state.clip_min_x = Mathf::Max(state.clip_min_x, m_scissor_x);
+                    state.clip_min_y = Mathf::Max(state.clip_min_y, m_scissor_y);
+                    state.clip_max_x = Mathf::Min(state.clip_max_x, m_scissor_x + m_scissor_width - 1);
+                    state.clip_max_y = Mathf::Min(state.clip_max_y, m_scissor_y + m_scissor_height - 1);
+                }
 
-                for (int j = 0; j < 3; ++j) // vertex
+                for (int i = 0; i < 3; ++i)
                 {
-                    unsigned int index = first + i * 3 + j;
+                    state.keep_faces[i] = !m_cull_face_enable || this->CullFaceTest((float) (i - 1));
+                }
+            }
 
-                    this->ApplyVertexAttribs(program, index);
+            if (m_dirty & (DIRTY_FRAMEBUFFER | DIRTY_OUTPUT))
+            {
+                this->ValidateOutputState(state);
+            }
 
-                    positions[j] = *(Vector4*) program->CallVSMain();
-                    varyings[j] = program->GetVSVaryings();
+            if (m_dirty & (DIRTY_FRAMEBUFFER | DIRTY_PROGRAM | DIRTY_OUTPUT))
+            {
+                state.draw_bins = nullptr;
+                if (state.program)
+                {
+                    // without discard every fragment reaching the fs is kept, so the tests can run first.
+                    // with color writes off too, the fs has no effect and is not run at all
+                    state.draw_bins = this->SelectDrawBins(!state.program->HasDiscard(), state.color_write, state.target.samples > 1);
                 }
-
-                this->Rasterize(color_buffer, depth_buffer, buffer_width, buffer_height, program,
-                    positions, varyings);
             }
+
+            m_dirty = 0;
         }
 
-        void DrawElementsTriangles(GLsizei count, GLenum type, const void* indices)
+        void ValidateOutputState(DrawState& state)
         {
-            unsigned char* color_buffer = m_default_color_buffer;
-            float* depth_buffer = m_default_depth_buffer;
-            unsigned char* stencil_buffer = m_default_stencil_buffer;
-            int buffer_width = m_default_buffer_width;
-            int buffer_height = m_default_buffer_height;
+            // tests without their buffer always pass
+            state.depth_test = m_depth_test_enable && state.target.depth_buffer;
+            state.depth_write = state.depth_test && m_depth_mask;
+            state.stencil_enable = m_stencil_test_enable && state.target.stencil_buffer;
+            state.color_write = state.target.color_buffer && (m_color_mask[0] || m_color_mask[1] || m_color_mask[2] || m_color_mask[3]);
+
+            // depth is read by the depth test even when it is not written
+            state.tile_buffers = 0;
+            if (state.depth_test)
+            {
+                state.tile_buffers |= GLTileBuffer::DEPTH;
+            }
+            if (state.color_write)
+            {
+                state.tile_buffers |= GLTileBuffer::COLOR;
+            }
+            if (state.stencil_enable)
+            {
+                state.tile_buffers |= GLTileBuffer::STENCIL;
+            }
+
+            for (int i = 0; i < 2; ++i)
+            {
+                state.stencil_writes_on_depth_fail[i] = this->StencilWritesOnDepthFail(m_stencil[i]);
+            }
 
-            if (!m_current_fb.expired())
+            // the depth test bypasses depth writes too when it is off
+            GLOutputMerger::State merger_state;
+            merger_state.depth_func = state.depth_test ? m_depth_func : GL_ALWAYS;
+            merger_state.depth_write = state.depth_write;
+            merger_state.depth_range = m_depth_range;
+            merger_state.depth_format = state.target.depth_format;
+            merger_state.blend_enable = m_blend_enable;
+            merger_state.blend_src_factor_c = m_blend_src_factor_c;
+            merger_state.blend_src_factor_a = m_blend_src_factor_a;
+            merger_state.blend_dest_factor_c = m_blend_dest_factor_c;
+            merger_state.blend_dest_factor_a = m_blend_dest_factor_a;
+            merger_state.blend_equation_c = m_blend_equation_c;
+            merger_state.blend_equation_a = m_blend_equation_a;
+            merger_state.blend_color = m_blend_color;
+            for (int i = 0; i < 4; ++i)
             {
-                color_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Color0, buffer_width, buffer_height);
-                depth_buffer = (float*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Depth, buffer_width, buffer_height);
-                stencil_buffer = (unsigned char*) this->GetFramebufferAttachmentBuffer(GLFramebuffer::Attachment::Stencil, buffer_width, buffer_height);
+                merger_state.color_mask[i] = m_color_mask[i];
             }
+            m_output_merger.Select(merger_state);
+        }
+
+        // the output stage is picked here and inlined into the rasterizer's pixel loop
+        DrawBinsFunc SelectDrawBins(bool early_tests, bool color_write, bool multisample)
+        {
+            static const DrawBinsFunc funcs[2][2][2] = {
+                {
+                    { &GLContext::DrawBins<FragmentOutput<false, false, false>>, &GLContext::DrawBins<FragmentOutput<false, false, true>> },
+                    { &GLContext::DrawBins<FragmentOutput<false, true, false>>, &GLContext::DrawBins<FragmentOutput<false, true, true>> },
+                },
+                {
+                    { &GLContext::DrawBins<FragmentOutput<true, false, false>>, &GLContext::DrawBins<FragmentOutput<true, false, true>> },
+                    { &GLContext::DrawBins<FragmentOutput<true, true, false>>, &GLContext::DrawBins<FragmentOutput<true, true, true>> },
+                },
+            };
+
+            return funcs[early_tests ? 1 : 0][color_write ? 1 : 0][multisample ? 1 : 0];
+        }
 
-            Ref<GLProgram> program = m_using_program.lock();
+        void ApplyDrawCommandUniform(const DrawState& state, const GLDrawCommandSGL& cmd)
+        {
+            if (cmd.uniform_location >= 0 && cmd.uniform_count > 0)
+            {
+                state.program->Uniformv(cmd.uniform_location, cmd.uniform_count * sizeof(Vector4), cmd.uniform_value);
+            }
+        }
 
-            int index_type_size = 0;
+        int GetIndexTypeSize(GLenum type)
+        {
             switch (type)
             {
                 case GL_UNSIGNED_BYTE:
-                    index_type_size = 1;
-                    break;
+                    return 1;
                 case GL_UNSIGNED_SHORT:
-                    index_type_size = 2;
-                    break;
+                    return 2;
                 case GL_UNSIGNED_INT:
-                    index_type_size = 4;
-                    break;
+                    return 4;
                 default:
-                    break;
+                    return 0;
             }
+        }
 
-            for (int i = 0; i < count; ++i) // triangle
+        void GetVertexInputs(Vector<VertexInput>& inputs)
+        {
+            for (int k = 0; k < m_vertex_attrib_arrays.Size(); ++k) // attrib
             {
-                Vector4 positions[3];
-                Vector<GLProgram::Varying> varyings[3];
-
-                for (int j = 0; j < 3; ++j) // vertex
+                const VertexAttribArray& va = m_vertex_attrib_arrays[k];
+                if (va.enable)
                 {
-                    unsigned int index = 0;
-                    char* index_addr = nullptr;
-
-                    if (!m_current_ib.expired())
-                    {
-                        Ref<GLBuffer> ib = m_current_ib.lock();
-                        char* p = (char*) ib->GetData();
-                        int offset = (int) (size_t) indices;
-                        index_addr = (char*) &p[offset + (i * 3 + j) * index_type_size];
-                    }
-                    else
-                    {
-                        char* p = (char*) indices;
-                        index_addr = (char*) &p[(i * 3 + j) * index_type_size];
-                    }
-
-                    switch (type)
+                    int size = 0;
+                    switch (va.type)
                     {
+                        case GL_BYTE:
                         case GL_UNSIGNED_BYTE:
-                            index = *(unsigned char*) index_addr;
+                            size = va.size * 1;
                             break;
+                        case GL_SHORT:
                         case GL_UNSIGNED_SHORT:
-                            index = *(unsigned short*) index_addr;
+                        case GL_FIXED:
+                            size = va.size * 2;
                             break;
-                        case GL_UNSIGNED_INT:
-                            index = *(unsigned int*) index_addr;
+                        case GL_FLOAT:
+                            size = va.size * 4;
                             break;
                         default:
                             break;
                     }
 
-                    this->ApplyVertexAttribs(program, index);
+                    VertexInput input;
+                    input.index = va.index;
+                    input.stride = va.stride > 0 ? va.stride : size;
+                    input.size = size;
 
-                    positions[j] = *(Vector4*) program->CallVSMain();
-                    varyings[j] = program->GetVSVaryings();
-                }
+                    if (va.vb)
+                    {
+                        char* p = (char*) va.vb->GetData();
+                        int offset = (int) (size_t) va.pointer;
+                        input.data = &p[offset];
+                    }
+                    else
+                    {
+                        input.data = (const char*) va.pointer;
+                    }
 
-                this->Rasterize(color_buffer, depth_buffer, buffer_width, buffer_height, program,
-                    positions, varyings);
+                    inputs.Add(input);
+                }
             }
         }
 
-        void Enable(GLenum cap)
+        void ApplyVertexAttribs(const DrawState& state, unsigned int index)
         {
-            switch (cap)
+            for (int k = 0; k < state.inputs.Size(); ++k) // attrib
             {
-                case GL_DEPTH_TEST:
-                    m_depth_test_enable = true;
-                    break;
-                case GL_CULL_FACE:
-                    m_cull_face_enable = true;
-                    break;
-                case GL_BLEND:
-                    m_blend_enable = true;
-                    break;
-                default:
-                    break;
+                const VertexInput& input = state.inputs[k];
+                state.program->SetVertexAttrib(input.index, &input.data[index * input.stride], input.size);
             }
         }
 
-        void Disable(GLenum cap)
+        // triangles of a draw are binned to the tiles their bounds overlap, then drawn tile by tile
+        void AddTriangle(const DrawState& state, int i0, int i1, int i2)
         {
-            switch (cap)
+            const Vector4 positions[3] = {
+                m_transformed_positions[i0],
+                m_transformed_positions[i1],
+                m_transformed_positions[i2],
+            };
+            const Vector<GLProgram::Varying>* varyings[3] = {
+                &m_transformed_varyings[i0],
+                &m_transformed_varyings[i1],
+                &m_transformed_varyings[i2],
+            };
+
+            float cross = (positions[1].x - positions[0].x) * (positions[2].y - positions[1].y)
+                - (positions[2].x - positions[1].x) * (positions[1].y - positions[0].y);
+
+            if (!state.keep_faces[(cross > 0) - (cross < 0) + 1])
             {
-                case GL_DEPTH_TEST:
-                    m_depth_test_enable = false;
-                    break;
-                case GL_CULL_FACE:
-                    m_cull_face_enable = false;
-                    break;
-                case GL_BLEND:
-                    m_blend_enable = false;
-                    break;
-                default:
-                    break;
+                return;
             }
-        }
-
-        void DepthMask(GLboolean flag)
-        {
-            m_depth_mask = flag == GL_TRUE;
-        }
 
-        void DepthRangef(GLfloat n, GLfloat f)
-        {
-            m_depth_range = Vector2(n, f);
-        }
+            BinnedTriangle triangle;
+            GLRasterizer rasterizer(positions, varyings, state.program, m_viewport_x, m_viewport_y, m_viewport_width, m_viewport_height, cross > 0, m_tiles.GetSamples());
+            if (!rasterizer.GetBounds(triangle.min_x, triangle.min_y, triangle.max_x, triangle.max_y))
+            {
+                return;
+            }
 
-        void DepthFunc(GLenum func)
-        {
-            m_depth_func = func;
-        }
+            triangle.min_x = Mathf::Max(triangle.min_x, state.clip_min_x);
+            triangle.min_y = Mathf::Max(triangle.min_y, state.clip_min_y);
+            triangle.max_x = Mathf::Min(triangle.max_x, state.clip_max_x);
+            triangle.max_y = Mathf::Min(triangle.max_y, state.clip_max_y);
+            if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+            {
+                return;
+            }
 
-        void CullFace(GLenum mode)
-        {
-            m_cull_face = mode;
-        }
+            triangle.vertices[0] = i0;
+            triangle.vertices[1] = i1;
+            triangle.vertices[2] = i2;
+            triangle.ccw = cross > 0;
+            this->GetTriangleDepthRange(positions, triangle.min_depth, triangle.max_depth);
 
-        void FrontFace(GLenum mode)
-        {
-            m_front_face = mode;
-        }
+            int index = m_triangles.Size();
+            m_triangles.Add(triangle);
 
-        void BlendFunc(GLenum sfactor, GLenum dfactor)
-        {
-            m_blend_src_factor_c = sfactor;
-            m_blend_src_factor_a = sfactor;
-            m_blend_dest_factor_c = dfactor;
-            m_blend_dest_factor_a = dfactor;
+            int tiles_x = m_tiles.GetTilesX();
+            for (int y = triangle.min_y >> GLTileBuffer::TILE_SHIFT; y <= triangle.max_y >> GLTileBuffer::TILE_SHIFT; ++y)
+            {
+                for (int x = triangle.min_x >> GLTileBuffer::TILE_SHIFT; x <= triangle.max_x >> GLTileBuffer::TILE_SHIFT; ++x)
+                {
+                    m_bins[y * tiles_x + x].Add(index);
+                }
+            }
         }
 
-        void BlendFuncSeparate(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha)
+        void GetTriangleDepthRange(const Vector4* positions, float& min_depth, float& max_depth)
         {
-            m_blend_src_factor_c = sfactorRGB;
-            m_blend_src_factor_a = sfactorAlpha;
-            m_blend_dest_factor_c = dfactorRGB;
-            m_blend_dest_factor_a = dfactorAlpha;
-        }
+            min_depth = Mathf::MaxFloatValue;
+            max_depth = Mathf::MinFloatValue;
 
-        void BlendEquation(GLenum mode)
-        {
-            m_blend_equation_c = mode;
-            m_blend_equation_a = mode;
-        }
+            for (int i = 0; i < 3; ++i)
+            {
+                // vertices behind the eye are not clipped, their depth says nothing
+                if (positions[i].w <= 0)
+                {
+                    min_depth = Mathf::MinFloatValue;
+                    max_depth = Mathf::MaxFloatValue;
+                    return;
+                }
 
-        void BlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
-        {
-            m_blend_equation_c = modeRGB;
-            m_blend_equation_a = modeAlpha;
-        }
+                float depth = m_depth_range.x + (positions[i].z / positions[i].w + 1) / 2 * (m_depth_range.y - m_depth_range.x);
+                min_depth = Mathf::Min(min_depth, depth);
+                max_depth = Mathf::Max(max_depth, depth);
+            }
 
-        void BlendColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
-        {
-            m_blend_color = Vector4(red, green, blue, alpha);
+            // interpolation may round slightly past the vertex depths
+            min_depth -= Mathf::Epsilon;
+            max_depth += Mathf::Epsilon;
         }
 
-        bool DepthTest(float src, float dest)
+        // true if the depth test fails for every fragment the triangle can have in the tile
+        bool DepthBoundsReject(const BinnedTriangle& triangle, const GLTileBuffer::Tile* tile)
         {
             switch (m_depth_func)
             {
                 case GL_NEVER:
-                    return false;
+                    return true;
                 case GL_LESS:
-                    return src < dest;
-                case GL_EQUAL:
-                    return Mathf::FloatEqual(src, dest);
+                    return triangle.min_depth >= tile->depth_max;
                 case GL_LEQUAL:
-                    return src <= dest;
+                    return triangle.min_depth > tile->depth_max;
                 case GL_GREATER:
-                    return src > dest;
-                case GL_NOTEQUAL:
-                    return !Mathf::FloatEqual(src, dest);
+                    return triangle.max_depth <= tile->depth_min;
                 case GL_GEQUAL:
-                    return src >= dest;
-                case GL_ALWAYS:
-                    return true;
+                    return triangle.max_depth < tile->depth_min;
+                case GL_EQUAL:
+                    return triangle.min_depth > tile->depth_max || triangle.max_depth < tile->depth_min;
                 default:
                     return false;
             }
         }
 
-        bool CullFaceTest(float cross)
+        // stencil and depth tests of one fragment with their writes, false if it is dropped.
+        // stencil is the state of the triangle's face, null without stencil test
+        bool FragmentTests(GLTileBuffer::Tile* tile, int index, float depth, const StencilFace* stencil)
         {
-            switch (m_cull_face)
+            if (stencil == nullptr)
             {
-                case GL_BACK:
-                    switch (m_front_face)
+                return m_output_merger.Depth(tile, index, depth);
+            }
+
+            unsigned char& dest = tile->stencil[index];
+
+            if (!this->StencilTest(*stencil, dest))
+            {
+                dest = this->StencilOperation(*stencil, stencil->fail_op, dest);
+                return false;
+            }
+
+            if (!m_output_merger.Depth(tile, index, depth))
+            {
+                dest = this->StencilOperation(*stencil, stencil->depth_fail_op, dest);
+                return false;
+            }
+
+            dest = this->StencilOperation(*stencil, stencil->depth_pass_op, dest);
+            return true;
+        }
+
+        void DrawBinnedTriangles(const DrawState& state)
+        {
+            if (m_triangles.Size() == 0)
+            {
+                return;
+            }
+
+            (this->*state.draw_bins)(state);
+
+            m_triangles.Clear();
+        }
+
+        template<class Output>
+        void DrawBins(const DrawState& state)
+        {
+            Output output;
+            output.context = this;
+            output.tile = nullptr;
+            output.stencil = nullptr;
+            output.count = 0;
+
+            int tiles_x = m_tiles.GetTilesX();
+            for (int i = 0; i < m_bins.Size(); ++i)
+            {
+                Vector<int>& bin = m_bins[i];
+                if (bin.Size() == 0)
+                {
+                    continue;
+                }
+
+                int tile_x = i % tiles_x;
+                int tile_y = i / tiles_x;
+                int tile_min_x = tile_x << GLTileBuffer::TILE_SHIFT;
+                int tile_min_y = tile_y << GLTileBuffer::TILE_SHIFT;
+                int tile_max_x = tile_min_x + GLTileBuffer::TILE_SIZE - 1;
+                int tile_max_y = tile_min_y + GLTileBuffer::TILE_SIZE - 1;
+
+                output.tile = m_tiles.Touch(tile_x, tile_y, state.tile_buffers);
+
+                for (int j = 0; j < bin.Size(); ++j)
+                {
+                    const BinnedTriangle& triangle = m_triangles[bin[j]];
+
+                    int face = 0;
+                    if (state.stencil_enable)
                     {
-                        case GL_CCW:
-                            return cross > 0;
-                        case GL_CW:
-                            return cross < 0;
+                        bool front = triangle.ccw == (m_front_face == GL_CCW);
+                        face = front ? 0 : 1;
+                        output.stencil = &m_stencil[face];
                     }
-                    break;
-                case GL_FRONT:
-                    switch (m_front_face)
+
+                    // hierarchical z, occluded triangles are not set up or shaded in this tile,
+                    // unless a failing depth test would still change the stencil
+                    if (state.depth_test && this->DepthBoundsReject(triangle, output.tile) &&
+                        (output.stencil == nullptr || !state.stencil_writes_on_depth_fail[face]))
                     {
-                        case GL_CCW:
-                            return cross < 0;
-                        case GL_CW:
-                            return cross > 0;
+                        continue;
                     }
+
+                    const Vector4 positions[3] = {
+                        m_transformed_positions[triangle.vertices[0]],
+                        m_transformed_positions[triangle.vertices[1]],
+                        m_transformed_positions[triangle.vertices[2]],
+                    };
+                    const Vector<GLProgram::Varying>* varyings[3] = {
+                        &m_transformed_varyings[triangle.vertices[0]],
+                        &m_transformed_varyings[triangle.vertices[1]],
+                        &m_transformed_varyings[triangle.vertices[2]],
+                    };
+
+                    GLRasterizer rasterizer(positions, varyings, state.program, m_viewport_x, m_viewport_y, m_viewport_width, m_viewport_height, triangle.ccw, m_tiles.GetSamples());
+                    rasterizer.Run(output,
+                        Mathf::Max(triangle.min_x, tile_min_x),
+                        Mathf::Max(triangle.min_y, tile_min_y),
+                        Mathf::Min(triangle.max_x, tile_max_x),
+                        Mathf::Min(triangle.max_y, tile_max_y));
+                    output.Flush();
+                }
+
+                if (state.depth_write)
+                {
+                    m_tiles.UpdateDepthBounds(tile_x, tile_y);
+                }
+
+                bin.Clear();
+            }
+        }
+
+        void TransformVertex(const DrawState& state, int cache_index, unsigned int index)
+        {
+            this->ApplyVertexAttribs(state, index);
+
+            m_transformed_positions[cache_index] = *(Vector4*) state.program->CallVSMain();
+            m_transformed_varyings[cache_index] = state.program->GetVSVaryings();
+        }
+
+        void DrawArraysTriangles(const DrawState& state, GLint first, GLsizei count)
+        {
+            if (count <= 0)
+            {
+                return;
+            }
+
+            m_transformed_positions.Resize(count * 3);
+            m_transformed_varyings.Resize(count * 3);
+
+            for (int i = 0; i < count * 3; ++i) // vertex
+            {
+                this->TransformVertex(state, i, first + i);
+            }
+
+            for (int i = 0; i < count; ++i) // triangle
+            {
+                this->AddTriangle(state, i * 3 + 0, i * 3 + 1, i * 3 + 2);
+            }
+
+            this->DrawBinnedTriangles(state);
+        }
+
+        // indices is an offset into the bound element array buffer, or a client pointer when none is bound
+        void DrawElementsTriangles(const DrawState& state, GLsizei count, GLenum type, const void* indices)
+        {
+            int index_count = count * 3;
+            const char* index_data = nullptr;
+            GLuint min_index = 0;
+            GLuint max_index = 0;
+
+            if (index_count <= 0)
+            {
+                return;
+            }
+
+            if (state.index_buffer)
+            {
+                GLintptr offset = (GLintptr) indices;
+                if (offset < 0 || offset + index_count * this->GetIndexTypeSize(type) > state.index_buffer->GetSize())
+                {
+                    return;
+                }
+
+                index_data = &((const char*) state.index_buffer->GetData())[offset];
+                state.index_buffer->GetIndexRange(type, offset, index_count, min_index, max_index);
+            }
+            else
+            {
+                index_data = (const char*) indices;
+                GLBuffer::ScanIndexRange(type, index_data, index_count, min_index, max_index);
+            }
+
+            switch (type)
+            {
+                case GL_UNSIGNED_BYTE:
+                    this->DrawIndexedTriangles(state, count, (const GLubyte*) index_data, min_index, max_index);
+                    break;
+                case GL_UNSIGNED_SHORT:
+                    this->DrawIndexedTriangles(state, count, (const GLushort*) index_data, min_index, max_index);
+                    break;
+                case GL_UNSIGNED_INT:
+                    this->DrawIndexedTriangles(state, count, (const GLuint*) index_data, min_index, max_index);
+                    break;
+                default:
                     break;
-                case GL_FRONT_AND_BACK:
-                    return false;
             }
+        }
 
-            return false;
+        template<class T>
+        void DrawIndexedTriangles(const DrawState& state, GLsizei count, const T* indices, GLuint min_index, GLuint max_index)
+        {
+            // a sparse range would shade vertices no triangle references, transform per index instead
+            if (max_index - min_index >= (GLuint) (count * 3))
+            {
+                m_transformed_positions.Resize(count * 3);
+                m_transformed_varyings.Resize(count * 3);
+
+                for (int i = 0; i < count * 3; ++i) // vertex
+                {
+                    this->TransformVertex(state, i, indices[i]);
+                }
+
+                for (int i = 0; i < count; ++i) // triangle
+                {
+                    this->AddTriangle(state, i * 3 + 0, i * 3 + 1, i * 3 + 2);
+                }
+
+                this->DrawBinnedTriangles(state);
+                return;
+            }
+
+            // post-transform cache, every vertex of the referenced range is shaded exactly once
+            int vertex_count = (int) (max_index - min_index) + 1;
+            m_transformed_positions.Resize(vertex_count);
+            m_transformed_varyings.Resize(vertex_count);
+
+            for (int i = 0; i < vertex_count; ++i)
+            {
+                this->TransformVertex(state, i, min_index + i);
+            }
+
+            for (int i = 0; i < count; ++i) // triangle
+            {
+                this->AddTriangle(state,
+                    indices[i * 3 + 0] - min_index,
+                    indices[i * 3 + 1] - min_index,
+                    indices[i * 3 + 2] - min_index);
+            }
+
+            this->DrawBinnedTriangles(state);
         }
 
-        void GenTextures(GLsizei n, GLuint* textures)
+        void Enable(GLenum cap)
+        {
+            switch (cap)
+            {
+                case GL_DEPTH_TEST:
+                    m_depth_test_enable = true;
+                    m_dirty |= DIRTY_OUTPUT;
+                    break;
+                case GL_CULL_FACE:
+                    m_cull_face_enable = true;
+                    m_dirty |= DIRTY_RASTER;
+                    break;
+                case GL_BLEND:
+                    m_blend_enable = true;
+                    m_dirty |= DIRTY_OUTPUT;
+                    break;
+                case GL_STENCIL_TEST:
+                    m_stencil_test_enable = true;
+                    m_dirty |= DIRTY_OUTPUT;
+                    break;
+                case GL_SCISSOR_TEST:
+                    m_scissor_test_enable = true;
+                    m_dirty |= DIRTY_RASTER;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void Disable(GLenum cap)
+        {
+            switch (cap)
+            {
+                case GL_DEPTH_TEST:
+                    m_depth_test_enable = false;
+                    m_dirty |= DIRTY_OUTPUT;
+                    break;
+                case GL_CULL_FACE:
+                    m_cull_face_enable = false;
+                    m_dirty |= DIRTY_RASTER;
+                    break;
+                case GL_BLEND:
+                    m_blend_enable = false;
+                    m_dirty |= DIRTY_OUTPUT;
+                    break;
+                case GL_STENCIL_TEST:
+                    m_stencil_test_enable = false;
+                    m_dirty |= DIRTY_OUTPUT;
+                    break;
+                case GL_SCISSOR_TEST:
+                    m_scissor_test_enable = false;
+                    m_dirty |= DIRTY_RASTER;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void DepthMask(GLboolean flag)
+        {
+            m_depth_mask = flag == GL_TRUE;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void DepthRangef(GLfloat n, GLfloat f)
+        {
+            m_depth_range = Vector2(n, f);
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void DepthFunc(GLenum func)
+        {
+            m_depth_func = func;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void CullFace(GLenum mode)
+        {
+            m_cull_face = mode;
+            m_dirty |= DIRTY_RASTER;
+        }
+
+        void FrontFace(GLenum mode)
+        {
+            m_front_face = mode;
+            m_dirty |= DIRTY_RASTER;
+        }
+
+        void BlendFunc(GLenum sfactor, GLenum dfactor)
+        {
+            m_blend_src_factor_c = sfactor;
+            m_blend_src_factor_a = sfactor;
+            m_blend_dest_factor_c = dfactor;
+            m_blend_dest_factor_a = dfactor;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void BlendFuncSeparate(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha)
+        {
+            m_blend_src_factor_c = sfactorRGB;
+            m_blend_src_factor_a = sfactorAlpha;
+            m_blend_dest_factor_c = dfactorRGB;
+            m_blend_dest_factor_a = dfactorAlpha;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void BlendEquation(GLenum mode)
+        {
+            m_blend_equation_c = mode;
+            m_blend_equation_a = mode;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void BlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+        {
+            m_blend_equation_c = modeRGB;
+            m_blend_equation_a = modeAlpha;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void BlendColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+        {
+            m_blend_color = Vector4(red, green, blue, alpha);
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+        {
+            m_color_mask[0] = red == GL_TRUE;
+            m_color_mask[1] = green == GL_TRUE;
+            m_color_mask[2] = blue == GL_TRUE;
+            m_color_mask[3] = alpha == GL_TRUE;
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void StencilFunc(GLenum func, GLint ref, GLuint mask)
+        {
+            this->StencilFuncSeparate(GL_FRONT_AND_BACK, func, ref, mask);
+        }
+
+        void StencilFuncSeparate(GLenum face, GLenum func, GLint ref, GLuint mask)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                if (IsStencilFace(face, i))
+                {
+                    m_stencil[i].func = func;
+                    m_stencil[i].ref = ref;
+                    m_stencil[i].value_mask = mask;
+                }
+            }
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void StencilMask(GLuint mask)
+        {
+            this->StencilMaskSeparate(GL_FRONT_AND_BACK, mask);
+        }
+
+        void StencilMaskSeparate(GLenum face, GLuint mask)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                if (IsStencilFace(face, i))
+                {
+                    m_stencil[i].write_mask = mask;
+                }
+            }
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        void StencilOp(GLenum fail, GLenum zfail, GLenum zpass)
+        {
+            this->StencilOpSeparate(GL_FRONT_AND_BACK, fail, zfail, zpass);
+        }
+
+        void StencilOpSeparate(GLenum face, GLenum sfail, GLenum dpfail, GLenum dppass)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                if (IsStencilFace(face, i))
+                {
+                    m_stencil[i].fail_op = sfail;
+                    m_stencil[i].depth_fail_op = dpfail;
+                    m_stencil[i].depth_pass_op = dppass;
+                }
+            }
+            m_dirty |= DIRTY_OUTPUT;
+        }
+
+        // index 0 is the front face, 1 the back face
+        static bool IsStencilFace(GLenum face, int index)
+        {
+            return face == GL_FRONT_AND_BACK || face == (index == 0 ? GL_FRONT : GL_BACK);
+        }
+
+        bool StencilTest(const StencilFace& stencil, unsigned char dest)
+        {
+            // the reference is clamped to the 8 bit range of the buffer
+            unsigned int ref = (unsigned int) Mathf::Clamp(stencil.ref, 0, 0xff) & stencil.value_mask;
+            unsigned int value = dest & stencil.value_mask;
+
+            switch (stencil.func)
+            {
+                case GL_NEVER:
+                    return false;
+                case GL_LESS:
+                    return ref < value;
+                case GL_EQUAL:
+                    return ref == value;
+                case GL_LEQUAL:
+                    return ref <= value;
+                case GL_GREATER:
+                    return ref > value;
+                case GL_NOTEQUAL:
+                    return ref != value;
+                case GL_GEQUAL:
+                    return ref >= value;
+                case GL_ALWAYS:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        unsigned char StencilOperation(const StencilFace& stencil, GLenum op, unsigned char dest)
+        {
+            int value = dest;
+
+            switch (op)
+            {
+                case GL_KEEP:
+                    return dest;
+                case GL_ZERO:
+                    value = 0;
+                    break;
+                case GL_REPLACE:
+                    value = Mathf::Clamp(stencil.ref, 0, 0xff);
+                    break;
+                case GL_INCR:
+                    value = Mathf::Min(value + 1, 0xff);
+                    break;
+                case GL_DECR:
+                    value = Mathf::Max(value - 1, 0);
+                    break;
+                case GL_INVERT:
+                    value = ~value;
+                    break;
+                case GL_INCR_WRAP:
+                    value = value + 1;
+                    break;
+                case GL_DECR_WRAP:
+                    value = value - 1;
+                    break;
+                default:
+                    return dest;
+            }
+
+            return (unsigned char) ((dest & ~stencil.write_mask) | (value & stencil.write_mask));
+        }
+
+        bool StencilWritesOnDepthFail(const StencilFace& stencil)
+        {
+            return (stencil.write_mask & 0xff) != 0 && (stencil.fail_op != GL_KEEP || stencil.depth_fail_op != GL_KEEP);
+        }
+
+        bool CullFaceTest(float cross)
+        {
+            switch (m_cull_face)
+            {
+                case GL_BACK:
+                    switch (m_front_face)
+                    {
+                        case GL_CCW:
+                            return cross > 0;
+                        case GL_CW:
+                            return cross < 0;
+                    }
+                    break;
+                case GL_FRONT:
+                    switch (m_front_face)
+                    {
+                        case GL_CCW:
+                            return cross < 0;
+                        case GL_CW:
+                            return cross > 0;
+                    }
+                    break;
+                case GL_FRONT_AND_BACK:
+                    return false;
+            }
+
+            return false;
+        }
+
+        void GenTextures(GLsizei n, GLuint* textures)
+        {
+            this->GenObjects(m_textures, n, textures);
+        }
+
+        void DeleteTextures(GLsizei n, const GLuint* textures)
+        {
+            this->StoreFramebufferTiles();
+            m_dirty |= DIRTY_FRAMEBUFFER;
+            this->DeleteObjects(m_textures, n, textures, [this](GLObject* obj) {
+                for (int i = 0; i < 32; ++i)
+                {
+                    if (m_texture_units[i].get() == obj)
+                    {
+                        m_texture_units[i] = nullptr;
+                    }
+                }
+                this->DetachFromFramebuffers(obj);
+            });
+        }
+
+        GLboolean IsTexture(GLuint texture)
+        {
+            return this->ObjectIs(m_textures, texture);
+        }
+
+        void ActiveTexture(GLenum texture)
+        {
+            m_active_texture_unit = texture;
+        }
+
+        void BindTexture(GLenum target, GLuint texture)
+        {
+            switch (target)
+            {
+                case GL_TEXTURE_2D:
+                {
+                    // the first bind gives a generated name its target
+                    GLTexture* tex = m_textures.Get(texture);
+                    if (tex && tex->GetTarget() == 0)
+                    {
+                        m_textures.Replace(texture, RefMake<GLTexture2D>(texture));
+                    }
+
+                    m_texture_units[m_active_texture_unit - GL_TEXTURE0] = this->GetTexture2D(texture);
+                    break;
+                }
+                case GL_TEXTURE_CUBE_MAP:
+                    break;
+            }
+        }
+
+        GLTexture2D* GetBoundTexture2D()
+        {
+            return m_texture_units[m_active_texture_unit - GL_TEXTURE0].get();
+        }
+
+        void TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+        {
+            switch (target)
+            {
+                case GL_TEXTURE_2D:
+                {
+                    GLTexture2D* tex2d = this->GetBoundTexture2D();
+                    if (tex2d)
+                    {
+                        this->StoreFramebufferTiles();
+                        tex2d->TexImage2D(level, internalformat, width, height, format, type, m_unpack_alignment, pixels);
+                        m_dirty |= DIRTY_FRAMEBUFFER;
+                        this->ChangeSharedObject();
+                    }
+                    break;
+                }
+                case GL_TEXTURE_CUBE_MAP:
+                    break;
+            }
+        }
+
+        void TexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+        {
+            if (target == GL_TEXTURE_2D)
+            {
+                GLTexture2D* tex2d = this->GetBoundTexture2D();
+                if (tex2d)
+                {
+                    this->StoreFramebufferTiles();
+                    tex2d->TexSubImage2D(level, xoffset, yoffset, width, height, format, type, m_unpack_alignment, pixels);
+                }
+            }
+        }
+
+        void PixelStorei(GLenum pname, GLint param)
+        {
+            if (param == 1 || param == 2 || param == 4 || param == 8)
+            {
+                switch (pname)
+                {
+                    case GL_PACK_ALIGNMENT:
+                        m_pack_alignment = param;
+                        break;
+                    case GL_UNPACK_ALIGNMENT:
+                        m_unpack_alignment = param;
+                        break;
+                }
+            }
+        }
+
+        void CompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void* data)
+        {
+            if (target == GL_TEXTURE_2D && border == 0)
+            {
+                GLTexture2D* tex2d = this->GetBoundTexture2D();
+                if (tex2d)
+                {
+                    this->StoreFramebufferTiles();
+                    tex2d->CompressedTexImage2D(level, internalformat, width, height, imageSize, data);
+                    m_dirty |= DIRTY_FRAMEBUFFER;
+                    this->ChangeSharedObject();
+                }
+            }
+        }
+
+        void TexParameteri(GLenum target, GLenum pname, GLint param)
+        {
+            if (target == GL_TEXTURE_2D)
+            {
+                GLTexture2D* tex2d = this->GetBoundTexture2D();
+                if (tex2d)
+                {
+                    tex2d->SetParameter(pname, param);
+                }
+            }
+        }
+
+        void TexParameteriv(GLenum target, GLenum pname, const GLint* params)
+        {
+            this->TexParameteri(target, pname, params[0]);
+        }
+
+        void TexParameterf(GLenum target, GLenum pname, GLfloat param)
+        {
+            this->TexParameteri(target, pname, (GLint) param);
+        }
+
+        void TexParameterfv(GLenum target, GLenum pname, const GLfloat* params)
+        {
+            this->TexParameteri(target, pname, (GLint) params[0]);
+        }
+
+        void GetTexParameteriv(GLenum target, GLenum pname, GLint* params)
+        {
+            if (target == GL_TEXTURE_2D)
+            {
+                GLTexture2D* tex2d = this->GetBoundTexture2D();
+                if (tex2d)
+                {
+                    *params = tex2d->GetParameter(pname);
+                }
+            }
+        }
+
+        void GetTexParameterfv(GLenum target, GLenum pname, GLfloat* params)
+        {
+            GLint param = 0;
+            this->GetTexParameteriv(target, pname, &param);
+            *params = (GLfloat) param;
+        }
+
+        void GenerateMipmap(GLenum target)
+        {
+            if (target == GL_TEXTURE_2D)
+            {
+                GLTexture2D* tex2d = this->GetBoundTexture2D();
+                if (tex2d)
+                {
+                    this->StoreFramebufferTiles();
+                    tex2d->GenerateMipmap();
+                }
+            }
+        }
+
+        // shares the objects of share_group, or starts a group of its own if it is null
+        GLContext(const Ref<GLShareGroup>& share_group):
+            m_default_color_buffer(nullptr),
+            m_default_depth_buffer(nullptr),
+            m_default_depth_format(GL_DEPTH_COMPONENT32_OES),
+            m_default_samples(1),
+            m_default_stencil_buffer(nullptr),
+            m_default_buffer_width(0),
+            m_default_buffer_height(0),
+            m_share_group(share_group ? share_group : RefMake<GLShareGroup>()),
+            m_share_changes(0),
+            m_framebuffers(GLShareGroup::FRAMEBUFFER_TAG),
+            m_renderbuffers(m_share_group->renderbuffers),
+            m_shaders(m_share_group->shaders),
+            m_programs(m_share_group->programs),
+            m_buffers(m_share_group->buffers),
+            m_textures(m_share_group->textures),
+            m_current_fb(nullptr),
+            m_dirty(DIRTY_ALL),
+            m_viewport_x(-1),
+            m_viewport_y(-1),
+            m_viewport_width(-1),
+            m_viewport_height(-1),
+            m_scissor_test_enable(false),
+            m_scissor_x(-1),
+            m_scissor_y(-1),
+            m_scissor_width(-1),
+            m_scissor_height(-1),
+            m_clear_color(0, 0, 0, 1),
+            m_clear_depth(1.0f),
+            m_clear_stencil(0),
+            m_depth_test_enable(false),
+            m_depth_mask(true),
+            m_depth_range(0, 1),
+            m_depth_func(GL_LESS),
+            m_cull_face_enable(false),
+            m_cull_face(GL_BACK),
+            m_front_face(GL_CCW),
+            m_blend_enable(false),
+            m_blend_src_factor_c(GL_ONE),
+            m_blend_src_factor_a(GL_ONE),
+            m_blend_dest_factor_c(GL_ZERO),
+            m_blend_dest_factor_a(GL_ZERO),
+            m_blend_equation_c(GL_FUNC_ADD),
+            m_blend_equation_a(GL_FUNC_ADD),
+            m_blend_color(0, 0, 0, 0),
+            m_stencil_test_enable(false),
+            m_active_texture_unit(GL_TEXTURE0),
+            m_pack_alignment(4),
+            m_unpack_alignment(4)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                m_color_mask[i] = true;
+            }
+
+            for (int i = 0; i < 2; ++i)
+            {
+                m_stencil[i].func = GL_ALWAYS;
+                m_stencil[i].ref = 0;
+                m_stencil[i].value_mask = 0xffffffff;
+                m_stencil[i].write_mask = 0xffffffff;
+                m_stencil[i].fail_op = GL_KEEP;
+                m_stencil[i].depth_fail_op = GL_KEEP;
+                m_stencil[i].depth_pass_op = GL_KEEP;
+            }
+        }
+
+    private:
+        unsigned char FloatToColorByte(float f)
+        {
+            return (unsigned char) (Mathf::Clamp01(f) * 255);
+        }
+
+        // storage of a shared object changed, other contexts of the group rebuild their draw state
+        void ChangeSharedObject()
+        {
+            unsigned int changes = m_share_group->changes.fetch_add(1);
+            // the context's own changes mark what they dirty themselves
+            if (changes == m_share_changes)
+            {
+                m_share_changes = changes + 1;
+            }
+        }
+
+    private:
+        unsigned char* m_default_color_buffer;
+        void* m_default_depth_buffer;
+        GLenum m_default_depth_format;
+        int m_default_samples;
+        unsigned char* m_default_stencil_buffer;
+        int m_default_buffer_width;
+        int m_default_buffer_height;
+        Ref<GLShareGroup> m_share_group;
+        unsigned int m_share_changes;
+        // released before the share group, framebuffers still named hold attachments of it
+        GLHandleTable<GLFramebuffer> m_framebuffers;
+        GLHandleTable<GLRenderbuffer>& m_renderbuffers;
+        GLHandleTable<GLShader>& m_shaders;
+        GLHandleTable<GLProgram>& m_programs;
+        GLHandleTable<GLBuffer>& m_buffers;
+        GLHandleTable<GLTexture>& m_textures;
+        // deleting an object unbinds it in the deleting context, bindings of shared objects hold them
+        // so an object deleted by another context of the group lives on where it is bound, as in gl
+        GLFramebuffer* m_current_fb;
+        Ref<GLRenderbuffer> m_current_rb;
+        Ref<GLBuffer> m_current_vb;
+        Ref<GLBuffer> m_current_ib;
+        Ref<GLProgram> m_using_program;
+        DrawState m_draw_state;
+        unsigned int m_dirty;
+        int m_viewport_x;
+        int m_viewport_y;
+        int m_viewport_width;
+        int m_viewport_height;
+        bool m_scissor_test_enable;
+        int m_scissor_x;
+        int m_scissor_y;
+        int m_scissor_width;
+        int m_scissor_height;
+        Vector4 m_clear_color;
+        float m_clear_depth;
+        int m_clear_stencil;
+        Vector<VertexAttribArray> m_vertex_attrib_arrays;
+        bool m_depth_test_enable;
+        bool m_depth_mask;
+        Vector2 m_depth_range;
+        GLenum m_depth_func;
+        bool m_cull_face_enable;
+        GLenum m_cull_face;
+        GLenum m_front_face;
+        bool m_blend_enable;
+        GLenum m_blend_src_factor_c;
+        GLenum m_blend_src_factor_a;
+        GLenum m_blend_dest_factor_c;
+        GLenum m_blend_dest_factor_a;
+        GLenum m_blend_equation_c;
+        GLenum m_blend_equation_a;
+        Vector4 m_blend_color;
+        bool m_color_mask[4];
+        bool m_stencil_test_enable;
+        StencilFace m_stencil[2];
+        Ref<GLTexture2D> m_texture_units[32];
+        GLenum m_active_texture_unit;
+        int m_pack_alignment;
+        int m_unpack_alignment;
+        Vector<Vector4> m_transformed_positions;
+        Vector<Vector<GLProgram::Varying>> m_transformed_varyings;
+        GLTileBuffer m_tiles;
+        GLOutputMerger m_output_merger;
+        Vector<BinnedTriangle> m_triangles;
+        Vector<Vector<int>> m_bins;
+    };
+}
+
+// the bindings that decide which client memory a call reads, mirrored on the calling thread in
+// every mode so deferred mode can be turned on at any time
+struct GLClientState
+{
+    struct Attrib
+    {
+        GLuint index;
+        bool enable;
+        GLuint buffer;
+    };
+
+    GLClientState():
+        array_buffer(0),
+        element_array_buffer(0),
+        unpack_alignment(4)
+    {
+    }
+
+    Attrib& GetAttrib(GLuint index)
+    {
+        for (int i = 0; i < attribs.Size(); ++i)
+        {
+            if (attribs[i].index == index)
+            {
+                return attribs[i];
+            }
+        }
+
+        attribs.Add({ index, false, 0 });
+        return attribs[attribs.Size() - 1];
+    }
+
+    void DeleteBuffers(GLsizei n, const GLuint* buffers)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            if (buffers[i] == 0)
+            {
+                continue;
+            }
+            if (array_buffer == buffers[i])
+            {
+                array_buffer = 0;
+            }
+            if (element_array_buffer == buffers[i])
+            {
+                element_array_buffer = 0;
+            }
+            for (int j = 0; j < attribs.Size(); ++j)
+            {
+                if (attribs[j].buffer == buffers[i])
+                {
+                    attribs[j].buffer = 0;
+                }
+            }
+        }
+    }
+
+    // whether a draw reads vertices, or indices with indexed set, from client memory
+    bool DrawReadsClientMemory(bool indexed) const
+    {
+        if (indexed && element_array_buffer == 0)
+        {
+            return true;
+        }
+        for (int i = 0; i < attribs.Size(); ++i)
+        {
+            if (attribs[i].enable && attribs[i].buffer == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    GLuint array_buffer;
+    GLuint element_array_buffer;
+    Vector<Attrib> attribs;
+    GLint unpack_alignment;
+};
+
+struct SGLSurface_T
+{
+    Ref<sgl::GLSurface> surface;
+    // the context the surface is current to
+    SGLContext_T* context;
+    // swaps recorded, the surface has presented them all when it is not current
+    unsigned int swap_count;
+    bool destroyed;
+};
+
+struct SGLContext_T
+{
+    Ref<sgl::GLContext> gl;
+    // set in deferred mode, calls are recorded for its render thread instead of run on the calling thread
+    Ref<sgl::GLCommandQueue> queue;
+    GLClientState client;
+    SGLSurface_T* surface;
+    bool current;
+    bool destroyed;
+};
+
+// the context the gl functions of a thread act on
+static thread_local SGLContext_T* gl_current = nullptr;
+// guards which contexts and surfaces are current, and their destruction
+static std::mutex gl_current_mutex;
+
+// runs a call on the calling thread, or records it with its arguments by value in deferred mode
+template<class... Params, class... Args>
+static void gl_call(void (sgl::GLContext::*func)(Params...), Args... args)
+{
+    SGLContext_T* ctx = gl_current;
+    if (ctx->queue)
+    {
+        ctx->queue->Record(func, args...);
+    }
+    else
+    {
+        (ctx->gl.get()->*func)(args...);
+    }
+}
+
+// the recorded calls have run when this returns, the context can be used on the calling thread
+static void gl_sync()
+{
+    if (gl_current->queue)
+    {
+        gl_current->queue->Finish();
+    }
+}
+
+// count values of client memory a recorded call reads, copied in deferred mode
+template<class T>
+static const T* gl_copy(const T* data, int count)
+{
+    if (gl_current->queue && data && count > 0)
+    {
+        return (const T*) gl_current->queue->Copy(data, count * (int) sizeof(T));
+    }
+    return data;
+}
+
+static const void* gl_copy_bytes(const void* data, int size)
+{
+    if (gl_current->queue && data && size > 0)
+    {
+        return gl_current->queue->Copy(data, size);
+    }
+    return data;
+}
+
+// vertices and indices in client memory are not copied, a draw reading them has run when it returns
+static void gl_wait_client_draw(bool indexed)
+{
+    if (gl_current->queue && gl_current->client.DrawReadsClientMemory(indexed))
+    {
+        gl_current->queue->Finish();
+    }
+}
+
+// uniform blocks of a batch are copied with its commands
+static const GLDrawCommandSGL* gl_copy_draw_commands(const GLDrawCommandSGL* commands, GLsizei drawcount)
+{
+    if (gl_current->queue == nullptr || commands == nullptr || drawcount <= 0)
+    {
+        return commands;
+    }
+
+    GLDrawCommandSGL* copy = (GLDrawCommandSGL*) gl_current->queue->Copy(commands, drawcount * (int) sizeof(GLDrawCommandSGL));
+    for (int i = 0; i < drawcount; ++i)
+    {
+        if (copy[i].uniform_location >= 0)
+        {
+            copy[i].uniform_value = gl_copy(copy[i].uniform_value, copy[i].uniform_count * 4);
+        }
+    }
+    return copy;
+}
+
+static GLint gl_get_attrib(const GLint* attrib_list, GLint attribute, GLint default_value)
+{
+    for (int i = 0; attrib_list && attrib_list[i] != SGL_NONE; i += 2)
+    {
+        if (attrib_list[i] == attribute)
+        {
+            return attrib_list[i + 1];
+        }
+    }
+    return default_value;
+}
+
+static void gl_delete_context(SGLContext_T* ctx)
+{
+    // the render thread runs the recorded calls before the context goes
+    ctx->queue.reset();
+    delete ctx;
+}
+
+// the surface's pixels are in its buffers once the current context lets it go,
+// run without the lock, the surface stays claimed by the context until the caller frees it
+static void gl_release_surface(SGLContext_T* ctx)
+{
+    gl_call(&sgl::GLContext::ReleaseDefaultBuffers);
+    gl_sync();
+    ctx->surface = nullptr;
+}
+
+// run without the lock on a surface the current context has claimed
+static void gl_bind_surface(SGLContext_T* ctx, SGLSurface_T* surface)
+{
+    ctx->surface = surface;
+
+    const Ref<sgl::GLSurface>& buffers = surface->surface;
+    gl_call(&sgl::GLContext::SetDefaultDepthFormat, buffers->GetDepthFormat());
+    gl_call(&sgl::GLContext::SetDefaultSamples, buffers->GetSamples());
+    gl_call(&sgl::GLContext::SetDefaultBuffers, (void*) buffers->GetColorBuffer(), buffers->GetDepthBuffer(), (void*) buffers->GetStencilBuffer(), buffers->GetWidth(), buffers->GetHeight());
+}
+
+SGLContext GL_APIENTRY sglCreateContext(SGLContext share_context, const GLint* attrib_list)
+{
+    Ref<sgl::GLShareGroup> share_group;
+    if (share_context)
+    {
+        std::lock_guard<std::mutex> lock(gl_current_mutex);
+        if (share_context->destroyed)
+        {
+            return SGL_NO_CONTEXT;
+        }
+        share_group = share_context->gl->GetShareGroup();
+    }
+
+    SGLContext_T* ctx = new SGLContext_T();
+    ctx->gl = RefMake<sgl::GLContext>(share_group);
+    ctx->surface = nullptr;
+    ctx->current = false;
+    ctx->destroyed = false;
+    if (gl_get_attrib(attrib_list, SGL_DEFERRED, GL_FALSE) == GL_TRUE)
+    {
+        ctx->queue = RefMake<sgl::GLCommandQueue>(ctx->gl.get());
+    }
+
+    return ctx;
+}
+
+GLboolean GL_APIENTRY sglDestroyContext(SGLContext ctx)
+{
+    if (ctx == SGL_NO_CONTEXT)
+    {
+        return GL_FALSE;
+    }
+
+    // a context current to a thread is deleted by that thread when it lets it go
+    {
+        std::lock_guard<std::mutex> lock(gl_current_mutex);
+        if (ctx->destroyed)
+        {
+            return GL_FALSE;
+        }
+
+        ctx->destroyed = true;
+        if (ctx->current)
+        {
+            return GL_TRUE;
+        }
+    }
+
+    gl_delete_context(ctx);
+    return GL_TRUE;
+}
+
+SGLSurface GL_APIENTRY sglCreatePbufferSurface(const GLint* attrib_list)
+{
+    GLint width = gl_get_attrib(attrib_list, SGL_WIDTH, 0);
+    GLint height = gl_get_attrib(attrib_list, SGL_HEIGHT, 0);
+    GLint samples = gl_get_attrib(attrib_list, SGL_SAMPLES, 1);
+    GLint depth_format = gl_get_attrib(attrib_list, SGL_DEPTH_FORMAT, GL_DEPTH24_STENCIL8_OES);
+    GLint buffer_count = gl_get_attrib(attrib_list, SGL_BUFFER_COUNT, 2);
+
+    if (width <= 0 || height <= 0)
+    {
+        return SGL_NO_SURFACE;
+    }
+    if (samples != 1 && samples != sgl::GLTileBuffer::MAX_SAMPLES)
+    {
+        return SGL_NO_SURFACE;
+    }
+    if (!sgl::GLSurface::IsDepthFormat(depth_format))
+    {
+        return SGL_NO_SURFACE;
+    }
+    if (buffer_count < 1 || buffer_count > sgl::GLSurface::MAX_BUFFERS)
+    {
+        return SGL_NO_SURFACE;
+    }
+
+    SGLSurface_T* surface = new SGLSurface_T();
+    surface->surface = RefMake<sgl::GLSurface>(width, height, depth_format, samples, buffer_count);
+    surface->context = nullptr;
+    surface->swap_count = 0;
+    surface->destroyed = false;
+
+    return surface;
+}
+
+GLboolean GL_APIENTRY sglDestroySurface(SGLSurface surface)
+{
+    if (surface == SGL_NO_SURFACE)
+    {
+        return GL_FALSE;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(gl_current_mutex);
+        if (surface->destroyed)
         {
-            this->GenObjects<GLTexture>(n, textures);
+            return GL_FALSE;
         }
 
-        void DeleteTextures(GLsizei n, const GLuint* textures)
+        surface->destroyed = true;
+        if (surface->context)
         {
-            this->DeleteObjects<GLTexture>(n, textures);
+            return GL_TRUE;
         }
+    }
 
-        GLboolean IsTexture(GLuint texture)
+    delete surface;
+    return GL_TRUE;
+}
+
+GLboolean GL_APIENTRY sglQuerySurface(SGLSurface surface, GLint attribute, GLint* value)
+{
+    if (surface == SGL_NO_SURFACE)
+    {
+        return GL_FALSE;
+    }
+
+    const Ref<sgl::GLSurface>& buffers = surface->surface;
+    switch (attribute)
+    {
+        case SGL_WIDTH:
+            *value = buffers->GetWidth();
+            break;
+        case SGL_HEIGHT:
+            *value = buffers->GetHeight();
+            break;
+        case SGL_SAMPLES:
+            *value = buffers->GetSamples();
+            break;
+        case SGL_DEPTH_FORMAT:
+            *value = buffers->GetDepthFormat();
+            break;
+        case SGL_BUFFER_COUNT:
+            *value = buffers->GetBufferCount();
+            break;
+        default:
+            return GL_FALSE;
+    }
+    return GL_TRUE;
+}
+
+GLboolean GL_APIENTRY sglMakeCurrent(SGLSurface surface, SGLContext ctx)
+{
+    // only the calling thread changes the surface of its current context
+    SGLContext_T* old = gl_current;
+    SGLSurface_T* old_surface = old ? old->surface : nullptr;
+    if (ctx == old && surface == old_surface)
+    {
+        return GL_TRUE;
+    }
+
+    // the checks and the claims on ctx and surface are made under the lock, other threads see them taken
+    // while this thread lets the old ones go and binds the new ones without it
+    {
+        std::lock_guard<std::mutex> lock(gl_current_mutex);
+        if (ctx == SGL_NO_CONTEXT && surface != SGL_NO_SURFACE)
         {
-            return this->ObjectIs<GLTexture>(texture);
+            return GL_FALSE;
         }
-
-        void ActiveTexture(GLenum texture)
+        if (ctx && (ctx->destroyed || (ctx != old && ctx->current)))
         {
-            m_active_texture_unit = texture;
+            return GL_FALSE;
         }
-
-        void BindTexture(GLenum target, GLuint texture)
+        if (surface && (surface->destroyed || (surface->context && surface->context != ctx)))
         {
-            switch (target)
-            {
-                case GL_TEXTURE_2D:
-                {
-                    Ref<GLTexture> tex = this->ObjectGet<GLTexture>(texture);
-                    if (tex)
-                    {
-                        Ref<GLTexture2D> tex2d = RefCast<GLTexture2D>(tex);
-                        if (!tex2d)
-                        {
-                            tex2d = RefMake<GLTexture2D>(tex->GetId());
-                            m_objects[texture] = tex2d;
-                        }
-
-                        m_texture_units[m_active_texture_unit - GL_TEXTURE0] = tex2d;
-                    }
-                    else
-                    {
-                        m_texture_units[m_active_texture_unit - GL_TEXTURE0].reset();
-                    }
-                    break;
-                }
-                case GL_TEXTURE_CUBE_MAP:
-                    break;
-            }
+            return GL_FALSE;
         }
 
-        void TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+        if (ctx)
         {
-            switch (target)
-            {
-                case GL_TEXTURE_2D:
-                {
-                    if (!m_texture_units[m_active_texture_unit - GL_TEXTURE0].expired())
-                    {
-                        Ref<GLTexture2D> tex2d = RefCast<GLTexture2D>(m_texture_units[m_active_texture_unit - GL_TEXTURE0].lock());
-                        if (tex2d)
-                        {
-                            tex2d->TexImage2D(level, internalformat, width, height, format, type, pixels);
-                        }
-                    }
-                    break;
-                }
-                case GL_TEXTURE_CUBE_MAP:
-                    break;
-            }
+            ctx->current = true;
         }
-
-        GLContext():
-            m_default_color_buffer(nullptr),
-            m_default_depth_buffer(nullptr),
-            m_default_stencil_buffer(nullptr),
-            m_default_buffer_width(0),
-            m_default_buffer_height(0),
-            m_gen_id(0),
-            m_viewport_x(-1),
-            m_viewport_y(-1),
-            m_viewport_width(-1),
-            m_viewport_height(-1),
-            m_clear_color(0, 0, 0, 1),
-            m_clear_depth(1.0f),
-            m_clear_stencil(0),
-            m_depth_test_enable(false),
-            m_depth_mask(true),
-            m_depth_range(0, 1),
-            m_depth_func(GL_LESS),
-            m_cull_face_enable(false),
-            m_cull_face(GL_BACK),
-            m_front_face(GL_CCW),
-            m_blend_enable(false),
-            m_blend_src_factor_c(GL_ONE),
-            m_blend_src_factor_a(GL_ONE),
-            m_blend_dest_factor_c(GL_ZERO),
-            m_blend_dest_factor_a(GL_ZERO),
-            m_blend_equation_c(GL_FUNC_ADD),
-            m_blend_equation_a(GL_FUNC_ADD),
-            m_blend_color(0, 0, 0, 0),
-            m_active_texture_unit(GL_TEXTURE0)
+        if (surface)
         {
+            surface->context = ctx;
         }
+    }
+
+    if (old_surface)
+    {
+        gl_release_surface(old);
+    }
 
-        ~GLContext()
+    bool delete_old = false;
+    bool delete_old_surface = false;
+    if (old_surface || (old && old != ctx))
+    {
+        std::lock_guard<std::mutex> lock(gl_current_mutex);
+        if (old_surface)
         {
-            assert(m_objects.Size() == 0);
+            old_surface->context = nullptr;
+            delete_old_surface = old_surface->destroyed;
         }
-
-    private:
-        unsigned char FloatToColorByte(float f)
+        if (old && old != ctx)
         {
-            return (unsigned char) (Mathf::Clamp01(f) * 255);
+            old->current = false;
+            delete_old = old->destroyed;
         }
+    }
 
-    private:
-        unsigned char* m_default_color_buffer;
-        float* m_default_depth_buffer;
-        unsigned char* m_default_stencil_buffer;
-        int m_default_buffer_width;
-        int m_default_buffer_height;
-        Map<GLuint, Ref<GLObject>> m_objects;
-        GLuint m_gen_id;
-        WeakRef<GLFramebuffer> m_current_fb;
-        WeakRef<GLRenderbuffer> m_current_rb;
-        WeakRef<GLBuffer> m_current_vb;
-        WeakRef<GLBuffer> m_current_ib;
-        WeakRef<GLProgram> m_using_program;
-        int m_viewport_x;
-        int m_viewport_y;
-        int m_viewport_width;
-        int m_viewport_height;
-        Vector4 m_clear_color;
-        float m_clear_depth;
-        int m_clear_stencil;
-        Vector<VertexAttribArray> m_vertex_attrib_arrays;
-        bool m_depth_test_enable;
-        bool m_depth_mask;
-        Vector2 m_depth_range;
-        GLenum m_depth_func;
-        bool m_cull_face_enable;
-        GLenum m_cull_face;
-        GLenum m_front_face;
-        bool m_blend_enable;
-        GLenum m_blend_src_factor_c;
-        GLenum m_blend_src_factor_a;
-        GLenum m_blend_dest_factor_c;
-        GLenum m_blend_dest_factor_a;
-        GLenum m_blend_equation_c;
-        GLenum m_blend_equation_a;
-        Vector4 m_blend_color;
-        WeakRef<GLTexture> m_texture_units[32];
-        GLenum m_active_texture_unit;
-    };
+    gl_current = ctx;
+    if (delete_old_surface)
+    {
+        delete old_surface;
+    }
+    if (delete_old)
+    {
+        gl_delete_context(old);
+    }
+    if (ctx && surface)
+    {
+        gl_bind_surface(ctx, surface);
+    }
+
+    return GL_TRUE;
+}
+
+SGLContext GL_APIENTRY sglGetCurrentContext()
+{
+    return gl_current;
+}
+
+SGLSurface GL_APIENTRY sglGetCurrentSurface()
+{
+    return gl_current ? gl_current->surface : SGL_NO_SURFACE;
+}
+
+GLboolean GL_APIENTRY sglSwapBuffers(SGLSurface surface)
+{
+    SGLContext_T* ctx = gl_current;
+    if (surface == SGL_NO_SURFACE || ctx == nullptr || ctx->surface != surface)
+    {
+        return GL_FALSE;
+    }
+
+    sgl::GLSurface* buffers = surface->surface.get();
+    gl_call(&sgl::GLContext::SwapBuffers, buffers);
+    surface->swap_count += 1;
+
+    // a deferred context runs at most this many frames behind, the wait is over at once otherwise
+    unsigned int behind = (unsigned int) buffers->GetBufferCount() - 1;
+    buffers->WaitForPresented(surface->swap_count - behind);
+
+    return GL_TRUE;
+}
+
+GLboolean GL_APIENTRY sglAddFrameCallback(SGLSurface surface, SGLFRAMEPROC callback, void* user_data)
+{
+    if (surface == SGL_NO_SURFACE || callback == nullptr)
+    {
+        return GL_FALSE;
+    }
+
+    surface->surface->AddOutput(RefMake<sgl::GLFrameCallback>([=](const sgl::GLFrame& frame) {
+        SGLFrame sgl_frame;
+        sgl_frame.pixels = frame.pixels;
+        sgl_frame.width = frame.width;
+        sgl_frame.height = frame.height;
+        sgl_frame.pitch = frame.pitch;
+        sgl_frame.serial = frame.serial;
+        callback(&sgl_frame, user_data);
+    }));
+    return GL_TRUE;
+}
+
+GLboolean GL_APIENTRY sglAddFrameRing(SGLSurface surface, const char* name, GLint slot_count)
+{
+    if (surface == SGL_NO_SURFACE || name == nullptr || slot_count <= 0)
+    {
+        return GL_FALSE;
+    }
+
+    const Ref<sgl::GLSurface>& buffers = surface->surface;
+    Ref<sgl::GLFrameRing> ring = RefMake<sgl::GLFrameRing>(name, slot_count, buffers->GetWidth(), buffers->GetHeight());
+    if (!ring->IsValid())
+    {
+        return GL_FALSE;
+    }
+
+    buffers->AddOutput(ring);
+    return GL_TRUE;
+}
+
+GLboolean GL_APIENTRY sglAddFrameWriter(SGLSurface surface, const char* path_format, GLint interval)
+{
+    if (surface == SGL_NO_SURFACE || path_format == nullptr || interval <= 0)
+    {
+        return GL_FALSE;
+    }
+
+    surface->surface->AddOutput(RefMake<sgl::GLFrameWriter>(path_format, interval));
+    return GL_TRUE;
+}
+
+// a context of its own made current on the calling thread, without a surface
+GL_APICALL void create_gl_context()
+{
+    sglMakeCurrent(SGL_NO_SURFACE, sglCreateContext(SGL_NO_CONTEXT, nullptr));
+}
+
+GL_APICALL void destroy_gl_context()
+{
+    SGLContext ctx = sglGetCurrentContext();
+    sglMakeCurrent(SGL_NO_SURFACE, SGL_NO_CONTEXT);
+    sglDestroyContext(ctx);
 }
 
-static Ref<sgl::GLContext> gl;
+// calls made from here on run in order on a render thread while the calling thread goes on with its own
+// work. glFinish, glReadPixels and calls returning a value or writing to client memory wait for them
+GL_APICALL void set_gl_context_deferred(bool deferred)
+{
+    SGLContext_T* ctx = gl_current;
+    if (deferred && !ctx->queue)
+    {
+        ctx->queue = RefMake<sgl::GLCommandQueue>(ctx->gl.get());
+    }
+    else if (!deferred)
+    {
+        ctx->queue.reset();
+    }
+}
 
-__declspec(dllexport) void create_gl_context()
+GL_APICALL void set_gl_context_default_buffers(void* color_buffer, void* depth_buffer, void* stencil_buffer, int width, int height)
 {
-    gl = RefMake<sgl::GLContext>();
+    gl_call(&sgl::GLContext::SetDefaultBuffers, color_buffer, depth_buffer, stencil_buffer, width, height);
 }
 
-__declspec(dllexport) void destroy_gl_context()
+// call before set_gl_context_default_buffers, whose stencil buffer is ignored with GL_DEPTH24_STENCIL8_OES
+GL_APICALL void set_gl_context_default_depth_format(GLenum format)
 {
-    gl.reset();
+    gl_call(&sgl::GLContext::SetDefaultDepthFormat, format);
 }
 
-__declspec(dllexport) void set_gl_context_default_buffers(void* color_buffer, void* depth_buffer, void* stencil_buffer, int width, int height)
+// 1 or 4, call before set_gl_context_default_buffers
+GL_APICALL void set_gl_context_default_samples(int samples)
 {
-    gl->SetDefaultBuffers(color_buffer, depth_buffer, stencil_buffer, width, height);
+    gl_call(&sgl::GLContext::SetDefaultSamples, samples);
 }
 
 #define NOT_IMPLEMENT_VOID_GL_FUNC(func) \
@@ -1537,73 +3167,100 @@ __declspec(dllexport) void set_gl_context_default_buffers(void* color_buffer, vo
     }
 #define IMPLEMENT_VOID_GL_FUNC_0(func) \
     void GL_APIENTRY gl##func() { \
-        gl->func(); \
+        gl_call(&sgl::GLContext::func); \
     }
 #define IMPLEMENT_VOID_GL_FUNC_1(func, t1) \
     void GL_APIENTRY gl##func(t1 p1) { \
-        gl->func(p1); \
+        gl_call(&sgl::GLContext::func, p1); \
     }
 #define IMPLEMENT_VOID_GL_FUNC_2(func, t1, t2) \
     void GL_APIENTRY gl##func(t1 p1, t2 p2) { \
-        gl->func(p1, p2); \
+        gl_call(&sgl::GLContext::func, p1, p2); \
     }
 #define IMPLEMENT_VOID_GL_FUNC_3(func, t1, t2, t3) \
     void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3) { \
-        gl->func(p1, p2, p3); \
+        gl_call(&sgl::GLContext::func, p1, p2, p3); \
     }
 #define IMPLEMENT_VOID_GL_FUNC_4(func, t1, t2, t3, t4) \
     void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4) { \
-        gl->func(p1, p2, p3, p4); \
+        gl_call(&sgl::GLContext::func, p1, p2, p3, p4); \
     }
 #define IMPLEMENT_VOID_GL_FUNC_5(func, t1, t2, t3, t4, t5) \
     void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4, t5 p5) { \
-        gl->func(p1, p2, p3, p4, p5); \
+        gl_call(&sgl::GLContext::func, p1, p2, p3, p4, p5); \
     }
-#define IMPLEMENT_VOID_GL_FUNC_6(func, t1, t2, t3, t4, t5, t6) \
-    void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4, t5 p5, t6 p6) { \
-        gl->func(p1, p2, p3, p4, p5, p6); \
+// queries and calls writing to client memory run on the calling thread once the recorded calls have run
+#define IMPLEMENT_SYNC_VOID_GL_FUNC_0(func) \
+    void GL_APIENTRY gl##func() { \
+        gl_sync(); \
+        gl_current->gl->func(); \
     }
-#define IMPLEMENT_VOID_GL_FUNC_7(func, t1, t2, t3, t4, t5, t6, t7) \
-    void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4, t5 p5, t6 p6, t7 p7) { \
-        gl->func(p1, p2, p3, p4, p5, p6, p7); \
+#define IMPLEMENT_SYNC_VOID_GL_FUNC_2(func, t1, t2) \
+    void GL_APIENTRY gl##func(t1 p1, t2 p2) { \
+        gl_sync(); \
+        gl_current->gl->func(p1, p2); \
+    }
+#define IMPLEMENT_SYNC_VOID_GL_FUNC_3(func, t1, t2, t3) \
+    void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3) { \
+        gl_sync(); \
+        gl_current->gl->func(p1, p2, p3); \
+    }
+#define IMPLEMENT_SYNC_VOID_GL_FUNC_4(func, t1, t2, t3, t4) \
+    void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4) { \
+        gl_sync(); \
+        gl_current->gl->func(p1, p2, p3, p4); \
     }
-#define IMPLEMENT_VOID_GL_FUNC_9(func, t1, t2, t3, t4, t5, t6, t7, t8, t9) \
-    void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4, t5 p5, t6 p6, t7 p7, t8 p8, t9 p9) { \
-        gl->func(p1, p2, p3, p4, p5, p6, p7, p8, p9); \
+#define IMPLEMENT_SYNC_VOID_GL_FUNC_7(func, t1, t2, t3, t4, t5, t6, t7) \
+    void GL_APIENTRY gl##func(t1 p1, t2 p2, t3 p3, t4 p4, t5 p5, t6 p6, t7 p7) { \
+        gl_sync(); \
+        gl_current->gl->func(p1, p2, p3, p4, p5, p6, p7); \
     }
 #define IMPLEMENT_GL_FUNC_0(ret, func) \
     ret GL_APIENTRY gl##func() { \
-        return gl->func(); \
+        gl_sync(); \
+        return gl_current->gl->func(); \
     }
 #define IMPLEMENT_GL_FUNC_1(ret, func, t1) \
     ret GL_APIENTRY gl##func(t1 p1) { \
-        return gl->func(p1); \
+        gl_sync(); \
+        return gl_current->gl->func(p1); \
     }
 #define IMPLEMENT_GL_FUNC_2(ret, func, t1, t2) \
     ret GL_APIENTRY gl##func(t1 p1, t2 p2) { \
-        return gl->func(p1, p2); \
+        gl_sync(); \
+        return gl_current->gl->func(p1, p2); \
     }
 
 // Framebuffer
-IMPLEMENT_VOID_GL_FUNC_2(GenFramebuffers, GLsizei, GLuint*)
-IMPLEMENT_VOID_GL_FUNC_2(DeleteFramebuffers, GLsizei, const GLuint*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_2(GenFramebuffers, GLsizei, GLuint*)
+void GL_APIENTRY glDeleteFramebuffers(GLsizei n, const GLuint* names)
+{
+    gl_call(&sgl::GLContext::DeleteFramebuffers, n, gl_copy(names, n));
+}
 IMPLEMENT_GL_FUNC_1(GLboolean, IsFramebuffer, GLuint)
 IMPLEMENT_VOID_GL_FUNC_2(BindFramebuffer, GLenum, GLuint)
 IMPLEMENT_VOID_GL_FUNC_4(FramebufferRenderbuffer, GLenum, GLenum, GLenum, GLuint)
-IMPLEMENT_VOID_GL_FUNC_4(GetFramebufferAttachmentParameteriv, GLenum, GLenum, GLenum, GLint*)
+IMPLEMENT_VOID_GL_FUNC_5(FramebufferTexture2D, GLenum, GLenum, GLenum, GLuint, GLint)
+IMPLEMENT_SYNC_VOID_GL_FUNC_4(GetFramebufferAttachmentParameteriv, GLenum, GLenum, GLenum, GLint*)
 IMPLEMENT_GL_FUNC_1(GLenum, CheckFramebufferStatus, GLenum)
-IMPLEMENT_VOID_GL_FUNC_7(ReadPixels, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_7(ReadPixels, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_0(Finish)
+IMPLEMENT_VOID_GL_FUNC_0(Flush)
 
 // Renderbuffer
-IMPLEMENT_VOID_GL_FUNC_2(GenRenderbuffers, GLsizei, GLuint*)
-IMPLEMENT_VOID_GL_FUNC_2(DeleteRenderbuffers, GLsizei, const GLuint*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_2(GenRenderbuffers, GLsizei, GLuint*)
+void GL_APIENTRY glDeleteRenderbuffers(GLsizei n, const GLuint* names)
+{
+    gl_call(&sgl::GLContext::DeleteRenderbuffers, n, gl_copy(names, n));
+}
 IMPLEMENT_GL_FUNC_1(GLboolean, IsRenderbuffer, GLuint)
 IMPLEMENT_VOID_GL_FUNC_2(BindRenderbuffer, GLenum, GLuint)
 IMPLEMENT_VOID_GL_FUNC_4(RenderbufferStorage, GLenum, GLenum, GLsizei, GLsizei)
-IMPLEMENT_VOID_GL_FUNC_3(GetRenderbufferParameteriv, GLenum, GLenum, GLint*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_3(GetRenderbufferParameteriv, GLenum, GLenum, GLint*)
 
 // Viewport
 IMPLEMENT_VOID_GL_FUNC_4(Viewport, GLint, GLint, GLsizei, GLsizei)
+IMPLEMENT_VOID_GL_FUNC_4(Scissor, GLint, GLint, GLsizei, GLsizei)
 
 // Clear
 IMPLEMENT_VOID_GL_FUNC_4(ClearColor, GLfloat, GLfloat, GLfloat, GLfloat)
@@ -1615,8 +3272,37 @@ IMPLEMENT_VOID_GL_FUNC_1(Clear, GLbitfield)
 IMPLEMENT_GL_FUNC_1(GLuint, CreateShader, GLenum)
 IMPLEMENT_VOID_GL_FUNC_1(DeleteShader, GLuint)
 IMPLEMENT_GL_FUNC_1(GLboolean, IsShader, GLuint)
-IMPLEMENT_VOID_GL_FUNC_4(ShaderSource, GLuint, GLsizei, const GLchar* const*, const GLint*)
-IMPLEMENT_VOID_GL_FUNC_4(GetShaderSource, GLuint, GLsizei, GLsizei*, GLchar*)
+void GL_APIENTRY glShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)
+{
+    if (gl_current->queue && count > 0)
+    {
+        // the strings are joined into one copy
+        int size = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            size += length != nullptr && length[i] > 0 ? length[i] : (int) strlen(string[i]);
+        }
+
+        GLchar* source = (GLchar*) gl_current->queue->Alloc(size + 1);
+        int offset = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            int n = length != nullptr && length[i] > 0 ? length[i] : (int) strlen(string[i]);
+            Memory::Copy(&source[offset], string[i], n);
+            offset += n;
+        }
+        source[size] = 0;
+
+        const GLchar** strings = (const GLchar**) gl_current->queue->Alloc(sizeof(GLchar*));
+        strings[0] = source;
+        gl_current->queue->Record(&sgl::GLContext::ShaderSource, shader, (GLsizei) 1, (const GLchar* const*) strings, (const GLint*) nullptr);
+    }
+    else
+    {
+        gl_call(&sgl::GLContext::ShaderSource, shader, count, string, length);
+    }
+}
+IMPLEMENT_SYNC_VOID_GL_FUNC_4(GetShaderSource, GLuint, GLsizei, GLsizei*, GLchar*)
 IMPLEMENT_VOID_GL_FUNC_1(CompileShader, GLuint)
 NOT_IMPLEMENT_VOID_GL_FUNC(ShaderBinary(GLsizei, const GLuint*, GLenum binaryformat, const void*, GLsizei))
 NOT_IMPLEMENT_VOID_GL_FUNC(ReleaseShaderCompiler())
@@ -1630,30 +3316,105 @@ IMPLEMENT_VOID_GL_FUNC_1(DeleteProgram, GLuint)
 IMPLEMENT_GL_FUNC_1(GLboolean, IsProgram, GLuint)
 IMPLEMENT_VOID_GL_FUNC_2(AttachShader, GLuint, GLuint)
 IMPLEMENT_VOID_GL_FUNC_2(DetachShader, GLuint, GLuint)
-IMPLEMENT_VOID_GL_FUNC_4(GetAttachedShaders, GLuint, GLsizei, GLsizei*, GLuint*)
-IMPLEMENT_VOID_GL_FUNC_3(BindAttribLocation, GLuint, GLuint, const GLchar*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_4(GetAttachedShaders, GLuint, GLsizei, GLsizei*, GLuint*)
+void GL_APIENTRY glBindAttribLocation(GLuint program, GLuint index, const GLchar* name)
+{
+    gl_call(&sgl::GLContext::BindAttribLocation, program, index, gl_copy(name, name ? (int) strlen(name) + 1 : 0));
+}
 IMPLEMENT_VOID_GL_FUNC_1(LinkProgram, GLuint)
 IMPLEMENT_GL_FUNC_2(GLint, GetAttribLocation, GLuint, const GLchar*)
 IMPLEMENT_GL_FUNC_2(GLint, GetUniformLocation, GLuint, const GLchar*)
 IMPLEMENT_VOID_GL_FUNC_1(UseProgram, GLuint)
 IMPLEMENT_VOID_GL_FUNC_2(Uniform1i, GLint, GLint)
-IMPLEMENT_VOID_GL_FUNC_3(Uniform4fv, GLint, GLsizei, const GLfloat*)
-IMPLEMENT_VOID_GL_FUNC_4(UniformMatrix4fv, GLint, GLsizei, GLboolean, const GLfloat*)
+void GL_APIENTRY glUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    gl_call(&sgl::GLContext::Uniform4fv, location, count, gl_copy(value, count * 4));
+}
+void GL_APIENTRY glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    gl_call(&sgl::GLContext::UniformMatrix4fv, location, count, transpose, gl_copy(value, count * 16));
+}
 
 // Buffer
-IMPLEMENT_VOID_GL_FUNC_2(GenBuffers, GLsizei, GLuint*)
-IMPLEMENT_VOID_GL_FUNC_2(DeleteBuffers, GLsizei, const GLuint*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_2(GenBuffers, GLsizei, GLuint*)
+void GL_APIENTRY glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    gl_current->client.DeleteBuffers(n, buffers);
+    gl_call(&sgl::GLContext::DeleteBuffers, n, gl_copy(buffers, n));
+}
 IMPLEMENT_GL_FUNC_1(GLboolean, IsBuffer, GLuint)
-IMPLEMENT_VOID_GL_FUNC_2(BindBuffer, GLenum, GLuint)
-IMPLEMENT_VOID_GL_FUNC_4(BufferData, GLenum, GLsizeiptr, const void*, GLenum)
-IMPLEMENT_VOID_GL_FUNC_4(BufferSubData, GLenum, GLintptr, GLsizeiptr, const void*)
+void GL_APIENTRY glBindBuffer(GLenum target, GLuint buffer)
+{
+    switch (target)
+    {
+        case GL_ARRAY_BUFFER:
+            gl_current->client.array_buffer = buffer;
+            break;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            gl_current->client.element_array_buffer = buffer;
+            break;
+        default:
+            break;
+    }
+    gl_call(&sgl::GLContext::BindBuffer, target, buffer);
+}
+void GL_APIENTRY glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    gl_call(&sgl::GLContext::BufferData, target, size, gl_copy_bytes(data, (int) size), usage);
+}
+void GL_APIENTRY glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+    gl_call(&sgl::GLContext::BufferSubData, target, offset, size, gl_copy_bytes(data, (int) size));
+}
 
 // Draw
-IMPLEMENT_VOID_GL_FUNC_6(VertexAttribPointer, GLuint, GLint, GLenum, GLboolean, GLsizei, const void*)
-IMPLEMENT_VOID_GL_FUNC_1(EnableVertexAttribArray, GLuint)
-IMPLEMENT_VOID_GL_FUNC_1(DisableVertexAttribArray, GLuint)
-IMPLEMENT_VOID_GL_FUNC_3(DrawArrays, GLenum, GLint, GLsizei)
-IMPLEMENT_VOID_GL_FUNC_4(DrawElements, GLenum, GLsizei, GLenum, const void*)
+void GL_APIENTRY glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+{
+    gl_current->client.GetAttrib(index).buffer = gl_current->client.array_buffer;
+    gl_call(&sgl::GLContext::VertexAttribPointer, index, size, type, normalized, stride, pointer);
+}
+void GL_APIENTRY glEnableVertexAttribArray(GLuint index)
+{
+    gl_current->client.GetAttrib(index).enable = true;
+    gl_call(&sgl::GLContext::EnableVertexAttribArray, index);
+}
+void GL_APIENTRY glDisableVertexAttribArray(GLuint index)
+{
+    GLClientState::Attrib& attrib = gl_current->client.GetAttrib(index);
+    attrib.enable = false;
+    attrib.buffer = 0;
+    gl_call(&sgl::GLContext::DisableVertexAttribArray, index);
+}
+void GL_APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    gl_call(&sgl::GLContext::DrawArrays, mode, first, count);
+    gl_wait_client_draw(false);
+}
+void GL_APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+    gl_call(&sgl::GLContext::DrawElements, mode, count, type, indices);
+    gl_wait_client_draw(true);
+}
+void GL_APIENTRY glMultiDrawArraysEXT(GLenum mode, const GLint* first, const GLsizei* count, GLsizei primcount)
+{
+    gl_call(&sgl::GLContext::MultiDrawArraysEXT, mode, gl_copy(first, primcount), gl_copy(count, primcount), primcount);
+    gl_wait_client_draw(false);
+}
+void GL_APIENTRY glMultiDrawElementsEXT(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices, GLsizei primcount)
+{
+    gl_call(&sgl::GLContext::MultiDrawElementsEXT, mode, gl_copy(count, primcount), type, gl_copy(indices, primcount), primcount);
+    gl_wait_client_draw(true);
+}
+void GL_APIENTRY glDrawArraysBatchSGL(GLenum mode, const GLDrawCommandSGL* commands, GLsizei drawcount)
+{
+    gl_call(&sgl::GLContext::DrawArraysBatchSGL, mode, gl_copy_draw_commands(commands, drawcount), drawcount);
+    gl_wait_client_draw(false);
+}
+void GL_APIENTRY glDrawElementsBatchSGL(GLenum mode, GLenum type, const GLDrawCommandSGL* commands, GLsizei drawcount)
+{
+    gl_call(&sgl::GLContext::DrawElementsBatchSGL, mode, type, gl_copy_draw_commands(commands, drawcount), drawcount);
+    gl_wait_client_draw(true);
+}
 
 // State
 IMPLEMENT_VOID_GL_FUNC_1(Enable, GLenum)
@@ -1668,11 +3429,55 @@ IMPLEMENT_VOID_GL_FUNC_4(BlendFuncSeparate, GLenum, GLenum, GLenum, GLenum)
 IMPLEMENT_VOID_GL_FUNC_1(BlendEquation, GLenum)
 IMPLEMENT_VOID_GL_FUNC_2(BlendEquationSeparate, GLenum, GLenum)
 IMPLEMENT_VOID_GL_FUNC_4(BlendColor, GLfloat, GLfloat, GLfloat, GLfloat)
+IMPLEMENT_VOID_GL_FUNC_4(ColorMask, GLboolean, GLboolean, GLboolean, GLboolean)
+IMPLEMENT_VOID_GL_FUNC_3(StencilFunc, GLenum, GLint, GLuint)
+IMPLEMENT_VOID_GL_FUNC_4(StencilFuncSeparate, GLenum, GLenum, GLint, GLuint)
+IMPLEMENT_VOID_GL_FUNC_1(StencilMask, GLuint)
+IMPLEMENT_VOID_GL_FUNC_2(StencilMaskSeparate, GLenum, GLuint)
+IMPLEMENT_VOID_GL_FUNC_3(StencilOp, GLenum, GLenum, GLenum)
+IMPLEMENT_VOID_GL_FUNC_4(StencilOpSeparate, GLenum, GLenum, GLenum, GLenum)
 
 // Texture
-IMPLEMENT_VOID_GL_FUNC_2(GenTextures, GLsizei, GLuint*)
-IMPLEMENT_VOID_GL_FUNC_2(DeleteTextures, GLsizei, const GLuint*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_2(GenTextures, GLsizei, GLuint*)
+void GL_APIENTRY glDeleteTextures(GLsizei n, const GLuint* names)
+{
+    gl_call(&sgl::GLContext::DeleteTextures, n, gl_copy(names, n));
+}
 IMPLEMENT_GL_FUNC_1(GLboolean, IsTexture, GLuint)
 IMPLEMENT_VOID_GL_FUNC_1(ActiveTexture, GLenum)
 IMPLEMENT_VOID_GL_FUNC_2(BindTexture, GLenum, GLuint)
-IMPLEMENT_VOID_GL_FUNC_9(TexImage2D, GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*)
+void GL_APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+{
+    int size = sgl::GLTexture2D::GetImageSize(width, height, format, type, gl_current->client.unpack_alignment);
+    gl_call(&sgl::GLContext::TexImage2D, target, level, internalformat, width, height, border, format, type, gl_copy_bytes(pixels, size));
+}
+void GL_APIENTRY glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+{
+    int size = sgl::GLTexture2D::GetImageSize(width, height, format, type, gl_current->client.unpack_alignment);
+    gl_call(&sgl::GLContext::TexSubImage2D, target, level, xoffset, yoffset, width, height, format, type, gl_copy_bytes(pixels, size));
+}
+void GL_APIENTRY glPixelStorei(GLenum pname, GLint param)
+{
+    if (pname == GL_UNPACK_ALIGNMENT && (param == 1 || param == 2 || param == 4 || param == 8))
+    {
+        gl_current->client.unpack_alignment = param;
+    }
+    gl_call(&sgl::GLContext::PixelStorei, pname, param);
+}
+void GL_APIENTRY glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void* data)
+{
+    gl_call(&sgl::GLContext::CompressedTexImage2D, target, level, internalformat, width, height, border, imageSize, gl_copy_bytes(data, imageSize));
+}
+IMPLEMENT_VOID_GL_FUNC_3(TexParameteri, GLenum, GLenum, GLint)
+void GL_APIENTRY glTexParameteriv(GLenum target, GLenum pname, const GLint* params)
+{
+    gl_call(&sgl::GLContext::TexParameteriv, target, pname, gl_copy(params, 1));
+}
+IMPLEMENT_VOID_GL_FUNC_3(TexParameterf, GLenum, GLenum, GLfloat)
+void GL_APIENTRY glTexParameterfv(GLenum target, GLenum pname, const GLfloat* params)
+{
+    gl_call(&sgl::GLContext::TexParameterfv, target, pname, gl_copy(params, 1));
+}
+IMPLEMENT_SYNC_VOID_GL_FUNC_3(GetTexParameteriv, GLenum, GLenum, GLint*)
+IMPLEMENT_SYNC_VOID_GL_FUNC_3(GetTexParameterfv, GLenum, GLenum, GLfloat*)
+IMPLEMENT_VOID_GL_FUNC_1(GenerateMipmap, GLenum)
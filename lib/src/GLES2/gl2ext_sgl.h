@@ -0,0 +1,59 @@
+#ifndef __gl2ext_sgl_h_
+#define __gl2ext_sgl_h_ 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/* soft-gles2 specific extensions, declared in the same layout as gl2ext.h */
+
+#include <GLES2/gl2.h>
+
+#ifndef GL_APIENTRYP
+#define GL_APIENTRYP GL_APIENTRY*
+#endif
+
+#ifndef GL_SGL_draw_batch
+#define GL_SGL_draw_batch 1
+/* One draw of a batch. All draws of a batch share the current state,
+ * except for an optional vec4 uniform block uploaded before the draw
+ * (uniform_location = -1 to skip). */
+typedef struct GLDrawCommandSGL
+{
+    GLint first;
+    GLsizei count;
+    const void *indices;
+    GLint uniform_location;
+    GLsizei uniform_count;
+    const GLfloat *uniform_value;
+} GLDrawCommandSGL;
+typedef void (GL_APIENTRYP PFNGLDRAWARRAYSBATCHSGLPROC) (GLenum mode, const GLDrawCommandSGL *commands, GLsizei drawcount);
+typedef void (GL_APIENTRYP PFNGLDRAWELEMENTSBATCHSGLPROC) (GLenum mode, GLenum type, const GLDrawCommandSGL *commands, GLsizei drawcount);
+#ifdef GL_GLEXT_PROTOTYPES
+GL_APICALL void GL_APIENTRY glDrawArraysBatchSGL (GLenum mode, const GLDrawCommandSGL *commands, GLsizei drawcount);
+GL_APICALL void GL_APIENTRY glDrawElementsBatchSGL (GLenum mode, GLenum type, const GLDrawCommandSGL *commands, GLsizei drawcount);
+#endif
+#endif /* GL_SGL_draw_batch */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
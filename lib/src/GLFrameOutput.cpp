@@ -0,0 +1,185 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLFrameOutput.h"
+#include "io/File.h"
+#include "memory/Memory.h"
+#include "Debug.h"
+#include <atomic>
+
+#if VR_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace Viry3D;
+
+namespace sgl
+{
+    // the sequence and count words of the ring are read by other processes while they change
+    static std::atomic<GLuint>* ring_word(volatile GLuint* word)
+    {
+        static_assert(sizeof(std::atomic<GLuint>) == sizeof(GLuint), "atomic word is not a plain word");
+        return (std::atomic<GLuint>*) word;
+    }
+
+    GLFrameRing::GLFrameRing(const String& name, int slot_count, int width, int height):
+        m_name(name),
+        m_size(0),
+        m_handle(nullptr),
+        m_header(nullptr)
+    {
+        int pitch = width * 4;
+        int slot_size = (int) sizeof(SGLFrameRingSlot) + pitch * height;
+        m_size = (int) sizeof(SGLFrameRingHeader) + slot_size * slot_count;
+
+        void* memory = nullptr;
+#if VR_WINDOWS
+        HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, m_size, name.CString());
+        if (handle)
+        {
+            memory = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, m_size);
+            if (memory == nullptr)
+            {
+                CloseHandle(handle);
+                handle = nullptr;
+            }
+        }
+        m_handle = handle;
+#else
+        int fd = shm_open(name.CString(), O_CREAT | O_RDWR, 0600);
+        if (fd >= 0)
+        {
+            if (ftruncate(fd, m_size) == 0)
+            {
+                memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (memory == MAP_FAILED)
+                {
+                    memory = nullptr;
+                }
+            }
+            close(fd);
+
+            if (memory == nullptr)
+            {
+                shm_unlink(name.CString());
+            }
+        }
+#endif
+
+        if (memory == nullptr)
+        {
+            Log("frame ring %s could not be made", name.CString());
+            return;
+        }
+
+        m_header = (SGLFrameRingHeader*) memory;
+        m_header->width = width;
+        m_header->height = height;
+        m_header->pitch = pitch;
+        m_header->slot_count = slot_count;
+        m_header->slot_size = slot_size;
+        ring_word(&m_header->frame_count)->store(0, std::memory_order_relaxed);
+
+        for (int i = 0; i < slot_count; ++i)
+        {
+            SGLFrameRingSlot* slot = (SGLFrameRingSlot*) ((unsigned char*) (m_header + 1) + i * slot_size);
+            ring_word(&slot->sequence)->store(0, std::memory_order_relaxed);
+            slot->serial = 0;
+        }
+
+        // readers check the magic last, the layout is complete when they see it
+        ring_word(&m_header->magic)->store(SGL_FRAME_RING_MAGIC, std::memory_order_release);
+    }
+
+    GLFrameRing::~GLFrameRing()
+    {
+        if (m_header == nullptr)
+        {
+            return;
+        }
+
+#if VR_WINDOWS
+        UnmapViewOfFile(m_header);
+        CloseHandle((HANDLE) m_handle);
+#else
+        munmap(m_header, m_size);
+        shm_unlink(m_name.CString());
+#endif
+    }
+
+    void GLFrameRing::Present(const GLFrame& frame)
+    {
+        if (m_header == nullptr || frame.width != m_header->width || frame.height != m_header->height)
+        {
+            return;
+        }
+
+        GLuint frame_count = ring_word(&m_header->frame_count)->load(std::memory_order_relaxed);
+        int slot_index = (int) (frame_count % (GLuint) m_header->slot_count);
+        SGLFrameRingSlot* slot = (SGLFrameRingSlot*) ((unsigned char*) (m_header + 1) + slot_index * m_header->slot_size);
+
+        // odd while the slot is written, a reader whose copy saw the sequence change reads again.
+        // slot rows go from the top down as the frame walks them
+        std::atomic<GLuint>* sequence = ring_word(&slot->sequence);
+        GLuint odd = sequence->load(std::memory_order_relaxed) + 1;
+        sequence->store(odd, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->serial = frame.serial;
+        unsigned char* pixels = (unsigned char*) (slot + 1);
+        for (int i = 0; i < frame.height; ++i)
+        {
+            Memory::Copy(&pixels[i * m_header->pitch], &frame.pixels[i * frame.pitch], m_header->pitch);
+        }
+
+        sequence->store(odd + 1, std::memory_order_release);
+        ring_word(&m_header->frame_count)->store(frame_count + 1, std::memory_order_release);
+    }
+
+    void GLFrameWriter::Present(const GLFrame& frame)
+    {
+        if (m_interval <= 0 || frame.serial % (unsigned int) m_interval != 0)
+        {
+            return;
+        }
+
+        // binary ppm, rgb rows from the top down after a text header, the frame walks its rows in that order
+        String header = String::Format("P6\n%d %d\n255\n", frame.width, frame.height);
+        int header_size = header.Size();
+        ByteBuffer ppm(header_size + frame.width * frame.height * 3);
+        Memory::Copy(ppm.Bytes(), header.CString(), header_size);
+
+        unsigned char* rgb = &ppm[header_size];
+        for (int i = 0; i < frame.height; ++i)
+        {
+            const unsigned char* row = &frame.pixels[i * frame.pitch];
+            for (int j = 0; j < frame.width; ++j)
+            {
+                rgb[0] = row[j * 4 + 0];
+                rgb[1] = row[j * 4 + 1];
+                rgb[2] = row[j * 4 + 2];
+                rgb += 3;
+            }
+        }
+
+        File::WriteAllBytes(String::Format(m_path_format.CString(), frame.serial), ppm);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "SGL/sgl.h"
+#include "string/String.h"
+#include <functional>
+
+namespace sgl
+{
+    // a presented color buffer of rgba8 pixels
+    struct GLFrame
+    {
+        // the top row, the buffer keeps rows from the bottom up so the next row down is pitch away
+        const unsigned char* pixels;
+        int width;
+        int height;
+        // bytes from a row to the one below it, negative for a color buffer
+        int pitch;
+        // frames of the surface presented before this one
+        unsigned int serial;
+    };
+
+    // where a surface hands its frames. Present runs on the thread the gl calls of the
+    // context run on, the pixels are not copied and stay unchanged until the surface has
+    // presented as many frames more as it has buffers less one
+    class GLFrameOutput
+    {
+    public:
+        virtual ~GLFrameOutput() { }
+        virtual void Present(const GLFrame& frame) = 0;
+    };
+
+    class GLFrameCallback: public GLFrameOutput
+    {
+    public:
+        typedef std::function<void(const GLFrame&)> Callback;
+
+        GLFrameCallback(const Callback& callback):
+            m_callback(callback)
+        {
+        }
+
+        virtual void Present(const GLFrame& frame)
+        {
+            m_callback(frame);
+        }
+
+    private:
+        Callback m_callback;
+    };
+
+    // frames copied into the slots of a named shared memory ring another process reads, laid out
+    // as SGLFrameRingHeader and SGLFrameRingSlot describe. the ring goes with its output
+    class GLFrameRing: public GLFrameOutput
+    {
+    public:
+        GLFrameRing(const Viry3D::String& name, int slot_count, int width, int height);
+        virtual ~GLFrameRing();
+        // false if the shared memory could not be made
+        bool IsValid() const { return m_header != nullptr; }
+        virtual void Present(const GLFrame& frame);
+
+    private:
+        Viry3D::String m_name;
+        int m_size;
+        // the file mapping on windows
+        void* m_handle;
+        SGLFrameRingHeader* m_header;
+    };
+
+    // every interval-th frame written to a binary ppm file, path_format takes the serial of the frame as %u
+    class GLFrameWriter: public GLFrameOutput
+    {
+    public:
+        GLFrameWriter(const Viry3D::String& path_format, int interval):
+            m_path_format(path_format),
+            m_interval(interval)
+        {
+        }
+
+        virtual void Present(const GLFrame& frame);
+
+    private:
+        Viry3D::String m_path_format;
+        int m_interval;
+    };
+}
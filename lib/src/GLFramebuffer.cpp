@@ -21,40 +21,73 @@
 
 namespace sgl
 {
-    void GLFramebuffer::GetAttachmentParameteriv(Attachment attachment, GLenum pname, GLint* params) const
+    void GLFramebuffer::SetAttachment(Attachment attachment, const Ref<GLRenderbuffer>& rb)
+    {
+        m_attachment_types[(int) attachment] = rb ? GL_RENDERBUFFER : GL_NONE;
+        m_attachments[(int) attachment] = rb;
+    }
+
+    void GLFramebuffer::SetAttachment(Attachment attachment, const Ref<GLTexture2D>& tex)
     {
-        Ref<GLObject> obj;
+        m_attachment_types[(int) attachment] = tex ? GL_TEXTURE : GL_NONE;
+        m_attachments[(int) attachment] = tex;
+    }
 
-        if (m_attachments[(int) attachment].expired())
+    void GLFramebuffer::Detach(const GLObject* obj)
+    {
+        for (int i = 0; i < (int) Attachment::Count; ++i)
         {
-            *params = GL_NONE;
-            return;
+            if (m_attachments[i].get() == obj)
+            {
+                m_attachment_types[i] = GL_NONE;
+                m_attachments[i].reset();
+            }
         }
-        else
+    }
+
+    GLRenderbuffer* GLFramebuffer::GetRenderbuffer(Attachment attachment) const
+    {
+        if (m_attachment_types[(int) attachment] == GL_RENDERBUFFER)
         {
-            obj = m_attachments[(int) attachment].lock();
+            return static_cast<GLRenderbuffer*>(m_attachments[(int) attachment].get());
+        }
+
+        return nullptr;
+    }
+
+    GLTexture2D* GLFramebuffer::GetTexture2D(Attachment attachment) const
+    {
+        if (m_attachment_types[(int) attachment] == GL_TEXTURE)
+        {
+            return static_cast<GLTexture2D*>(m_attachments[(int) attachment].get());
+        }
+
+        return nullptr;
+    }
+
+    void GLFramebuffer::GetAttachmentParameteriv(Attachment attachment, GLenum pname, GLint* params) const
+    {
+        GLenum type = m_attachment_types[(int) attachment];
+        if (type == GL_NONE)
+        {
+            *params = GL_NONE;
+            return;
         }
 
         switch (pname)
         {
             case GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE:
-                if (RefCast<GLRenderbuffer>(obj))
-                {
-                    *params = GL_RENDERBUFFER;
-                }
-                else if (RefCast<GLTexture>(obj))
-                {
-                    *params = GL_TEXTURE;
-                }
-                else
-                {
-                    *params = GL_NONE;
-                }
+                *params = type;
                 break;
             case GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME:
-                *params = (GLint) obj->GetId();
+                *params = (GLint) m_attachments[(int) attachment]->GetId();
+                break;
+            case GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LEVEL:
+                if (type == GL_TEXTURE)
+                {
+                    *params = 0;
+                }
                 break;
-                //TODO: case GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LEVEL:
                 //TODO: case GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_CUBE_MAP_FACE:
             default:
                 break;
@@ -63,22 +96,36 @@ namespace sgl
 
     GLenum GLFramebuffer::CheckStatus() const
     {
-        bool no_attached = true;
-        bool all_attached = true;
         bool same_size = true;
         int w = -1;
         int h = -1;
 
         for (int i = 0; i < (int) Attachment::Count; ++i)
         {
-            if (!m_attachments[i].expired())
+            if (m_attachment_types[i] != GL_NONE)
             {
-                no_attached = false;
-
-                Ref<GLObject> obj = m_attachments[i].lock();
-                if (RefCast<GLRenderbuffer>(obj))
+                if (m_attachment_types[i] == GL_RENDERBUFFER)
                 {
-                    Ref<GLRenderbuffer> rbo = RefCast<GLRenderbuffer>(obj);
+                    GLRenderbuffer* rbo = static_cast<GLRenderbuffer*>(m_attachments[i].get());
+                    // a packed depth stencil buffer fits both the depth and the stencil attachment
+                    bool renderable;
+                    switch ((Attachment) i)
+                    {
+                        case Attachment::Depth:
+                            renderable = rbo->GetDepthSize() > 0;
+                            break;
+                        case Attachment::Stencil:
+                            renderable = rbo->GetStencilSize() > 0;
+                            break;
+                        default:
+                            renderable = rbo->GetDepthSize() == 0 && rbo->GetStencilSize() == 0;
+                            break;
+                    }
+                    if (!renderable)
+                    {
+                        return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
+                    }
+
                     if (w != -1 && h != -1 && (w != rbo->GetWidth() || h != rbo->GetHeight()))
                     {
                         same_size = false;
@@ -87,9 +134,14 @@ namespace sgl
                     w = rbo->GetWidth();
                     h = rbo->GetHeight();
                 }
-                else if (RefCast<GLTexture2D>(obj))
+                else if (m_attachment_types[i] == GL_TEXTURE)
                 {
-                    Ref<GLTexture2D> tex = RefCast<GLTexture2D>(obj);
+                    GLTexture2D* tex = static_cast<GLTexture2D*>(m_attachments[i].get());
+                    if (i != (int) Attachment::Color0 || tex->IsRenderable() == false)
+                    {
+                        return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
+                    }
+
                     if (w != -1 && h != -1 && (w != tex->GetWidth() || h != tex->GetHeight()))
                     {
                         same_size = false;
@@ -103,39 +155,29 @@ namespace sgl
                     return 0;
                 }
             }
-            else
-            {
-                all_attached = false;
-            }
         }
 
-        if (no_attached)
+        // draws need a color buffer, without depth or stencil their tests pass
+        if (m_attachment_types[(int) Attachment::Color0] == GL_NONE)
         {
             return GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT;
         }
         else
         {
-            if (all_attached)
+            if (same_size)
             {
-                if (same_size)
+                if (w == 0 || h == 0)
                 {
-                    if (w == 0 || h == 0)
-                    {
-                        return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
-                    }
-                    else
-                    {
-                        return GL_FRAMEBUFFER_COMPLETE;
-                    }
+                    return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
                 }
                 else
                 {
-                    return GL_FRAMEBUFFER_INCOMPLETE_DIMENSIONS;
+                    return GL_FRAMEBUFFER_COMPLETE;
                 }
             }
             else
             {
-                return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
+                return GL_FRAMEBUFFER_INCOMPLETE_DIMENSIONS;
             }
         }
 
@@ -23,6 +23,8 @@
 namespace sgl
 {
     class GLContext;
+    class GLRenderbuffer;
+    class GLTexture2D;
 
     class GLFramebuffer: public GLObject
     {
@@ -38,7 +40,14 @@ namespace sgl
             Count
         };
 
-        GLFramebuffer(GLuint id): GLObject(id) { }
+        GLFramebuffer(GLuint id):
+            GLObject(id)
+        {
+            for (int i = 0; i < (int) Attachment::Count; ++i)
+            {
+                m_attachment_types[i] = GL_NONE;
+            }
+        }
 
         virtual ~GLFramebuffer() { }
 
@@ -64,15 +73,21 @@ namespace sgl
             return attach;
         }
 
-        void SetAttachment(Attachment attachment, const Ref<GLObject>& obj)
-        {
-            m_attachments[(int) attachment] = obj;
-        }
-
+        // null detaches
+        void SetAttachment(Attachment attachment, const Ref<GLRenderbuffer>& rb);
+        void SetAttachment(Attachment attachment, const Ref<GLTexture2D>& tex);
+        // the deleting context detaches an object from its framebuffers, in the framebuffers
+        // of other contexts of the share group the attachment keeps the object alive
+        void Detach(const GLObject* obj);
+        // null if the attachment is not of the type
+        GLRenderbuffer* GetRenderbuffer(Attachment attachment) const;
+        GLTexture2D* GetTexture2D(Attachment attachment) const;
         void GetAttachmentParameteriv(Attachment attachment, GLenum pname, GLint* params) const;
         GLenum CheckStatus() const;
 
     private:
-        WeakRef<GLObject> m_attachments[(int) Attachment::Count];
+        // GL_RENDERBUFFER, GL_TEXTURE or GL_NONE
+        GLenum m_attachment_types[(int) Attachment::Count];
+        Ref<GLObject> m_attachments[(int) Attachment::Count];
     };
 }
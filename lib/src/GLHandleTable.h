@@ -0,0 +1,220 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "GLES2/gl2.h"
+#include "memory/Ref.h"
+#include "container/Vector.h"
+#include <mutex>
+
+namespace sgl
+{
+    // objects of one type in a dense slot array, a name is slot index, type tag and slot generation,
+    // so a lookup is an index and two compares. a deleted name misses the slot's next objects until
+    // the 7 bit generation wraps, once the slot has been reused 128 times the name can be live again.
+    // a table of a share group is used from the threads of all its contexts, every call takes its lock
+    template<class T>
+    class GLHandleTable
+    {
+    public:
+        enum
+        {
+            INDEX_BITS = 20,
+            TAG_BITS = 4,
+            GENERATION_BITS = 7,
+
+            INDEX_MASK = (1 << INDEX_BITS) - 1,
+            TAG_SHIFT = INDEX_BITS,
+            TAG_MASK = (1 << TAG_BITS) - 1,
+            GENERATION_SHIFT = INDEX_BITS + TAG_BITS,
+            GENERATION_MASK = (1 << GENERATION_BITS) - 1,
+
+            // index 0 is never used, so no name is 0
+            MAX_SLOTS = INDEX_MASK,
+        };
+
+        // tags keep names of different tables apart, as if they shared one namespace
+        GLHandleTable(int tag):
+            m_tag((GLuint) tag & TAG_MASK),
+            m_free(0),
+            m_size(0)
+        {
+            // slot 0 heads nothing, the free list ends at it
+            m_slots.Resize(1);
+            m_slots[0].generation = 0;
+            m_slots[0].next_free = 0;
+        }
+
+        GLuint Create()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            int index = m_free;
+            if (index != 0)
+            {
+                m_free = m_slots[index].next_free;
+            }
+            else
+            {
+                if (m_slots.Size() > MAX_SLOTS)
+                {
+                    return 0;
+                }
+
+                index = m_slots.Size();
+
+                Slot slot;
+                slot.generation = 0;
+                slot.next_free = 0;
+                m_slots.Add(slot);
+            }
+
+            Slot& slot = m_slots[index];
+            GLuint name = this->MakeName(index, slot.generation);
+            slot.object = RefMake<T>(name);
+            m_size += 1;
+
+            return name;
+        }
+
+        T* Get(GLuint name) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            int index = this->FindSlot(name);
+            if (index != 0)
+            {
+                return m_slots[index].object.get();
+            }
+
+            return nullptr;
+        }
+
+        // for holders that own the object past its name, like a program its attached shaders
+        Ref<T> GetRef(GLuint name) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            int index = this->FindSlot(name);
+            if (index != 0)
+            {
+                return m_slots[index].object;
+            }
+
+            return Ref<T>();
+        }
+
+        // the object under a live name, made again under the same name
+        void Replace(GLuint name, const Ref<T>& obj)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            int index = this->FindSlot(name);
+            if (index != 0)
+            {
+                m_slots[index].object = obj;
+            }
+        }
+
+        bool Remove(GLuint name)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            int index = this->FindSlot(name);
+            if (index == 0)
+            {
+                return false;
+            }
+
+            Slot& slot = m_slots[index];
+            slot.object.reset();
+            // wraps, stale names are only told apart over the last GENERATION_MASK reuses
+            slot.generation = (slot.generation + 1) & GENERATION_MASK;
+            slot.next_free = m_free;
+            m_free = index;
+            m_size -= 1;
+
+            return true;
+        }
+
+        int Size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            return m_size;
+        }
+
+        // live objects in slot order, for the rare walks on delete
+        template<class F>
+        void ForEach(F f) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (int i = 1; i < m_slots.Size(); ++i)
+            {
+                if (m_slots[i].object)
+                {
+                    f(m_slots[i].object.get());
+                }
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            Ref<T> object;
+            GLuint generation;
+            int next_free;
+        };
+
+        GLuint MakeName(int index, GLuint generation) const
+        {
+            return (generation << GENERATION_SHIFT) | (m_tag << TAG_SHIFT) | (GLuint) index;
+        }
+
+        // 0 if the name is not a live object of this table
+        int FindSlot(GLuint name) const
+        {
+            int index = (int) (name & INDEX_MASK);
+            if (index == 0 || index >= m_slots.Size())
+            {
+                return 0;
+            }
+
+            if (((name >> TAG_SHIFT) & TAG_MASK) != m_tag)
+            {
+                return 0;
+            }
+
+            const Slot& slot = m_slots[index];
+            if (!slot.object || slot.generation != ((name >> GENERATION_SHIFT) & GENERATION_MASK))
+            {
+                return 0;
+            }
+
+            return index;
+        }
+
+    private:
+        Viry3D::Vector<Slot> m_slots;
+        GLuint m_tag;
+        int m_free;
+        int m_size;
+        mutable std::mutex m_mutex;
+    };
+}
@@ -0,0 +1,567 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLOutputMerger.h"
+#include "GLSimd.h"
+#include "math/Mathf.h"
+
+using namespace Viry3D;
+
+namespace sgl
+{
+    typedef GLOutputMerger::State State;
+    typedef GLOutputMerger::ColorParams ColorParams;
+
+    static bool DepthEqual(float src, float dest)
+    {
+        return Mathf::FloatEqual(src, dest);
+    }
+
+    // unorm values compare exactly at the precision of the buffer
+    static bool DepthEqual(unsigned short src, unsigned short dest)
+    {
+        return src == dest;
+    }
+
+    static bool DepthEqual(unsigned int src, unsigned int dest)
+    {
+        return src == dest;
+    }
+
+    template<GLenum func, class T>
+    static bool DepthCompare(T src, T dest)
+    {
+        switch (func)
+        {
+            case GL_NEVER:
+                return false;
+            case GL_LESS:
+                return src < dest;
+            case GL_EQUAL:
+                return DepthEqual(src, dest);
+            case GL_LEQUAL:
+                return src <= dest;
+            case GL_GREATER:
+                return src > dest;
+            case GL_NOTEQUAL:
+                return !DepthEqual(src, dest);
+            case GL_GEQUAL:
+                return src >= dest;
+            case GL_ALWAYS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Format is one of the GLTileBuffer depth formats, the fragment is quantized to it before the test
+    template<class Format, GLenum func, bool write>
+    static bool TestDepth(const State& state, GLTileBuffer::Tile* tile, int index, float depth)
+    {
+        if (func == GL_ALWAYS && !write)
+        {
+            return true;
+        }
+
+        float mapped_depth = state.depth_range.x + (depth + 1) / 2 * (state.depth_range.y - state.depth_range.x);
+        typename Format::Value value = Format::Quantize(mapped_depth);
+        typename Format::Value* values = Format::Values(tile);
+
+        if (!DepthCompare<func>(value, values[index]))
+        {
+            return false;
+        }
+
+        if (write)
+        {
+            values[index] = value;
+            float stored_depth = Format::ToFloat(value);
+            tile->depth_min = Mathf::Min(tile->depth_min, stored_depth);
+            tile->depth_max = Mathf::Max(tile->depth_max, stored_depth);
+        }
+
+        return true;
+    }
+
+    template<class Format>
+    static GLOutputMerger::DepthKernel DepthKernelOf(int func, bool write)
+    {
+        static const GLOutputMerger::DepthKernel kernels[8][2] = {
+            { TestDepth<Format, GL_NEVER, false>, TestDepth<Format, GL_NEVER, true> },
+            { TestDepth<Format, GL_LESS, false>, TestDepth<Format, GL_LESS, true> },
+            { TestDepth<Format, GL_EQUAL, false>, TestDepth<Format, GL_EQUAL, true> },
+            { TestDepth<Format, GL_LEQUAL, false>, TestDepth<Format, GL_LEQUAL, true> },
+            { TestDepth<Format, GL_GREATER, false>, TestDepth<Format, GL_GREATER, true> },
+            { TestDepth<Format, GL_NOTEQUAL, false>, TestDepth<Format, GL_NOTEQUAL, true> },
+            { TestDepth<Format, GL_GEQUAL, false>, TestDepth<Format, GL_GEQUAL, true> },
+            { TestDepth<Format, GL_ALWAYS, false>, TestDepth<Format, GL_ALWAYS, true> },
+        };
+
+        return kernels[func][write ? 1 : 0];
+    }
+
+    // (a * b + 127) / 255 exactly, for a and b in 0..255
+    static int Mul255(int a, int b)
+    {
+        int t = a * b + 127;
+        return (t + 1 + (t >> 8)) >> 8;
+    }
+
+    static int BlendFactor(GLenum factor, const int* s, const int* d, const int* constant, int channel)
+    {
+        switch (factor)
+        {
+            case GL_ZERO:
+                return 0;
+            case GL_ONE:
+                return 255;
+            case GL_SRC_COLOR:
+                return s[channel];
+            case GL_ONE_MINUS_SRC_COLOR:
+                return 255 - s[channel];
+            case GL_DST_COLOR:
+                return d[channel];
+            case GL_ONE_MINUS_DST_COLOR:
+                return 255 - d[channel];
+            case GL_SRC_ALPHA:
+                return s[3];
+            case GL_ONE_MINUS_SRC_ALPHA:
+                return 255 - s[3];
+            case GL_DST_ALPHA:
+                return d[3];
+            case GL_ONE_MINUS_DST_ALPHA:
+                return 255 - d[3];
+            case GL_CONSTANT_COLOR:
+                return constant[channel];
+            case GL_ONE_MINUS_CONSTANT_COLOR:
+                return 255 - constant[channel];
+            case GL_CONSTANT_ALPHA:
+                return constant[3];
+            case GL_ONE_MINUS_CONSTANT_ALPHA:
+                return 255 - constant[3];
+            case GL_SRC_ALPHA_SATURATE:
+                return channel == 3 ? 255 : Mathf::Min(s[3], 255 - d[3]);
+        }
+
+        return 0;
+    }
+
+    static int BlendEquation(GLenum equation, int s, int d)
+    {
+        switch (equation)
+        {
+            case GL_FUNC_ADD:
+                return Mathf::Min(s + d, 255);
+            case GL_FUNC_SUBTRACT:
+                return Mathf::Max(s - d, 0);
+            case GL_FUNC_REVERSE_SUBTRACT:
+                return Mathf::Max(d - s, 0);
+        }
+
+        return s;
+    }
+
+#if SGL_SSE2
+    // the sse2 blends work on 2 pixels unpacked to 16 bit lanes, a 4 pixel span step is two of them
+    static __m128i Mul255(__m128i a, __m128i b)
+    {
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(127));
+        return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), _mm_set1_epi16(1)), 8);
+    }
+
+    static __m128i BroadcastAlpha(__m128i v)
+    {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    // lanes of the alpha channels
+    static __m128i AlphaLanes()
+    {
+        return _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    }
+
+    static __m128i BlendFactor(GLenum factor, __m128i s, __m128i d, __m128i constant, bool alpha)
+    {
+        __m128i one = _mm_set1_epi16(255);
+
+        switch (factor)
+        {
+            case GL_ZERO:
+                return _mm_setzero_si128();
+            case GL_ONE:
+                return one;
+            case GL_SRC_COLOR:
+                return s;
+            case GL_ONE_MINUS_SRC_COLOR:
+                return _mm_sub_epi16(one, s);
+            case GL_DST_COLOR:
+                return d;
+            case GL_ONE_MINUS_DST_COLOR:
+                return _mm_sub_epi16(one, d);
+            case GL_SRC_ALPHA:
+                return BroadcastAlpha(s);
+            case GL_ONE_MINUS_SRC_ALPHA:
+                return _mm_sub_epi16(one, BroadcastAlpha(s));
+            case GL_DST_ALPHA:
+                return BroadcastAlpha(d);
+            case GL_ONE_MINUS_DST_ALPHA:
+                return _mm_sub_epi16(one, BroadcastAlpha(d));
+            case GL_CONSTANT_COLOR:
+                return constant;
+            case GL_ONE_MINUS_CONSTANT_COLOR:
+                return _mm_sub_epi16(one, constant);
+            case GL_CONSTANT_ALPHA:
+                return BroadcastAlpha(constant);
+            case GL_ONE_MINUS_CONSTANT_ALPHA:
+                return _mm_sub_epi16(one, BroadcastAlpha(constant));
+            case GL_SRC_ALPHA_SATURATE:
+                return alpha ? one : _mm_min_epi16(BroadcastAlpha(s), _mm_sub_epi16(one, BroadcastAlpha(d)));
+        }
+
+        return _mm_setzero_si128();
+    }
+
+    // unsaturated 16 bit results, packing to bytes clamps the sum
+    static __m128i BlendEquation(GLenum equation, __m128i s, __m128i d)
+    {
+        switch (equation)
+        {
+            case GL_FUNC_ADD:
+                return _mm_add_epi16(s, d);
+            case GL_FUNC_SUBTRACT:
+                return _mm_subs_epu16(s, d);
+            case GL_FUNC_REVERSE_SUBTRACT:
+                return _mm_subs_epu16(d, s);
+        }
+
+        return s;
+    }
+#endif
+
+    // blend modes as policies, READ_DEST is 0 when the destination is not needed.
+    // Blend1 takes one pixel's channels, Blend16 two pixels in 16 bit lanes
+    struct BlendReplace
+    {
+        enum { READ_DEST = 0 };
+
+        static void Blend1(const ColorParams&, const int* s, const int*, int* out)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = s[i];
+            }
+        }
+
+#if SGL_SSE2
+        static __m128i Blend16(const ColorParams&, __m128i s, __m128i)
+        {
+            return s;
+        }
+#endif
+    };
+
+    // GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    struct BlendAlpha
+    {
+        enum { READ_DEST = 1 };
+
+        static void Blend1(const ColorParams&, const int* s, const int* d, int* out)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = Mul255(s[i], s[3]) + Mul255(d[i], 255 - s[3]);
+            }
+        }
+
+#if SGL_SSE2
+        static __m128i Blend16(const ColorParams&, __m128i s, __m128i d)
+        {
+            __m128i a = BroadcastAlpha(s);
+            return _mm_add_epi16(Mul255(s, a), Mul255(d, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+        }
+#endif
+    };
+
+    // GL_ONE, GL_ONE_MINUS_SRC_ALPHA, premultiplied alpha
+    struct BlendPremultiplied
+    {
+        enum { READ_DEST = 1 };
+
+        static void Blend1(const ColorParams&, const int* s, const int* d, int* out)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = Mathf::Min(s[i] + Mul255(d[i], 255 - s[3]), 255);
+            }
+        }
+
+#if SGL_SSE2
+        static __m128i Blend16(const ColorParams&, __m128i s, __m128i d)
+        {
+            return _mm_add_epi16(s, Mul255(d, _mm_sub_epi16(_mm_set1_epi16(255), BroadcastAlpha(s))));
+        }
+#endif
+    };
+
+    // GL_ONE, GL_ONE
+    struct BlendAdditive
+    {
+        enum { READ_DEST = 1 };
+
+        static void Blend1(const ColorParams&, const int* s, const int* d, int* out)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = Mathf::Min(s[i] + d[i], 255);
+            }
+        }
+
+#if SGL_SSE2
+        static __m128i Blend16(const ColorParams&, __m128i s, __m128i d)
+        {
+            return _mm_add_epi16(s, d);
+        }
+#endif
+    };
+
+    // any other factors and equations, rgb and alpha each take their own
+    struct BlendGeneric
+    {
+        enum { READ_DEST = 1 };
+
+        static void Blend1(const ColorParams& params, const int* s, const int* d, int* out)
+        {
+            int constant[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                constant[i] = (params.constant >> (i * 8)) & 0xff;
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                GLenum src_factor = i < 3 ? params.src_factor_c : params.src_factor_a;
+                GLenum dest_factor = i < 3 ? params.dest_factor_c : params.dest_factor_a;
+                GLenum equation = i < 3 ? params.equation_c : params.equation_a;
+
+                int src = Mul255(s[i], BlendFactor(src_factor, s, d, constant, i));
+                int dest = Mul255(d[i], BlendFactor(dest_factor, s, d, constant, i));
+                out[i] = BlendEquation(equation, src, dest);
+            }
+        }
+
+#if SGL_SSE2
+        static __m128i Blend16(const ColorParams& params, __m128i s, __m128i d)
+        {
+            __m128i constant = _mm_unpacklo_epi8(_mm_set1_epi32((int) params.constant), _mm_setzero_si128());
+
+            __m128i src_factor = BlendFactor(params.src_factor_c, s, d, constant, false);
+            __m128i dest_factor = BlendFactor(params.dest_factor_c, s, d, constant, false);
+            if (params.src_factor_a != params.src_factor_c || params.src_factor_a == GL_SRC_ALPHA_SATURATE)
+            {
+                src_factor = Simd::Select(AlphaLanes(), BlendFactor(params.src_factor_a, s, d, constant, true), src_factor);
+            }
+            if (params.dest_factor_a != params.dest_factor_c || params.dest_factor_a == GL_SRC_ALPHA_SATURATE)
+            {
+                dest_factor = Simd::Select(AlphaLanes(), BlendFactor(params.dest_factor_a, s, d, constant, true), dest_factor);
+            }
+
+            __m128i src = Mul255(s, src_factor);
+            __m128i dest = Mul255(d, dest_factor);
+            __m128i out = BlendEquation(params.equation_c, src, dest);
+            if (params.equation_a != params.equation_c)
+            {
+                out = Simd::Select(AlphaLanes(), BlendEquation(params.equation_a, src, dest), out);
+            }
+
+            return out;
+        }
+#endif
+    };
+
+    template<class Blend>
+    static unsigned int BlendPixel(const ColorParams& params, unsigned int src, unsigned int dest)
+    {
+        int s[4];
+        int d[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            s[i] = (src >> (i * 8)) & 0xff;
+            d[i] = (dest >> (i * 8)) & 0xff;
+        }
+
+        int out[4];
+        Blend::Blend1(params, s, d, out);
+
+        return (unsigned int) (out[0] | (out[1] << 8) | (out[2] << 16) | (out[3] << 24));
+    }
+
+    template<class Blend, bool full_mask>
+    static void WriteColors(const ColorParams& params, unsigned char* colors, const int* indices, const unsigned int* src, int count)
+    {
+        unsigned int* pixels = (unsigned int*) colors;
+        int i = 0;
+
+#if SGL_SSE2
+        __m128i mask = _mm_set1_epi32((int) params.mask);
+        for (; i + 4 <= count; i += 4)
+        {
+            const int* index = &indices[i];
+            __m128i s = _mm_loadu_si128((const __m128i*) &src[i]);
+            __m128i d = _mm_setzero_si128();
+            if (Blend::READ_DEST || !full_mask)
+            {
+                d = _mm_set_epi32((int) pixels[index[3]], (int) pixels[index[2]], (int) pixels[index[1]], (int) pixels[index[0]]);
+            }
+
+            __m128i out = s;
+            if (Blend::READ_DEST)
+            {
+                __m128i zero = _mm_setzero_si128();
+                __m128i lo = Blend::Blend16(params, _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+                __m128i hi = Blend::Blend16(params, _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+                out = _mm_packus_epi16(lo, hi);
+            }
+            if (!full_mask)
+            {
+                out = Simd::Select(mask, out, d);
+            }
+
+            unsigned int o[4];
+            _mm_storeu_si128((__m128i*) o, out);
+            for (int j = 0; j < 4; ++j)
+            {
+                pixels[index[j]] = o[j];
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            unsigned int& d = pixels[indices[i]];
+            unsigned int out = Blend::READ_DEST ? BlendPixel<Blend>(params, src[i], d) : src[i];
+            if (!full_mask)
+            {
+                out = (out & params.mask) | (d & ~params.mask);
+            }
+            d = out;
+        }
+    }
+
+    template<class Blend>
+    static GLOutputMerger::ColorKernel ColorKernelOf(bool full_mask)
+    {
+        return full_mask ? WriteColors<Blend, true> : WriteColors<Blend, false>;
+    }
+
+    // both factors and both equations of the blend state match
+    static bool IsBlendFunc(const State& state, GLenum src_factor, GLenum dest_factor)
+    {
+        return state.blend_src_factor_c == src_factor && state.blend_src_factor_a == src_factor &&
+            state.blend_dest_factor_c == dest_factor && state.blend_dest_factor_a == dest_factor &&
+            state.blend_equation_c == GL_FUNC_ADD && state.blend_equation_a == GL_FUNC_ADD;
+    }
+
+    GLOutputMerger::GLOutputMerger():
+        m_depth_kernel(nullptr),
+        m_color_kernel(nullptr)
+    {
+        State state;
+        state.depth_func = GL_ALWAYS;
+        state.depth_write = false;
+        state.depth_range = Vector2(0, 1);
+        state.depth_format = GL_DEPTH_COMPONENT32_OES;
+        state.blend_enable = false;
+        state.blend_src_factor_c = GL_ONE;
+        state.blend_src_factor_a = GL_ONE;
+        state.blend_dest_factor_c = GL_ZERO;
+        state.blend_dest_factor_a = GL_ZERO;
+        state.blend_equation_c = GL_FUNC_ADD;
+        state.blend_equation_a = GL_FUNC_ADD;
+        state.blend_color = Vector4(0, 0, 0, 0);
+        for (int i = 0; i < 4; ++i)
+        {
+            state.color_mask[i] = true;
+        }
+
+        this->Select(state);
+    }
+
+    void GLOutputMerger::Select(const State& state)
+    {
+        m_state = state;
+
+        m_color_params.src_factor_c = state.blend_src_factor_c;
+        m_color_params.src_factor_a = state.blend_src_factor_a;
+        m_color_params.dest_factor_c = state.blend_dest_factor_c;
+        m_color_params.dest_factor_a = state.blend_dest_factor_a;
+        m_color_params.equation_c = state.blend_equation_c;
+        m_color_params.equation_a = state.blend_equation_a;
+        m_color_params.constant = 0;
+        m_color_params.mask = 0;
+        const float* constant = (const float*) &state.blend_color;
+        for (int i = 0; i < 4; ++i)
+        {
+            m_color_params.constant |= (unsigned int) (Mathf::Clamp01(constant[i]) * 255 + 0.5f) << (i * 8);
+            if (state.color_mask[i])
+            {
+                m_color_params.mask |= 0xff << (i * 8);
+            }
+        }
+
+        // an invalid function fails like GL_NEVER
+        int func = (int) state.depth_func - GL_NEVER;
+        if (func < 0 || func >= 8)
+        {
+            func = 0;
+        }
+        switch (state.depth_format)
+        {
+            case GL_DEPTH_COMPONENT16:
+                m_depth_kernel = DepthKernelOf<GLTileBuffer::DepthUnorm16>(func, state.depth_write);
+                break;
+            case GL_DEPTH24_STENCIL8_OES:
+                m_depth_kernel = DepthKernelOf<GLTileBuffer::DepthUnorm24>(func, state.depth_write);
+                break;
+            default:
+                m_depth_kernel = DepthKernelOf<GLTileBuffer::DepthFloat32>(func, state.depth_write);
+                break;
+        }
+
+        bool full_mask = state.color_mask[0] && state.color_mask[1] && state.color_mask[2] && state.color_mask[3];
+
+        if (!state.blend_enable || IsBlendFunc(state, GL_ONE, GL_ZERO))
+        {
+            m_color_kernel = ColorKernelOf<BlendReplace>(full_mask);
+        }
+        else if (IsBlendFunc(state, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA))
+        {
+            m_color_kernel = ColorKernelOf<BlendAlpha>(full_mask);
+        }
+        else if (IsBlendFunc(state, GL_ONE, GL_ONE_MINUS_SRC_ALPHA))
+        {
+            m_color_kernel = ColorKernelOf<BlendPremultiplied>(full_mask);
+        }
+        else if (IsBlendFunc(state, GL_ONE, GL_ONE))
+        {
+            m_color_kernel = ColorKernelOf<BlendAdditive>(full_mask);
+        }
+        else
+        {
+            m_color_kernel = ColorKernelOf<BlendGeneric>(full_mask);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "GLTileBuffer.h"
+#include "GLSimd.h"
+#include "GLES2/gl2.h"
+#include "math/Mathf.h"
+#include "math/Vector2.h"
+#include "math/Vector4.h"
+
+namespace sgl
+{
+    // depth test and color write of the fragments that passed the earlier tests. the kernels are
+    // generated from templates over the depth format and function, blend mode and write masks, and
+    // the pair matching the draw state is picked once per draw. colors are blended as rgba8 integers
+    // a span of fragments at a time
+    class GLOutputMerger
+    {
+    public:
+        struct State
+        {
+            // GL_ALWAYS without depth write when the depth test is off
+            GLenum depth_func;
+            bool depth_write;
+            Viry3D::Vector2 depth_range;
+            // format of the tiles' depth values, as in GLTileBuffer::Bind
+            GLenum depth_format;
+            bool blend_enable;
+            GLenum blend_src_factor_c;
+            GLenum blend_src_factor_a;
+            GLenum blend_dest_factor_c;
+            GLenum blend_dest_factor_a;
+            GLenum blend_equation_c;
+            GLenum blend_equation_a;
+            Viry3D::Vector4 blend_color;
+            bool color_mask[4];
+        };
+
+        // blend state in the pixel format, the constant and mask are packed rgba8
+        struct ColorParams
+        {
+            GLenum src_factor_c;
+            GLenum src_factor_a;
+            GLenum dest_factor_c;
+            GLenum dest_factor_a;
+            GLenum equation_c;
+            GLenum equation_a;
+            unsigned int constant;
+            unsigned int mask;
+        };
+
+        typedef bool (*DepthKernel)(const State& state, GLTileBuffer::Tile* tile, int index, float depth);
+        typedef void (*ColorKernel)(const ColorParams& params, unsigned char* colors, const int* indices, const unsigned int* src, int count);
+
+        GLOutputMerger();
+        // copies the state and picks its kernels
+        void Select(const State& state);
+        // depth test and write of one fragment with its ndc depth, false if it fails
+        bool Depth(GLTileBuffer::Tile* tile, int index, float depth) const { return m_depth_kernel(m_state, tile, index, depth); }
+        // blends the packed src colors into the rgba8 pixels at the indices under the color mask,
+        // an index appears at most once in a span
+        void Colors(unsigned char* colors, const int* indices, const unsigned int* src, int count) const { m_color_kernel(m_color_params, colors, indices, src, count); }
+        // fs output to packed rgba8, clamped and truncated
+        static unsigned int PackColor(const Viry3D::Vector4& c)
+        {
+#if SGL_SSE2
+            __m128 zero = _mm_setzero_ps();
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps((const float*) &c), zero), _mm_set1_ps(1.0f));
+            __m128i bytes = _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+            bytes = _mm_packs_epi32(bytes, bytes);
+            return (unsigned int) _mm_cvtsi128_si32(_mm_packus_epi16(bytes, bytes));
+#else
+            const float* f = (const float*) &c;
+            unsigned int value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                value |= (unsigned int) (unsigned char) (Viry3D::Mathf::Clamp01(f[i]) * 255) << (i * 8);
+            }
+            return value;
+#endif
+        }
+
+    private:
+        State m_state;
+        ColorParams m_color_params;
+        DepthKernel m_depth_kernel;
+        ColorKernel m_color_kernel;
+    };
+}
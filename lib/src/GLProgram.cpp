@@ -29,13 +29,43 @@
 #include "math/Matrix4x4.h"
 #include "memory/Memory.h"
 #include "Debug.h"
+#include <atomic>
+
+#if VR_WINDOWS
 #include <Windows.h>
 
-using namespace Viry3D;
+#define DLL_EXT ".dll"
 
 extern const char* g_vs_path;
 extern const char* vc_version;
 extern const char* win_sdk_lib;
+#else
+#include <dlfcn.h>
+
+#define DLL_EXT ".so"
+
+extern const char* g_cxx;
+
+typedef void* HMODULE;
+
+// dlopen searches the library path for a name without a slash, the program's library is in the working directory
+static HMODULE LoadLibrary(const char* name)
+{
+    return dlopen((Viry3D::String("./") + name).CString(), RTLD_NOW | RTLD_LOCAL);
+}
+
+static void* GetProcAddress(HMODULE module, const char* name)
+{
+    return dlsym(module, name);
+}
+
+static void FreeLibrary(HMODULE module)
+{
+    dlclose(module);
+}
+#endif
+
+using namespace Viry3D;
 
 namespace sgl
 {
@@ -56,12 +86,30 @@ namespace sgl
             }
         };
 
+        enum
+        {
+            SPAN_SIZE = GLTexture2D::BATCH_SIZE,
+        };
+
+        // a texture unit as seen by the shader, passed back to SampleTexture on every texture2D call
+        struct SamplerBinding
+        {
+            GLProgramPrivate* program;
+            GLTexture2D* texture;
+            // the fs varying the shader first passed to texture2D on this sampler, -1 until then
+            int varying;
+            // colors of that varying sampled ahead for the fragments of the span, span_count 0 outside one
+            int span_count;
+            float span_color[4][SPAN_SIZE];
+        };
+
         struct Uniform
         {
             String name;
             String type;
             int location;
             GLProgram::VarSetter setter;
+            Ref<SamplerBinding> sampler;
 
             Uniform(const String& name):
                 name(name),
@@ -73,16 +121,34 @@ namespace sgl
 
         struct Sampler2D
         {
-            typedef Vector4(*Sample)(GLTexture2D*, const Vector2*);
-            GLTexture2D* texture;
+            typedef Vector4(*Sample)(SamplerBinding*, const Vector2*);
+            SamplerBinding* binding;
             Sample sample_func = Sampler2D::SampleTexture;
 
-            static Vector4 SampleTexture(GLTexture2D* tex, const Vector2* uv)
+            static Vector4 SampleTexture(SamplerBinding* binding, const Vector2* uv)
             {
-                return tex->Sample(*uv);
+                return binding->program->SampleTexture(binding, uv);
             }
         };
 
+        // screen space derivatives of a fs vec2 varying, keyed by its address in the shader
+        struct Derivative
+        {
+            const void* address;
+            Vector2 ddx;
+            Vector2 ddy;
+        };
+
+        // a fs vec2 varying at each fragment of the span, count fragments are set
+        struct SpanVarying
+        {
+            int count;
+            float u[SPAN_SIZE];
+            float v[SPAN_SIZE];
+            Vector2 ddx[SPAN_SIZE];
+            Vector2 ddy[SPAN_SIZE];
+        };
+
         GLProgramPrivate(GLProgram* p):
             m_p(p),
             m_dll(nullptr),
@@ -90,8 +156,15 @@ namespace sgl
             m_get_gl_Position(nullptr),
             m_set_gl_FragCoord(nullptr),
             m_fs_main(nullptr),
-            m_get_gl_FragColor(nullptr)
+            m_get_gl_FragColor(nullptr),
+            m_set_gl_Discard(nullptr),
+            m_get_gl_Discard(nullptr),
+            m_has_discard(false),
+            m_span_lane(-1)
         {
+            // program names repeat across share groups, temp files are named by a process wide serial
+            static std::atomic<int> s_serial(0);
+            m_serial = ++s_serial;
         }
 
         ~GLProgramPrivate()
@@ -103,14 +176,16 @@ namespace sgl
             }
 
             String dll_name = this->GetTempDllName();
-            File::Delete(dll_name + ".dll");
+            File::Delete(dll_name + DLL_EXT);
+#if VR_WINDOWS
             File::Delete(dll_name + ".exp");
             File::Delete(dll_name + ".lib");
+#endif
         }
 
         String GetTempDllName()
         {
-            return String::Format("temp.p.%d", m_p->GetId());
+            return String::Format("temp.p.%d", m_serial);
         }
 
         void BindAttribLocations()
@@ -200,6 +275,63 @@ namespace sgl
             }
         }
 
+        // uv is only known to be a varying when the shader passes it to texture2D directly,
+        // anything else samples without derivatives
+        int FindDerivative(const Vector2* uv) const
+        {
+            for (int i = 0; i < m_fs_derivatives.Size(); ++i)
+            {
+                if (m_fs_derivatives[i].address == uv)
+                {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        Vector4 SampleTexture(SamplerBinding* binding, const Vector2* uv)
+        {
+            int varying = this->FindDerivative(uv);
+            if (varying < 0)
+            {
+                return binding->texture->Sample(*uv, Vector2(), Vector2());
+            }
+
+            // a color sampled ahead stands in only for the same uv
+            int lane = m_span_lane;
+            if (lane >= 0 && lane < binding->span_count && binding->varying == varying)
+            {
+                const SpanVarying& span = m_fs_spans[varying];
+                if (span.u[lane] == uv->x && span.v[lane] == uv->y)
+                {
+                    return Vector4(binding->span_color[0][lane], binding->span_color[1][lane], binding->span_color[2][lane], binding->span_color[3][lane]);
+                }
+            }
+
+            if (binding->varying < 0)
+            {
+                binding->varying = varying;
+            }
+
+            const Derivative& d = m_fs_derivatives[varying];
+            return binding->texture->Sample(*uv, d.ddx, d.ddy);
+        }
+
+        void PrefetchSpanSamples(SamplerBinding* binding, int count)
+        {
+            binding->span_count = 0;
+            if (binding->varying < 0 || binding->texture == nullptr || m_fs_spans[binding->varying].count < count)
+            {
+                return;
+            }
+
+            // each fragment keeps its lod, the colors are those of single samples
+            const SpanVarying& span = m_fs_spans[binding->varying];
+            binding->texture->SampleBatch(count, span.u, span.v, span.ddx, span.ddy,
+                binding->span_color[0], binding->span_color[1], binding->span_color[2], binding->span_color[3]);
+            binding->span_count = count;
+        }
+
         GLProgram* m_p;
         Ref<GLShader> m_shaders[2];
         Map<String, GLuint> m_bind_attribs;
@@ -207,12 +339,21 @@ namespace sgl
         Vector<Uniform> m_uniforms;
         Vector<GLProgram::Varying> m_vs_varyings;
         Vector<GLProgram::Varying> m_fs_varyings;
+        Vector<Derivative> m_fs_derivatives;
+        Vector<SpanVarying> m_fs_spans;
         HMODULE m_dll;
         GLProgram::Main m_vs_main;
         GLProgram::VarGetter m_get_gl_Position;
         GLProgram::VarSetter m_set_gl_FragCoord;
         GLProgram::Main m_fs_main;
         GLProgram::VarGetter m_get_gl_FragColor;
+        GLProgram::VarSetter m_set_gl_Discard;
+        GLProgram::VarGetter m_get_gl_Discard;
+        bool m_has_discard;
+        // fragment of the span the fs runs for, -1 outside a span
+        int m_span_lane;
+        int m_serial;
+        std::mutex m_draw_mutex;
     };
 
     GLProgram::GLProgram(GLuint id):
@@ -302,22 +443,9 @@ namespace sgl
             return;
         }
 
-        const bool isX64 = sizeof(void*) == 8;
-        const String host = "Hostx64"; // "Hostx86"
-        String cl_dir;
-
-        if (isX64)
-        {
-            cl_dir = String(g_vs_path) + "\\VC\\Tools\\MSVC\\" + vc_version + "\\bin\\" + host + "\\x64";
-        }
-        else
-        {
-            cl_dir = String(g_vs_path) + "\\VC\\Tools\\MSVC\\" + vc_version + "\\bin\\" + host + "\\x86";
-        }
-
-        String temp_vs_obj_name = "temp.vs.obj";
-        String temp_fs_obj_name = "temp.fs.obj";
         String dll_name = m_private->GetTempDllName();
+        String temp_vs_obj_name = dll_name + ".vs.obj";
+        String temp_fs_obj_name = dll_name + ".fs.obj";
         String temp_out_name = dll_name + ".out.txt";
 
         ByteBuffer vs_bin = m_private->m_shaders[0]->GetBinary();
@@ -331,11 +459,28 @@ namespace sgl
         File::WriteAllBytes(temp_vs_obj_name, vs_bin);
         File::WriteAllBytes(temp_fs_obj_name, fs_bin);
 
+#if VR_WINDOWS
+        const bool isX64 = sizeof(void*) == 8;
+        const String host = "Hostx64"; // "Hostx86"
+        String cl_dir;
+
+        if (isX64)
+        {
+            cl_dir = String(g_vs_path) + "\\VC\\Tools\\MSVC\\" + vc_version + "\\bin\\" + host + "\\x64";
+        }
+        else
+        {
+            cl_dir = String(g_vs_path) + "\\VC\\Tools\\MSVC\\" + vc_version + "\\bin\\" + host + "\\x86";
+        }
+
         exec_cmd(cl_dir, "link.exe", "/dll " + temp_vs_obj_name + " " + temp_fs_obj_name + " /OUT:" + dll_name + ".dll "
             "/LIBPATH:\"" + g_vs_path + "\\VC\\Tools\\MSVC\\" + vc_version + "\\lib\\x64\" "
             "/LIBPATH:\"" + win_sdk_lib + "\\um\\x64\" "
             "/LIBPATH:\"" + win_sdk_lib + "\\ucrt\\x64\"",
             temp_out_name);
+#else
+        exec_cmd("", g_cxx, "-shared -o " + dll_name + DLL_EXT " " + temp_vs_obj_name + " " + temp_fs_obj_name, temp_out_name);
+#endif
 
         String out_text = File::ReadAllText(temp_out_name);
 
@@ -345,8 +490,9 @@ namespace sgl
 
         m_private->BindAttribLocations();
         m_private->BindUniformLocations();
+        m_private->m_has_discard = m_private->m_shaders[1]->HasDiscard();
 
-        Log("Link info:\n%sgen dll:%s.dll", out_text.CString(), dll_name.CString());
+        Log("Link info:\n%sgen dll:%s" DLL_EXT, out_text.CString(), dll_name.CString());
     }
 
     GLint GLProgram::GetAttribLocation(const GLchar* name) const
@@ -378,9 +524,11 @@ namespace sgl
 
     void GLProgram::Use()
     {
+        std::lock_guard<std::mutex> lock(m_private->m_draw_mutex);
+
         if (m_private->m_dll == nullptr)
         {
-            HMODULE dll = LoadLibrary((m_private->GetTempDllName() + ".dll").CString());
+            HMODULE dll = LoadLibrary((m_private->GetTempDllName() + DLL_EXT).CString());
             m_private->m_dll = dll;
 
             assert(dll != nullptr);
@@ -403,6 +551,8 @@ namespace sgl
             m_private->m_set_gl_FragCoord = (VarSetter) GetProcAddress(dll, "set_gl_FragCoord");
             m_private->m_fs_main = (Main) GetProcAddress(dll, "fs_main");
             m_private->m_get_gl_FragColor = (VarGetter) GetProcAddress(dll, "get_gl_FragColor");
+            m_private->m_set_gl_Discard = (VarSetter) GetProcAddress(dll, "set_gl_Discard");
+            m_private->m_get_gl_Discard = (VarGetter) GetProcAddress(dll, "get_gl_Discard");
 
             m_private->m_vs_varyings.Clear();
             Vector<String> varying_names = m_private->m_shaders[0]->GetVaryingNames();
@@ -435,6 +585,8 @@ namespace sgl
             }
 
             m_private->m_fs_varyings.Clear();
+            m_private->m_fs_derivatives.Clear();
+            m_private->m_fs_spans.Clear();
             varying_names = m_private->m_shaders[1]->GetVaryingNames();
             varying_types = m_private->m_shaders[1]->GetVaryingTypes();
             for (int i = 0; i < varying_names.Size(); ++i)
@@ -461,7 +613,17 @@ namespace sgl
                 }
                 String func_name = "set_" + varying_names[i];
                 v.setter = (VarSetter) GetProcAddress(dll, func_name.CString());
+                func_name = "get_fs_" + varying_names[i];
+                v.getter = (VarGetter) GetProcAddress(dll, func_name.CString());
                 m_private->m_fs_varyings.Add(v);
+
+                GLProgramPrivate::Derivative d;
+                d.address = v.getter ? v.getter() : nullptr;
+                m_private->m_fs_derivatives.Add(d);
+
+                GLProgramPrivate::SpanVarying span;
+                span.count = 0;
+                m_private->m_fs_spans.Add(span);
             }
         }
     }
@@ -482,20 +644,40 @@ namespace sgl
         return false;
     }
 
-    void GLProgram::UniformSampler2D(GLint location, const Ref<GLTexture2D>& texture) const
+    void GLProgram::UniformSampler2D(GLint location, GLTexture2D* texture) const
     {
-        for (const auto& i : m_private->m_uniforms)
+        for (auto& i : m_private->m_uniforms)
         {
             if (i.location == location)
             {
+                if (!i.sampler)
+                {
+                    i.sampler = RefMake<GLProgramPrivate::SamplerBinding>();
+                    i.sampler->program = m_private;
+                    i.sampler->varying = -1;
+                    i.sampler->span_count = 0;
+                }
+                i.sampler->texture = texture;
+
                 GLProgramPrivate::Sampler2D sampler;
-                sampler.texture = texture.get();
+                sampler.binding = i.sampler.get();
                 i.setter((void*) &sampler, sizeof(GLProgramPrivate::Sampler2D));
                 break;
             }
         }
     }
 
+    void GLProgram::ResolveSamplerTextures() const
+    {
+        for (const auto& i : m_private->m_uniforms)
+        {
+            if (i.sampler && i.sampler->texture)
+            {
+                i.sampler->texture->ResolveRenderBuffer();
+            }
+        }
+    }
+
     void GLProgram::Uniformv(GLint location, int size, const void* value) const
     {
         for (const auto& i : m_private->m_uniforms)
@@ -579,10 +761,107 @@ namespace sgl
         }
     }
 
+    void GLProgram::SetFSVaryingDerivatives(const String& name, const Vector2& ddx, const Vector2& ddy) const
+    {
+        for (int i = 0; i < m_private->m_fs_varyings.Size(); ++i)
+        {
+            if (m_private->m_fs_varyings[i].name == name)
+            {
+                m_private->m_fs_derivatives[i].ddx = ddx;
+                m_private->m_fs_derivatives[i].ddy = ddy;
+                break;
+            }
+        }
+    }
+
+    void GLProgram::SetFSSpanVarying(int lane, const String& name, const Vector2& uv, const Vector2& ddx, const Vector2& ddy) const
+    {
+        for (int i = 0; i < m_private->m_fs_varyings.Size(); ++i)
+        {
+            if (m_private->m_fs_varyings[i].name == name)
+            {
+                GLProgramPrivate::SpanVarying& span = m_private->m_fs_spans[i];
+                span.u[lane] = uv.x;
+                span.v[lane] = uv.y;
+                span.ddx[lane] = ddx;
+                span.ddy[lane] = ddy;
+                span.count = lane + 1;
+                break;
+            }
+        }
+    }
+
+    void GLProgram::PrefetchSpanSamples(int count) const
+    {
+        for (const auto& i : m_private->m_uniforms)
+        {
+            if (i.sampler)
+            {
+                m_private->PrefetchSpanSamples(i.sampler.get(), count);
+            }
+        }
+    }
+
+    void GLProgram::SetSpanLane(int lane) const
+    {
+        m_private->m_span_lane = lane;
+
+        if (lane < 0)
+        {
+            for (auto& i : m_private->m_fs_spans)
+            {
+                i.count = 0;
+            }
+            for (const auto& i : m_private->m_uniforms)
+            {
+                if (i.sampler)
+                {
+                    i.sampler->span_count = 0;
+                }
+            }
+            return;
+        }
+
+        for (int i = 0; i < m_private->m_fs_spans.Size(); ++i)
+        {
+            const GLProgramPrivate::SpanVarying& span = m_private->m_fs_spans[i];
+            if (lane < span.count)
+            {
+                Vector2 uv(span.u[lane], span.v[lane]);
+                m_private->m_fs_varyings[i].setter((void*) &uv, sizeof(Vector2));
+                m_private->m_fs_derivatives[i].ddx = span.ddx[lane];
+                m_private->m_fs_derivatives[i].ddy = span.ddy[lane];
+            }
+        }
+    }
+
     void* GLProgram::CallFSMain(const Vector4& frag_coord) const
     {
         m_private->m_set_gl_FragCoord((void*) &frag_coord, sizeof(Vector4));
+
+        if (m_private->m_set_gl_Discard)
+        {
+            bool discard = false;
+            m_private->m_set_gl_Discard(&discard, sizeof(bool));
+        }
+
         m_private->m_fs_main();
+
+        if (m_private->m_get_gl_Discard && *(bool*) m_private->m_get_gl_Discard())
+        {
+            return nullptr;
+        }
+
         return m_private->m_get_gl_FragColor();
     }
+
+    bool GLProgram::HasDiscard() const
+    {
+        return m_private->m_has_discard;
+    }
+
+    std::mutex& GLProgram::GetDrawMutex() const
+    {
+        return m_private->m_draw_mutex;
+    }
 }
@@ -21,7 +21,9 @@
 #include "memory/Ref.h"
 #include "container/Vector.h"
 #include "string/String.h"
+#include "math/Vector2.h"
 #include "math/Vector4.h"
+#include <mutex>
 
 namespace sgl
 {
@@ -76,14 +78,29 @@ namespace sgl
         GLint GetUniformLocation(const GLchar* name) const;
         void Use();
         bool IsUniformSampler2D(GLint location) const;
-        void UniformSampler2D(GLint location, const Ref<GLTexture2D>& texture) const;
+        void UniformSampler2D(GLint location, GLTexture2D* texture) const;
+        // takes back the rendered pixels of the sampled textures, once per draw before the fs runs
+        void ResolveSamplerTextures() const;
         void Uniformv(GLint location, int size, const void* value) const;
         void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) const;
         void SetVertexAttrib(GLuint index, const void* data, int size) const;
         void* CallVSMain() const;
         Viry3D::Vector<Varying> GetVSVaryings() const;
         void SetFSVarying(const Viry3D::String& name, const void* data, int size) const;
+        void SetFSVaryingDerivatives(const Viry3D::String& name, const Viry3D::Vector2& ddx, const Viry3D::Vector2& ddy) const;
+        // a span is up to GLTexture2D::BATCH_SIZE fragments shaded in a row. the rasterizer sets each
+        // fragment's vec2 varyings, PrefetchSpanSamples batches the texture2D calls the shader made on
+        // them before, then SetSpanLane picks the fragment for CallFSMain and sets its vec2 varyings.
+        // SetSpanLane(-1) ends the span
+        void SetFSSpanVarying(int lane, const Viry3D::String& name, const Viry3D::Vector2& uv, const Viry3D::Vector2& ddx, const Viry3D::Vector2& ddy) const;
+        void PrefetchSpanSamples(int count) const;
+        void SetSpanLane(int lane) const;
+        // null if the fragment was discarded
         void* CallFSMain(const Viry3D::Vector4& frag_coord) const;
+        // without discard the fragment's fate is known before the fs runs, so depth can be tested early
+        bool HasDiscard() const;
+        // the shader globals are the program's, contexts sharing the program draw with it one at a time
+        std::mutex& GetDrawMutex() const;
 
     private:
         friend class GLProgramPrivate;
@@ -23,441 +23,210 @@ using namespace Viry3D;
 
 namespace sgl
 {
-    static Vector<Vector2i> TriangleEdge(const Vector2i& p0, const Vector2i& p1)
+    // rotated grid of 4 samples, in subpixels from the pixel origin
+    static const int SAMPLE_POSITIONS[GLRasterizer::MULTISAMPLES][2] = {
+        { 6, 2 },
+        { 14, 6 },
+        { 2, 10 },
+        { 10, 14 },
+    };
+
+    // perspective correct interpolation weights of the three vertices at p, p may lie outside the triangle
+    static void InterpolationWeights(const Vector2i& p, const Vector2i& p0, const Vector2i& p1, const Vector2i& p2, float one_div_signed_area, const float* one_div_ws, float* weights)
     {
-        Vector<Vector2i> line;
+        float a01 = GLRasterizer::Cross(p1 - p, p0 - p) * one_div_signed_area;
+        float a12 = GLRasterizer::Cross(p2 - p, p1 - p) * one_div_signed_area;
+        float a20 = 1.0f - a01 - a12;
 
-        if (p0.x == p1.x)
-        {
-            int y = p0.y;
-            int step = p1.y > p0.y ? 1 : -1;
-            while (y != p1.y)
-            {
-                line.Add({ p0.x, y });
-                y += step;
-            }
-            line.Add({ p1.x, p1.y });
-        }
-        else
-        {
-            float k = fabs((p1.y - p0.y) / (float) (p1.x - p0.x));
+        float w = 1.0f / (a01 * one_div_ws[2] + a12 * one_div_ws[0] + a20 * one_div_ws[1]);
 
-            if (k < 1) // x step 1
-            {
-                int x = p0.x;
-                int y = p0.y;
-                int x_step = p1.x > p0.x ? 1 : -1;
-                int y_step = p1.y > p0.y ? 1 : -1;
-                float d_step = k;
-                float d = 0;
-                while (x != p1.x)
-                {
-                    if (d >= 0.5f)
-                    {
-                        line.Add({ x, y + y_step });
-                    }
-                    else
-                    {
-                        line.Add({ x, y });
-                    }
-
-                    x += x_step;
-                    d += d_step;
-                    if (d >= 1.0f)
-                    {
-                        d -= 1.0f;
-                        y += y_step;
-                    }
-                }
-                line.Add({ p1.x, p1.y });
-            }
-            else // y step 1
-            {
-                int x = p0.x;
-                int y = p0.y;
-                int x_step = p1.x > p0.x ? 1 : -1;
-                int y_step = p1.y > p0.y ? 1 : -1;
-                float d_step = 1.0f / k;
-                float d = 0;
-                while (y != p1.y)
-                {
-                    if (d >= 0.5f)
-                    {
-                        line.Add({ x + x_step, y });
-                    }
-                    else
-                    {
-                        line.Add({ x, y });
-                    }
-
-                    y += y_step;
-                    d += d_step;
-                    if (d >= 1.0f)
-                    {
-                        d -= 1.0f;
-                        x += x_step;
-                    }
-                }
-                line.Add({ p1.x, p1.y });
-            }
-        }
-
-        return line;
-    }
-
-    static bool IsTopLeftEdge(const Vector2i& p0, const Vector2i& p1)
-    {
-        return ((p1.y > p0.y) || (p0.y == p1.y && p0.x > p1.x));
-    }
-
-    static int EdgeEquation(const Vector2i& p, const Vector2i& p0, const Vector2i& p1, bool ccw)
-    {
-        int q = (p1.x - p0.x) * (p.y - p0.y) - (p1.y - p0.y) * (p.x - p0.x);
-        if (ccw == false)
-        {
-            q = -q;
-        }
-        return q + (IsTopLeftEdge(p0, p1) ? 0 : -1);
+        weights[0] = a12 * one_div_ws[0] * w;
+        weights[1] = a20 * one_div_ws[1] * w;
+        weights[2] = a01 * one_div_ws[2] * w;
     }
 
-    float GLRasterizer::ProjToScreenX(float x)
+    float GLRasterizer::ProjToScreenX(float x) const
     {
         return m_viewport_x + (x * 0.5f + 0.5f) * m_viewport_width;
     }
 
-    float GLRasterizer::ProjToScreenY(float y)
+    float GLRasterizer::ProjToScreenY(float y) const
     {
         return m_viewport_y + (y * 0.5f + 0.5f) * m_viewport_height;
     }
 
-    void GLRasterizer::DrawScanLine2(int y0, int min_x0, int max_x0, int min_x1, int max_x1, bool draw_y1, const Vector2i& p0, const Vector2i& p1, const Vector2i& p2)
+    GLRasterizer::GLRasterizer(
+        const Vector4* positions,
+        const Vector<GLProgram::Varying>* const* varyings,
+        GLProgram* program,
+        int viewport_x,
+        int viewport_y,
+        int viewport_width,
+        int viewport_height,
+        bool ccw,
+        int samples):
+        m_positions(positions),
+        m_varyings(varyings),
+        m_program(program),
+        m_viewport_x(viewport_x),
+        m_viewport_y(viewport_y),
+        m_viewport_width(viewport_width),
+        m_viewport_height(viewport_height),
+        m_ccw(ccw),
+        m_subpixel_shift(samples > 1 ? SUBPIXEL_SHIFT : 0)
     {
-        // ֵ
-        float one_div_area = 1.0f / fabs(Vector2i::Cross(p0 - p1, p2 - p1) / 2.0f);
-        // ͸У
-        float one_div_ws[3] = {
-            1.0f / m_positions[0].w,
-            1.0f / m_positions[1].w,
-            1.0f / m_positions[2].w,
-        };
-        float depths[3] = {
-            m_positions[0].z * one_div_ws[0],
-            m_positions[1].z * one_div_ws[1],
-            m_positions[2].z * one_div_ws[2],
-        };
-
-        int y = y0;
-        int min_x = Mathf::Min(min_x0, min_x1);
-        int max_x = Mathf::Max(max_x0, max_x1) + 1;
-        int mins[2] = { min_x0, min_x1 };
-        int maxs[2] = { max_x0, max_x1 };
-
-        for (int x = min_x; x <= max_x; x += 2)
+        for (int i = 0; i < 3; ++i)
         {
-            struct Varying
-            {
-                Vector4 value;
-                String name;
-                int size;
-            };
+            // the clamp also keeps the conversions to int defined
+            float x = Mathf::Clamp(this->ProjToScreenX(m_positions[i].x / m_positions[i].w), (float) -GUARD_BAND, (float) GUARD_BAND);
+            float y = Mathf::Clamp(this->ProjToScreenY(m_positions[i].y / m_positions[i].w), (float) -GUARD_BAND, (float) GUARD_BAND);
 
-            struct Fragment
+            if (m_subpixel_shift > 0)
             {
-                Vector2i p;
-                bool draw;
-                Vector4 frag_coord;
-                float depth;
-                Vector<Varying> varyings;
-            };
-            Fragment fragment[2][2];
-
-            // 2 x 2 block
-            for (int iy = 0; iy < 2; ++iy)
-            {
-                for (int ix = 0; ix < 2; ++ix)
-                {
-                    Fragment& f = fragment[iy][ix];
-
-                    Vector2i p(x + ix, y - iy);
-                    int w1 = EdgeEquation(p, p0, p1, m_ccw);
-                    int w2 = EdgeEquation(p, p1, p2, m_ccw);
-                    int w3 = EdgeEquation(p, p2, p0, m_ccw);
-
-                    float a01 = fabs(Vector2i::Cross(p1 - p, p0 - p) / 2.0f) * one_div_area;
-                    float a12 = fabs(Vector2i::Cross(p2 - p, p1 - p) / 2.0f) * one_div_area;
-                    float a20 = 1.0f - a01 - a12;
-
-                    float w = 1.0f / (a01 * one_div_ws[2] + a12 * one_div_ws[0] + a20 * one_div_ws[1]);
-
-                    int varying_count = m_varyings[0].Size();
-                    for (int i = 0; i < varying_count; ++i)
-                    {
-                        Vector4 varying = (m_varyings[2][i].value * a01 * one_div_ws[2] + m_varyings[0][i].value * a12 * one_div_ws[0] + m_varyings[1][i].value * a20 * one_div_ws[1]) * w;
-                        
-                        Varying v;
-                        v.value = varying;
-                        v.name = m_varyings[0][i].name;
-                        v.size = m_varyings[0][i].size;
-
-                        f.varyings.Add(v);
-                    }
-
-                    float depth = depths[2] * a01 + depths[0] * a12 + depths[1] * a20;
-                    Vector4 frag_coord((float) p.x, (float) p.y, depth, 1.0f / w);
-
-                    f.p = p;
-                    f.draw = w1 >= 0 && w2 >= 0 && w3 >= 0;
-                    f.frag_coord = frag_coord;
-                    f.depth = depth;
-                }
-            }
-
-            int lines = 0;
-            if (draw_y1)
-            {
-                lines = 2;
+                m_points[i].x = (int) floorf(x * SUBPIXEL_SIZE + 0.5f);
+                m_points[i].y = (int) floorf(y * SUBPIXEL_SIZE + 0.5f);
             }
             else
             {
-                lines = 1;
-            }
-
-            for (int iy = 0; iy < lines; ++iy)
-            {
-                for (int ix = 0; ix < 2; ++ix)
-                {
-                    const Fragment& f = fragment[iy][ix];
-
-                    if (f.draw &&
-                        f.p.x >= mins[iy] && f.p.x <= maxs[iy] &&
-                        f.p.x >= m_viewport_x && f.p.x < m_viewport_x + m_viewport_width)
-                    {
-                        for (int i = 0; i < f.varyings.Size(); ++i)
-                        {
-                            const Varying& v = f.varyings[i];
-                            m_program->SetFSVarying(v.name, &v.value, v.size);
-                        }
-
-                        Vector4 color = *(Vector4*) m_program->CallFSMain(f.frag_coord);
-
-                        m_set_fragment(f.p, color, f.depth);
-                    }
-                }
+                m_points[i].x = (int) x;
+                m_points[i].y = (int) y;
             }
         }
     }
 
-    void GLRasterizer::DrawScanLine(int y, int min_x, int max_x, const Vector2i& p0, const Vector2i& p1, const Vector2i& p2)
+    bool GLRasterizer::GetBounds(int& min_x, int& min_y, int& max_x, int& max_y) const
     {
-        // ֵ
-        float one_div_area = 1.0f / fabs(Vector2i::Cross(p0 - p1, p2 - p1) / 2.0f);
-        // ͸У
-        float one_div_ws[3] = {
-            1.0f / m_positions[0].w,
-            1.0f / m_positions[1].w,
-            1.0f / m_positions[2].w,
-        };
-        float depths[3] = {
-            m_positions[0].z * one_div_ws[0],
-            m_positions[1].z * one_div_ws[1],
-            m_positions[2].z * one_div_ws[2],
-        };
-
-        for (int x = min_x; x <= max_x; ++x)
-        {
-            if (x >= m_viewport_x && x < m_viewport_x + m_viewport_width)
-            {
-                Vector2i p(x, y);
-                int w1 = EdgeEquation(p, p0, p1, m_ccw);
-                int w2 = EdgeEquation(p, p1, p2, m_ccw);
-                int w3 = EdgeEquation(p, p2, p0, m_ccw);
-
-                if (w1 >= 0 && w2 >= 0 && w3 >= 0)
-                {
-                    float a01 = fabs(Vector2i::Cross(p1 - p, p0 - p) / 2.0f) * one_div_area;
-                    float a12 = fabs(Vector2i::Cross(p2 - p, p1 - p) / 2.0f) * one_div_area;
-                    float a20 = 1.0f - a01 - a12;
+        const Vector2i& p0 = m_points[0];
+        const Vector2i& p1 = m_points[1];
+        const Vector2i& p2 = m_points[2];
 
-                    float w = 1.0f / (a01 * one_div_ws[2] + a12 * one_div_ws[0] + a20 * one_div_ws[1]);
-
-                    int varying_count = m_varyings[0].Size();
-                    for (int i = 0; i < varying_count; ++i)
-                    {
-                        Vector4 varying = (m_varyings[2][i].value * a01 * one_div_ws[2] + m_varyings[0][i].value * a12 * one_div_ws[0] + m_varyings[1][i].value * a20 * one_div_ws[1]) * w;
-                        m_program->SetFSVarying(m_varyings[0][i].name, &varying, m_varyings[0][i].size);
-                    }
+        if (Cross(p0 - p1, p2 - p1) == 0)
+        {
+            return false;
+        }
 
-                    float depth = depths[2] * a01 + depths[0] * a12 + depths[1] * a20;
-                    Vector4 frag_coord((float) p.x, (float) p.y, depth, 1.0f / w);
+        int shift = m_subpixel_shift;
+        min_x = Mathf::Max(Mathf::Min(Mathf::Min(p0.x, p1.x), p2.x) >> shift, m_viewport_x);
+        min_y = Mathf::Max(Mathf::Min(Mathf::Min(p0.y, p1.y), p2.y) >> shift, m_viewport_y);
+        max_x = Mathf::Min(Mathf::Max(Mathf::Max(p0.x, p1.x), p2.x) >> shift, m_viewport_x + m_viewport_width - 1);
+        max_y = Mathf::Min(Mathf::Max(Mathf::Max(p0.y, p1.y), p2.y) >> shift, m_viewport_y + m_viewport_height - 1);
 
-                    Vector4 color = *(Vector4*) m_program->CallFSMain(frag_coord);
-                    
-                    m_set_fragment(p, color, depth);
-                }
-            }
-        }
+        return min_x <= max_x && min_y <= max_y;
     }
 
-    void GLRasterizer::DrawHalfTriangle(
-        const Vector<Vector2i>& e1, const Vector<Vector2i>& e2,
-        int y_top, int y_bottom, bool include_bottom,
-        const Vector2i& p0, const Vector2i& p1, const Vector2i& p2)
+    void GLRasterizer::Setup()
     {
-        int i1 = 0;
-        int i2 = 0;
-        int y = y_top;
+        const Vector2i& p0 = m_points[0];
+        const Vector2i& p1 = m_points[1];
+        const Vector2i& p2 = m_points[2];
 
-        int y0 = -1;
-        int min_x0 = -1;
-        int max_x0 = -1;
-        int lines = 0;
+        // ֵ
+        m_one_div_area = 1.0f / fabs(Cross(p0 - p1, p2 - p1) / 2.0f);
+        // ͸У
+        for (int i = 0; i < 3; ++i)
+        {
+            m_one_div_ws[i] = 1.0f / m_positions[i].w;
+            m_depths[i] = m_positions[i].z * m_one_div_ws[i];
+        }
 
-        while (y >= y_bottom)
+        // vec2 varyings may be texture coordinates, they get screen space derivatives for lod selection
+        m_one_div_signed_area = 1.0f / Cross(p0 - p1, p2 - p1);
+        m_need_derivatives = false;
+        int varying_count = m_varyings[0]->Size();
+        for (int i = 0; i < varying_count; ++i)
         {
-            if (y == y_bottom && include_bottom == false)
+            if ((*m_varyings[0])[i].type == GLProgram::VaryingType::Vec2)
             {
+                m_need_derivatives = true;
                 break;
             }
+        }
 
-            int min_x = 0x7fffffff;
-            int max_x = -1;
+        if (m_subpixel_shift > 0)
+        {
+            // edge functions and depth are linear in screen space, a sample differs from the pixel by a constant
+            const Vector2i* edges[3][2] = { { &p0, &p1 }, { &p1, &p2 }, { &p2, &p0 } };
+            float depth_dx = (m_depths[2] * (p1.y - p0.y) + m_depths[0] * (p2.y - p1.y) + m_depths[1] * (p0.y - p2.y)) * m_one_div_signed_area;
+            float depth_dy = (m_depths[2] * (p0.x - p1.x) + m_depths[0] * (p1.x - p2.x) + m_depths[1] * (p2.x - p0.x)) * m_one_div_signed_area;
 
-            for (int i = i1; i < e1.Size(); ++i)
+            for (int i = 0; i < MULTISAMPLES; ++i)
             {
-                if (e1[i].y != y)
-                {
-                    i1 = i;
-                    break;
-                }
-                else
-                {
-                    min_x = Mathf::Min(min_x, e1[i].x);
-                    max_x = Mathf::Max(max_x, e1[i].x);
-                }
-            }
+                int x = SAMPLE_POSITIONS[i][0];
+                int y = SAMPLE_POSITIONS[i][1];
 
-            for (int i = i2; i < e2.Size(); ++i)
-            {
-                if (e2[i].y != y)
-                {
-                    i2 = i;
-                    break;
-                }
-                else
+                for (int j = 0; j < 3; ++j)
                 {
-                    min_x = Mathf::Min(min_x, e2[i].x);
-                    max_x = Mathf::Max(max_x, e2[i].x);
+                    const Vector2i& a = *edges[j][0];
+                    const Vector2i& b = *edges[j][1];
+                    long long offset = (long long) (b.x - a.x) * y - (long long) (b.y - a.y) * x;
+                    m_sample_edges[j][i] = m_ccw ? offset : -offset;
                 }
+
+                m_sample_depths[i] = depth_dx * (x - SUBPIXEL_SIZE / 2) + depth_dy * (y - SUBPIXEL_SIZE / 2);
             }
+        }
+    }
 
-            if (y >= m_viewport_y && y < m_viewport_y + m_viewport_height)
+    void GLRasterizer::SetSpanTexCoords(int lane, const Fragment& f)
+    {
+        const Vector2i& p0 = m_points[0];
+        const Vector2i& p1 = m_points[1];
+        const Vector2i& p2 = m_points[2];
+        int varying_count = m_varyings[0]->Size();
+
+        float weights_dx[3];
+        float weights_dy[3];
+        int step = 1 << m_subpixel_shift;
+        InterpolationWeights(Vector2i(f.p.x + step, f.p.y), p0, p1, p2, m_one_div_signed_area, m_one_div_ws, weights_dx);
+        InterpolationWeights(Vector2i(f.p.x, f.p.y + step), p0, p1, p2, m_one_div_signed_area, m_one_div_ws, weights_dy);
+
+        for (int i = 0; i < varying_count; ++i)
+        {
+            const GLProgram::Varying& v0 = (*m_varyings[0])[i];
+            if (v0.type != GLProgram::VaryingType::Vec2)
             {
-                if (lines % 2 == 1)
-                {
-                    //DrawScanLine2(y0, min_x0, max_x0, min_x, max_x, true, p0, p1, p2);
-                }
-
-                y0 = y;
-                min_x0 = min_x;
-                max_x0 = max_x;
-
-                DrawScanLine(y, min_x, max_x, p0, p1, p2);
+                continue;
             }
 
-            --y;
-            ++lines;
-        }
+            const GLProgram::Varying& v1 = (*m_varyings[1])[i];
+            const GLProgram::Varying& v2 = (*m_varyings[2])[i];
 
-        if (lines % 2 == 1)
-        {
-            //DrawScanLine2(y0, min_x0, max_x0, min_x0, max_x0, false, p0, p1, p2);
+            Vector4 varying = (v2.value * f.a01 * m_one_div_ws[2] + v0.value * f.a12 * m_one_div_ws[0] + v1.value * f.a20 * m_one_div_ws[1]) * f.w;
+            Vector4 varying_dx = v0.value * weights_dx[0] + v1.value * weights_dx[1] + v2.value * weights_dx[2];
+            Vector4 varying_dy = v0.value * weights_dy[0] + v1.value * weights_dy[1] + v2.value * weights_dy[2];
+            Vector2 ddx(varying_dx.x - varying.x, varying_dx.y - varying.y);
+            Vector2 ddy(varying_dy.x - varying.x, varying_dy.y - varying.y);
+            m_program->SetFSSpanVarying(lane, v0.name, Vector2(varying.x, varying.y), ddx, ddy);
         }
     }
 
-    void GLRasterizer::Run()
+    const Vector4* GLRasterizer::Shade(int lane, const Fragment& f)
     {
-        Vector2i p0;
-        Vector2i p1;
-        Vector2i p2;
-        p0.x = (int) ProjToScreenX(m_positions[0].x / m_positions[0].w);
-        p1.x = (int) ProjToScreenX(m_positions[1].x / m_positions[1].w);
-        p2.x = (int) ProjToScreenX(m_positions[2].x / m_positions[2].w);
-        p0.y = (int) ProjToScreenY(m_positions[0].y / m_positions[0].w);
-        p1.y = (int) ProjToScreenY(m_positions[1].y / m_positions[1].w);
-        p2.y = (int) ProjToScreenY(m_positions[2].y / m_positions[2].w);
-
-        Vector4 a = m_positions[0];
-        Vector4 b = m_positions[1];
-        Vector4 c = m_positions[2];
-
-        Vector4 pa = a / a.w;
-        Vector4 pb = b / b.w;
-        Vector4 pc = c / c.w;
-
-        if (pa.y > pb.y)
-        {
-            std::swap(a, b);
-            std::swap(pa, pb);
-        }
-        if (pb.y > pc.y)
-        {
-            std::swap(b, c);
-            std::swap(pb, pc);
-        }
-        if (pa.y > pb.y)
+        int varying_count = m_varyings[0]->Size();
+
+        // vec2 varyings and their derivatives were given to the span
+        if (m_need_derivatives)
         {
-            std::swap(a, b);
-            std::swap(pa, pb);
+            m_program->SetSpanLane(lane);
         }
 
-        //             pc
-        //
-        //    pb     pd
-        //
-        //        pa
-
+        for (int i = 0; i < varying_count; ++i)
         {
-            Vector2i sa, sb, sc, sd;
-            sa.x = (int) ProjToScreenX(pa.x);
-            sa.y = (int) ProjToScreenY(pa.y);
-            sb.x = (int) ProjToScreenX(pb.x);
-            sb.y = (int) ProjToScreenY(pb.y);
-            sc.x = (int) ProjToScreenX(pc.x);
-            sc.y = (int) ProjToScreenY(pc.y);
-
-            // find pd
+            const GLProgram::Varying& v0 = (*m_varyings[0])[i];
+            if (v0.type == GLProgram::VaryingType::Vec2)
             {
-                Vector<Vector2i> e = TriangleEdge(sc, sa);
-                int min_x = 0x7fffffff;
-                int max_x = -1;
-                for (int i = 0; i < e.Size(); ++i)
-                {
-                    if (e[i].y == sb.y)
-                    {
-                        min_x = Mathf::Min(min_x, e[i].x);
-                        max_x = Mathf::Max(max_x, e[i].x);
-                    }
-                }
-
-                if (sb.x <= min_x)
-                {
-                    sd.x = max_x;
-                }
-                else
-                {
-                    sd.x = min_x;
-                }
-                sd.y = sb.y;
+                continue;
             }
 
-            Vector<Vector2i> e1 = TriangleEdge(sc, sd);
-            Vector<Vector2i> e2 = TriangleEdge(sc, sb);
-
-            DrawHalfTriangle(e1, e2, sc.y, sd.y, false, p0, p1, p2);
+            const GLProgram::Varying& v1 = (*m_varyings[1])[i];
+            const GLProgram::Varying& v2 = (*m_varyings[2])[i];
 
-            e1 = TriangleEdge(sd, sa);
-            e2 = TriangleEdge(sb, sa);
-            DrawHalfTriangle(e1, e2, sd.y, sa.y, true, p0, p1, p2);
+            Vector4 varying = (v2.value * f.a01 * m_one_div_ws[2] + v0.value * f.a12 * m_one_div_ws[0] + v1.value * f.a20 * m_one_div_ws[1]) * f.w;
+            m_program->SetFSVarying(v0.name, &varying, v0.size);
         }
+
+        Vector4 frag_coord((float) (f.p.x >> m_subpixel_shift), (float) (f.p.y >> m_subpixel_shift), f.depth, 1.0f / f.w);
+
+        return (const Vector4*) m_program->CallFSMain(frag_coord);
     }
 }
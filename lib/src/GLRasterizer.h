@@ -18,59 +18,317 @@
 #pragma once
 
 #include "GLProgram.h"
+#include "GLTexture2D.h"
 #include "math/Vector4.h"
 #include "math/Vector2i.h"
 #include "container/Vector.h"
-#include <functional>
+#include <math.h>
 
 namespace sgl
 {
-    typedef std::function<void(const Viry3D::Vector2i& p, const Viry3D::Vector4& c, float depth)> SetFragmentFunc;
-
     class GLRasterizer
     {
     public:
+        enum
+        {
+            // multisampled triangles are set up in fixed point with this many fraction bits
+            SUBPIXEL_SHIFT = 4,
+            SUBPIXEL_SIZE = 1 << SUBPIXEL_SHIFT,
+            MULTISAMPLES = 4,
+            // triangles are not clipped to the screen, vertices are clamped to this many pixels around
+            // the origin so raster coordinates fit in an int and edge products in 64 bits
+            GUARD_BAND = 1 << 22,
+        };
+
+        // samples is 1, or MULTISAMPLES for coverage on a rotated grid with subpixel vertices
         GLRasterizer(
             const Viry3D::Vector4* positions,
-            const Viry3D::Vector<GLProgram::Varying>* varyings,
+            const Viry3D::Vector<GLProgram::Varying>* const* varyings,
             GLProgram* program,
-            SetFragmentFunc set_fragment,
             int viewport_x,
             int viewport_y,
             int viewport_width,
             int viewport_height,
-            bool ccw):
-            m_positions(positions),
-            m_varyings(varyings),
-            m_program(program),
-            m_set_fragment(set_fragment),
-            m_viewport_x(viewport_x),
-            m_viewport_y(viewport_y),
-            m_viewport_width(viewport_width),
-            m_viewport_height(viewport_height),
-            m_ccw(ccw)
+            bool ccw,
+            int samples);
+        // twice the signed area of the triangle o, o + left, o + right. 64 bits, as raster units
+        // of triangles reaching far offscreen overflow an int product
+        static long long Cross(const Viry3D::Vector2i& left, const Viry3D::Vector2i& right)
         {
+            return (long long) left.x * right.y - (long long) left.y * right.x;
+        }
+        // inclusive screen rect of the triangle clipped to the viewport, false if it covers nothing
+        bool GetBounds(int& min_x, int& min_y, int& max_x, int& max_y) const;
+        // shades the covered pixels inside the inclusive rect, the caller clips it to the bounds.
+        // the output stage is inlined into the scanline loop: with Output::EARLY_TESTS a fragment goes
+        // through output.EarlyTest(p, depth) first and is dropped unshaded on false, then unless
+        // Output::SHADE is 0 it is shaded and handed to output.SetFragment(p, color, depth).
+        // with Output::SAMPLES > 1 the rasterizer must be multisampled, and the calls take the depth
+        // of each sample and the mask of covered samples instead: output.EarlyTestSamples(p, depths, mask)
+        // returns the samples that passed, output.SetFragmentSamples(p, color, depths, mask) gets the
+        // color shaded once at the pixel center. fragments that pass the early tests wait in a span and
+        // are shaded in order when it is full or the scanline ends, their texture samples taken in batches
+        template<class Output>
+        void Run(Output& output, int min_x, int min_y, int max_x, int max_y)
+        {
+            this->Setup();
+            m_span_size = 0;
+
+            for (int y = max_y; y >= min_y; --y)
+            {
+                if (Output::SAMPLES > 1)
+                {
+                    this->DrawScanLineSamples(output, y, min_x, max_x);
+                }
+                else
+                {
+                    this->DrawScanLine(output, y, min_x, max_x);
+                }
+            }
         }
-        void Run();
 
     private:
-        float ProjToScreenX(float x);
-        float ProjToScreenY(float y);
-        void DrawHalfTriangle(
-            const Viry3D::Vector<Viry3D::Vector2i>& e1, const Viry3D::Vector<Viry3D::Vector2i>& e2,
-            int y_top, int y_bottom, bool include_bottom,
-            const Viry3D::Vector2i& p0, const Viry3D::Vector2i& p1, const Viry3D::Vector2i& p2);
-        void DrawScanLine(int y, int min_x, int max_x, const Viry3D::Vector2i& p0, const Viry3D::Vector2i& p1, const Viry3D::Vector2i& p2);
-        void DrawScanLine2(int y0, int min_x0, int max_x0, int min_x1, int max_x1, bool draw_y1, const Viry3D::Vector2i& p0, const Viry3D::Vector2i& p1, const Viry3D::Vector2i& p2);
+        enum
+        {
+            SPAN_SIZE = GLTexture2D::BATCH_SIZE,
+        };
+
+        // a covered fragment waiting in the span, p is where it is shaded in raster units
+        struct Fragment
+        {
+            Viry3D::Vector2i p;
+            Viry3D::Vector2i pixel;
+            float a01;
+            float a12;
+            float a20;
+            float w;
+            float depth;
+            int mask;
+            float depths[MULTISAMPLES];
+        };
+
+        float ProjToScreenX(float x) const;
+        float ProjToScreenY(float y) const;
+        void Setup();
+        // gives the program the vec2 varyings and derivatives of the fragment in the span
+        void SetSpanTexCoords(int lane, const Fragment& f);
+        // runs the fs for the fragment in the span, null if it discarded
+        const Viry3D::Vector4* Shade(int lane, const Fragment& f);
+
+        template<class Output>
+        void ShadeSpan(Output& output)
+        {
+            int count = m_span_size;
+            m_span_size = 0;
+
+            // without vec2 varyings texture2D has no uv known ahead
+            if (m_need_derivatives)
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    this->SetSpanTexCoords(i, m_span[i]);
+                }
+                m_program->PrefetchSpanSamples(count);
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                const Fragment& f = m_span[i];
+                const Viry3D::Vector4* color = this->Shade(i, f);
+                if (color)
+                {
+                    if (Output::SAMPLES > 1)
+                    {
+                        output.SetFragmentSamples(f.pixel, *color, f.depths, f.mask);
+                    }
+                    else
+                    {
+                        output.SetFragment(f.pixel, *color, f.depth);
+                    }
+                }
+            }
+
+            if (m_need_derivatives)
+            {
+                m_program->SetSpanLane(-1);
+            }
+        }
+
+        static bool IsTopLeftEdge(const Viry3D::Vector2i& p0, const Viry3D::Vector2i& p1)
+        {
+            return ((p1.y > p0.y) || (p0.y == p1.y && p0.x > p1.x));
+        }
+
+        static long long EdgeEquation(const Viry3D::Vector2i& p, const Viry3D::Vector2i& p0, const Viry3D::Vector2i& p1, bool ccw)
+        {
+            long long q = (long long) (p1.x - p0.x) * (p.y - p0.y) - (long long) (p1.y - p0.y) * (p.x - p0.x);
+            if (ccw == false)
+            {
+                q = -q;
+            }
+            return q + (IsTopLeftEdge(p0, p1) ? 0 : -1);
+        }
+
+        template<class Output>
+        void DrawScanLine(Output& output, int y, int min_x, int max_x)
+        {
+            const Viry3D::Vector2i& p0 = m_points[0];
+            const Viry3D::Vector2i& p1 = m_points[1];
+            const Viry3D::Vector2i& p2 = m_points[2];
+
+            for (int x = min_x; x <= max_x; ++x)
+            {
+                Viry3D::Vector2i p(x, y);
+                long long w1 = EdgeEquation(p, p0, p1, m_ccw);
+                long long w2 = EdgeEquation(p, p1, p2, m_ccw);
+                long long w3 = EdgeEquation(p, p2, p0, m_ccw);
+
+                if (w1 >= 0 && w2 >= 0 && w3 >= 0)
+                {
+                    float a01 = fabs(Cross(p1 - p, p0 - p) / 2.0f) * m_one_div_area;
+                    float a12 = fabs(Cross(p2 - p, p1 - p) / 2.0f) * m_one_div_area;
+                    float a20 = 1.0f - a01 - a12;
+
+                    float w = 1.0f / (a01 * m_one_div_ws[2] + a12 * m_one_div_ws[0] + a20 * m_one_div_ws[1]);
+                    float depth = m_depths[2] * a01 + m_depths[0] * a12 + m_depths[1] * a20;
+
+                    if (Output::EARLY_TESTS && !output.EarlyTest(p, depth))
+                    {
+                        continue;
+                    }
+
+                    if (!Output::SHADE)
+                    {
+                        continue;
+                    }
+
+                    Fragment& f = m_span[m_span_size++];
+                    f.p = p;
+                    f.pixel = p;
+                    f.a01 = a01;
+                    f.a12 = a12;
+                    f.a20 = a20;
+                    f.w = w;
+                    f.depth = depth;
+                    if (m_span_size == SPAN_SIZE)
+                    {
+                        this->ShadeSpan(output);
+                    }
+                }
+            }
+
+            if (m_span_size > 0)
+            {
+                this->ShadeSpan(output);
+            }
+        }
+
+        template<class Output>
+        void DrawScanLineSamples(Output& output, int y, int min_x, int max_x)
+        {
+            const Viry3D::Vector2i& p0 = m_points[0];
+            const Viry3D::Vector2i& p1 = m_points[1];
+            const Viry3D::Vector2i& p2 = m_points[2];
+
+            for (int x = min_x; x <= max_x; ++x)
+            {
+                Viry3D::Vector2i p(x << SUBPIXEL_SHIFT, y << SUBPIXEL_SHIFT);
+                long long w1 = EdgeEquation(p, p0, p1, m_ccw);
+                long long w2 = EdgeEquation(p, p1, p2, m_ccw);
+                long long w3 = EdgeEquation(p, p2, p0, m_ccw);
+
+                int mask = 0;
+                for (int i = 0; i < MULTISAMPLES; ++i)
+                {
+                    if (w1 + m_sample_edges[0][i] >= 0 && w2 + m_sample_edges[1][i] >= 0 && w3 + m_sample_edges[2][i] >= 0)
+                    {
+                        mask |= 1 << i;
+                    }
+                }
+
+                if (mask == 0)
+                {
+                    continue;
+                }
+
+                // attributes are taken at the pixel center even when only outer samples are covered
+                Viry3D::Vector2i center(p.x + SUBPIXEL_SIZE / 2, p.y + SUBPIXEL_SIZE / 2);
+                float a01 = Cross(p1 - center, p0 - center) * m_one_div_signed_area;
+                float a12 = Cross(p2 - center, p1 - center) * m_one_div_signed_area;
+                float a20 = 1.0f - a01 - a12;
+
+                float w = 1.0f / (a01 * m_one_div_ws[2] + a12 * m_one_div_ws[0] + a20 * m_one_div_ws[1]);
+                float depth = m_depths[2] * a01 + m_depths[0] * a12 + m_depths[1] * a20;
+
+                float depths[MULTISAMPLES];
+                for (int i = 0; i < MULTISAMPLES; ++i)
+                {
+                    depths[i] = depth + m_sample_depths[i];
+                }
+
+                Viry3D::Vector2i pixel(x, y);
+
+                if (Output::EARLY_TESTS)
+                {
+                    mask = output.EarlyTestSamples(pixel, depths, mask);
+                    if (mask == 0)
+                    {
+                        continue;
+                    }
+                }
+
+                if (!Output::SHADE)
+                {
+                    continue;
+                }
+
+                Fragment& f = m_span[m_span_size++];
+                f.p = center;
+                f.pixel = pixel;
+                f.a01 = a01;
+                f.a12 = a12;
+                f.a20 = a20;
+                f.w = w;
+                f.depth = depth;
+                f.mask = mask;
+                for (int i = 0; i < MULTISAMPLES; ++i)
+                {
+                    f.depths[i] = depths[i];
+                }
+                if (m_span_size == SPAN_SIZE)
+                {
+                    this->ShadeSpan(output);
+                }
+            }
+
+            if (m_span_size > 0)
+            {
+                this->ShadeSpan(output);
+            }
+        }
 
         const Viry3D::Vector4* m_positions;
-        const Viry3D::Vector<GLProgram::Varying>* m_varyings;
+        const Viry3D::Vector<GLProgram::Varying>* const* m_varyings;
         GLProgram* m_program;
-        SetFragmentFunc m_set_fragment;
         int m_viewport_x;
         int m_viewport_y;
         int m_viewport_width;
         int m_viewport_height;
         bool m_ccw;
+        // 0, or SUBPIXEL_SHIFT when multisampled
+        int m_subpixel_shift;
+        // in raster units, pixels shifted up by m_subpixel_shift
+        Viry3D::Vector2i m_points[3];
+        float m_one_div_area;
+        float m_one_div_signed_area;
+        float m_one_div_ws[3];
+        float m_depths[3];
+        bool m_need_derivatives;
+        // per edge and sample, the edge function at the sample minus at the pixel origin
+        long long m_sample_edges[3][MULTISAMPLES];
+        // per sample, the depth at the sample minus at the pixel center
+        float m_sample_depths[MULTISAMPLES];
+        Fragment m_span[SPAN_SIZE];
+        int m_span_size;
     };
 }
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "GLObject.h"
+#include "GLES2/gl2ext.h"
 #include "memory/Memory.h"
 
 namespace sgl
@@ -53,9 +54,15 @@ namespace sgl
                     size = width * height * 4;
                     format = GL_RGBA;
                     break;
+                // depth is stored at its precision, 24 bit depth in GL_UNSIGNED_INT_24_8_OES words
                 case GL_DEPTH_COMPONENT16:
+                    size = width * height * 2;
+                    format = internalformat;
+                    break;
+                case GL_DEPTH_COMPONENT24_OES:
+                case GL_DEPTH24_STENCIL8_OES:
                     size = width * height * 4;
-                    format = GL_DEPTH_COMPONENT32_OES;
+                    format = internalformat;
                     break;
                 case GL_STENCIL_INDEX8:
                     size = width * height;
@@ -65,7 +72,7 @@ namespace sgl
                     return;
             }
 
-            if (m_width != width || m_height != height || m_buffer_size != size)
+            if (m_width != width || m_height != height || m_buffer_size != size || m_internal_format != format)
             {
                 m_width = width;
                 m_height = height;
@@ -82,8 +89,34 @@ namespace sgl
         int GetGreenComponentSize() const { return 8; }
         int GetBlueComponentSize() const { return 8; }
         int GetAlphaComponentSize() const { return 8; }
-        int GetDepthSize() const { return 32; }
-        int GetStencilSize() const { return 8; }
+        int GetDepthSize() const
+        {
+            switch (m_internal_format)
+            {
+                case GL_DEPTH_COMPONENT16:
+                    return 16;
+                case GL_DEPTH_COMPONENT24_OES:
+                case GL_DEPTH24_STENCIL8_OES:
+                    return 24;
+                default:
+                    return 0;
+            }
+        }
+        int GetStencilSize() const { return (m_internal_format == GL_STENCIL_INDEX8 || m_internal_format == GL_DEPTH24_STENCIL8_OES) ? 8 : 0; }
+        // layout of the buffer as a tile buffer depth format, 0 if it holds no depth
+        GLenum GetDepthFormat() const
+        {
+            switch (m_internal_format)
+            {
+                case GL_DEPTH_COMPONENT16:
+                    return GL_DEPTH_COMPONENT16;
+                case GL_DEPTH_COMPONENT24_OES:
+                case GL_DEPTH24_STENCIL8_OES:
+                    return GL_DEPTH24_STENCIL8_OES;
+                default:
+                    return 0;
+            }
+        }
         char* GetBuffer() const { return m_buffer; }
 
     private:
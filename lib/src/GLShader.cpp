@@ -20,15 +20,23 @@
 #include "Debug.h"
 #include "memory/Memory.h"
 #include "io/File.h"
+#include <atomic>
 
 using namespace Viry3D;
 
+#if VR_WINDOWS
 extern const char* g_vs_path;
 extern const char* vc_version;
 extern const char* win_sdk_inc;
+#else
+extern const char* g_cxx;
+#endif
 
 namespace sgl
 {
+    // shaders of every context compile in the working directory, their temp files must not meet
+    static std::atomic<int> s_temp_serial(0);
+
     class GLShaderPrivate
     {
     public:
@@ -57,8 +65,29 @@ namespace sgl
         };
 
         GLShaderPrivate(GLShader* p):
-            m_p(p)
+            m_p(p),
+            m_has_discard(false)
+        {
+        }
+
+        static bool IsIdentifierChar(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        }
+
+        static bool ContainsWord(const String& s, const String& word)
         {
+            int index = s.IndexOf(word);
+            while (index >= 0)
+            {
+                int end = index + word.Size();
+                if ((index == 0 || !IsIdentifierChar(s[index - 1])) && (end == s.Size() || !IsIdentifierChar(s[end])))
+                {
+                    return true;
+                }
+                index = s.IndexOf(word, index + 1);
+            }
+            return false;
         }
 
         // https://www.khronos.org/registry/OpenGL/specs/gl/GLSLangSpec.1.10.pdf
@@ -73,6 +102,7 @@ namespace sgl
             m_uniforms.Clear();
             m_attributes.Clear();
             m_varyings.Clear();
+            m_has_discard = false;
 
             for (int i = 0; i < sentences.Size(); ++i)
             {
@@ -106,6 +136,11 @@ namespace sgl
                         {
                             sentences[i] = "DLL_EXPORT " + s.Replace(" main(", " fs_main(");
                         }
+
+                        if (ContainsWord(s, "discard"))
+                        {
+                            m_has_discard = true;
+                        }
                     }
                 }
             }
@@ -114,7 +149,7 @@ namespace sgl
             {
                 builtins_get.Add("gl_Position");
 
-                temp_file = "temp.vs";
+                temp_file = String::Format("temp.vs.%d", ++s_temp_serial);
                 src = File::ReadAllText("Assets/shader/vs_include.txt") + "\n";
             }
             else if (m_p->m_type == GL_FRAGMENT_SHADER)
@@ -122,7 +157,14 @@ namespace sgl
                 builtins_set.Add("gl_FragCoord");
                 builtins_get.Add("gl_FragColor");
 
-                temp_file = "temp.fs";
+                // discard only raises a flag in the shader, which the caller resets and reads around fs_main
+                if (m_has_discard)
+                {
+                    builtins_set.Add("gl_Discard");
+                    builtins_get.Add("gl_Discard");
+                }
+
+                temp_file = String::Format("temp.fs.%d", ++s_temp_serial);
                 src = File::ReadAllText("Assets/shader/fs_include.txt") + "\n";
             }
 
@@ -154,6 +196,7 @@ namespace sgl
                 for (int i = 0; i < m_varyings.Size(); ++i)
                 {
                     src += String::Format("VAR_SETTER(%s)\n", m_varyings[i].name.CString());
+                    src += String::Format("VARYING_GETTER(%s)\n", m_varyings[i].name.CString());
                 }
             }
 
@@ -174,6 +217,7 @@ namespace sgl
         Vector<Uniform> m_uniforms;
         Vector<String> m_attributes;
         Vector<Varying> m_varyings;
+        bool m_has_discard;
         ByteBuffer m_obj_bin;
     };
 
@@ -234,6 +278,11 @@ namespace sgl
 
     void GLShader::Compile()
     {
+        String temp_src_name;
+        m_private->ParseSource(temp_src_name);
+        String temp_out_name = temp_src_name + ".out.txt";
+
+#if VR_WINDOWS
         const bool isX64 = sizeof(void*) == 8;
         const String host = "Hostx64"; // "Hostx86"
         String cl_dir;
@@ -247,14 +296,14 @@ namespace sgl
             cl_dir = String(g_vs_path) + "\\VC\\Tools\\MSVC\\" + vc_version + "\\bin\\" + host + "\\x86";
         }
 
-        String temp_src_name;
-        m_private->ParseSource(temp_src_name);
-        String temp_out_name = temp_src_name + ".out.txt";
-
         exec_cmd(cl_dir, "cl.exe", "/c " + temp_src_name + ".cpp "
             "/I \"" + g_vs_path + "\\VC\\Tools\\MSVC\\" + vc_version + "\\include\" "
             "/I \"" + win_sdk_inc + "\"",
             temp_out_name);
+#else
+        // position independent, the object is linked into the program's shared library
+        exec_cmd("", g_cxx, "-c -O2 -fPIC " + temp_src_name + ".cpp -o " + temp_src_name + ".obj", temp_out_name);
+#endif
 
         String out_text = File::ReadAllText(temp_out_name);
 
@@ -316,4 +365,9 @@ namespace sgl
         }
         return types;
     }
+
+    bool GLShader::HasDiscard() const
+    {
+        return m_private->m_has_discard;
+    }
 }
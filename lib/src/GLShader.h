@@ -49,6 +49,7 @@ namespace sgl
         Viry3D::Vector<Viry3D::String> GetUniformTypes() const;
         Viry3D::Vector<Viry3D::String> GetVaryingNames() const;
         Viry3D::Vector<Viry3D::String> GetVaryingTypes() const;
+        bool HasDiscard() const;
 
     private:
         friend class GLShaderPrivate;
@@ -0,0 +1,117 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLSurface.h"
+#include "memory/Memory.h"
+
+using namespace Viry3D;
+
+namespace sgl
+{
+    GLSurface::GLSurface(int width, int height, GLenum depth_format, int samples, int buffer_count):
+        m_width(width),
+        m_height(height),
+        m_depth_format(depth_format),
+        m_samples(samples),
+        m_buffer_count(buffer_count),
+        m_back_buffer(0),
+        m_depth_buffer(nullptr),
+        m_stencil_buffer(nullptr),
+        m_presented_count(0)
+    {
+        int pixels = width * height;
+        int depth_size = depth_format == GL_DEPTH_COMPONENT16 ? 2 : 4;
+
+        for (int i = 0; i < MAX_BUFFERS; ++i)
+        {
+            m_color_buffers[i] = nullptr;
+            if (i < buffer_count)
+            {
+                m_color_buffers[i] = Memory::Alloc<unsigned char>(pixels * 4);
+                Memory::Zero(m_color_buffers[i], pixels * 4);
+            }
+        }
+
+        m_depth_buffer = Memory::Alloc<unsigned char>(pixels * depth_size);
+        Memory::Zero(m_depth_buffer, pixels * depth_size);
+
+        if (depth_format != GL_DEPTH24_STENCIL8_OES)
+        {
+            m_stencil_buffer = Memory::Alloc<unsigned char>(pixels);
+            Memory::Zero(m_stencil_buffer, pixels);
+        }
+    }
+
+    GLSurface::~GLSurface()
+    {
+        for (int i = 0; i < MAX_BUFFERS; ++i)
+        {
+            Memory::SafeFree(m_color_buffers[i]);
+        }
+        Memory::SafeFree(m_depth_buffer);
+        Memory::SafeFree(m_stencil_buffer);
+    }
+
+    void GLSurface::AddOutput(const Ref<GLFrameOutput>& output)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_outputs.Add(output);
+    }
+
+    void GLSurface::Present()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        GLFrame frame;
+        // outputs walk the rows from the top down
+        frame.pixels = m_color_buffers[m_back_buffer] + (m_height - 1) * m_width * 4;
+        frame.width = m_width;
+        frame.height = m_height;
+        frame.pitch = -m_width * 4;
+        frame.serial = m_presented_count;
+
+        for (int i = 0; i < m_outputs.Size(); ++i)
+        {
+            m_outputs[i]->Present(frame);
+        }
+
+        m_back_buffer = (m_back_buffer + 1) % m_buffer_count;
+        m_presented_count += 1;
+
+        lock.unlock();
+        m_presented_cond.notify_all();
+    }
+
+    unsigned int GLSurface::GetPresentedCount()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_presented_count;
+    }
+
+    void GLSurface::WaitForPresented(unsigned int count)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_presented_cond.wait(lock, [this, count]() {
+            return (int) (m_presented_count - count) >= 0;
+        });
+    }
+
+    bool GLSurface::IsDepthFormat(GLenum format)
+    {
+        return format == GL_DEPTH_COMPONENT32_OES || format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH24_STENCIL8_OES;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "GLES2/gl2.h"
+#include "GLES2/gl2ext.h"
+#include "GLFrameOutput.h"
+#include "container/Vector.h"
+#include "memory/Ref.h"
+#include <condition_variable>
+#include <mutex>
+
+namespace sgl
+{
+    // an offscreen surface owning the default buffers a context draws to while it is current.
+    // the color buffers take turns as the back buffer, the others hold the last presented frames
+    class GLSurface
+    {
+    public:
+        enum
+        {
+            MAX_BUFFERS = 3,
+        };
+
+        // depth_format is a default depth format of the context, the stencil is packed into
+        // depth with GL_DEPTH24_STENCIL8_OES and has a buffer of its own otherwise
+        GLSurface(int width, int height, GLenum depth_format, int samples, int buffer_count);
+        ~GLSurface();
+
+        int GetWidth() const { return m_width; }
+        int GetHeight() const { return m_height; }
+        GLenum GetDepthFormat() const { return m_depth_format; }
+        int GetSamples() const { return m_samples; }
+        int GetBufferCount() const { return m_buffer_count; }
+        // the back buffer, rgba8 rows from the bottom up, row 0 is window y 0
+        unsigned char* GetColorBuffer() const { return m_color_buffers[m_back_buffer]; }
+        void* GetDepthBuffer() const { return m_depth_buffer; }
+        unsigned char* GetStencilBuffer() const { return m_stencil_buffer; }
+
+        void AddOutput(const Ref<GLFrameOutput>& output);
+        // hands the back buffer to the outputs and makes the next color buffer the back buffer,
+        // called by the context drawing to the surface once its tiles are stored
+        void Present();
+        // frames presented so far
+        unsigned int GetPresentedCount();
+        void WaitForPresented(unsigned int count);
+
+        static bool IsDepthFormat(GLenum format);
+
+    private:
+        int m_width;
+        int m_height;
+        GLenum m_depth_format;
+        int m_samples;
+        int m_buffer_count;
+        int m_back_buffer;
+        unsigned char* m_color_buffers[MAX_BUFFERS];
+        void* m_depth_buffer;
+        unsigned char* m_stencil_buffer;
+        // guards the outputs and the presented count, the surface presents on the thread the gl
+        // calls of its context run on while outputs are added from the application thread
+        std::mutex m_mutex;
+        std::condition_variable m_presented_cond;
+        Viry3D::Vector<Ref<GLFrameOutput>> m_outputs;
+        unsigned int m_presented_count;
+    };
+}
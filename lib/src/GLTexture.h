@@ -24,11 +24,18 @@ namespace sgl
     class GLTexture: public GLObject
     {
     public:
-        GLTexture(GLuint id):
-            GLObject(id)
+        // a generated name has no target until it is first bound
+        GLTexture(GLuint id, GLenum target = 0):
+            GLObject(id),
+            m_target(target)
         {
         }
 
         virtual ~GLTexture() { }
+
+        GLenum GetTarget() const { return m_target; }
+
+    private:
+        GLenum m_target;
     };
 }
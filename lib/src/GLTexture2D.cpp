@@ -16,8 +16,21 @@
 */
 
 #include "GLTexture2D.h"
+#include "GLSimd.h"
+#include "GLES2/gl2ext.h"
+#include "container/Vector.h"
 #include "memory/Memory.h"
 #include "math/Mathf.h"
+#include "Debug.h"
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+
+// levels are morton tiled, SGL_TEXTURE_LINEAR=1 stores them in padded rows instead to measure what
+// the tiling gains, see app_bench_texture in app/project/linux
+#ifndef SGL_TEXTURE_LINEAR
+#define SGL_TEXTURE_LINEAR 0
+#endif
 
 using namespace Viry3D;
 
@@ -26,28 +39,1148 @@ namespace sgl
     class GLTexture2DPrivate
     {
     public:
+        enum
+        {
+            BATCH_SIZE = GLTexture2D::BATCH_SIZE
+        };
+
+        struct FormatInfo;
+        class BlockCache;
+
+        // texels are stored in 4x4 tiles of 16 texels each, tiles in row major order,
+        // texels inside a tile in morton order so a bilinear footprint mostly hits one tile,
+        // compressed formats keep one block per tile and decode it through the sampling thread's cache
+        struct Level
+        {
+            int width;
+            int height;
+            int tiles_x;
+            const FormatInfo* format;
+            byte* data;
+            // names the blocks of a compressed level in the block caches, each upload takes a new one
+            unsigned int serial;
+        };
+
         GLTexture2DPrivate(GLTexture2D* p):
             m_p(p),
-            m_data(nullptr)
+            m_complete(false),
+            m_render_buffer(nullptr),
+            m_render_buffer_valid(false),
+            m_render_buffer_dirty(false)
         {
         }
 
         ~GLTexture2DPrivate()
         {
-            Memory::SafeFree(m_data);
+            for (auto& i : m_levels)
+            {
+                Memory::SafeFree(i.data);
+            }
+
+            Memory::SafeFree(m_render_buffer);
+        }
+
+        static bool IsMipmapFilter(GLenum filter)
+        {
+            return filter == GL_NEAREST_MIPMAP_NEAREST ||
+                filter == GL_LINEAR_MIPMAP_NEAREST ||
+                filter == GL_NEAREST_MIPMAP_LINEAR ||
+                filter == GL_LINEAR_MIPMAP_LINEAR;
+        }
+
+        static int GetMipmapLevelCount(int width, int height)
+        {
+            int count = 1;
+            int size = Mathf::Max(width, height);
+            while (size > 1)
+            {
+                size >>= 1;
+                ++count;
+            }
+            return count;
+        }
+
+        static int GetTiledSize(int width, int height, int tile_size)
+        {
+            return ((width + 3) >> 2) * ((height + 3) >> 2) * tile_size;
+        }
+
+        // a texel is at TexelOffsetX + TexelOffsetY, in tiled levels the two parts have disjoint bits
+        static int TexelOffsetX(int x)
+        {
+#if SGL_TEXTURE_LINEAR
+            return x;
+#else
+            return ((x >> 2) << 4) | ((x & 2) << 1) | (x & 1);
+#endif
+        }
+
+        static int TexelOffsetY(int y, int tiles_x)
+        {
+#if SGL_TEXTURE_LINEAR
+            return y * (tiles_x << 2);
+#else
+            return (((y >> 2) * tiles_x) << 4) | ((y & 2) << 2) | ((y & 1) << 1);
+#endif
+        }
+
+        // morton order of a texel inside its 4x4 tile, decoded etc1 blocks keep it in either layout
+        static int BlockTexelOffset(int x, int y)
+        {
+            return ((y & 2) << 2) | ((x & 2) << 1) | ((y & 1) << 1) | (x & 1);
+        }
+
+        static void AllocLevel(Level& level, int width, int height, const FormatInfo* format)
+        {
+            level.width = width;
+            level.height = height;
+            level.tiles_x = (width + 3) >> 2;
+            level.format = format;
+            level.data = Memory::Realloc(level.data, GetTiledSize(width, height, format->tile_size));
+        }
+
+        Level& SpecifyLevel(int level, int width, int height, const FormatInfo* format)
+        {
+            while (m_levels.Size() <= level)
+            {
+                m_levels.Add({ 0, 0, 0, nullptr, nullptr, 0 });
+            }
+
+            AllocLevel(m_levels[level], width, height, format);
+            return m_levels[level];
+        }
+
+        // unpacked rows start at multiples of the unpack alignment
+        static int GetRowPitch(int width, int texel_size, int alignment)
+        {
+            return (width * texel_size + alignment - 1) / alignment * alignment;
+        }
+
+        // writes a rect of linear rows into the tiled level in place, row_pitch in bytes
+        template<class Texel>
+        static void TileRect(const byte* pixels, int row_pitch, Level& level, int x, int y, int width, int height)
+        {
+            Texel* dest = (Texel*) level.data;
+
+            for (int j = 0; j < height; ++j)
+            {
+                const Texel* src = (const Texel*) &pixels[j * row_pitch];
+                Texel* row = &dest[TexelOffsetY(y + j, level.tiles_x)];
+
+                for (int i = 0; i < width; ++i)
+                {
+                    row[TexelOffsetX(x + i)] = src[i];
+                }
+            }
+        }
+
+        template<class Texel>
+        static void UntileLevel(const Level& level, byte* pixels, int row_pitch)
+        {
+            const Texel* src = (const Texel*) level.data;
+
+            for (int y = 0; y < level.height; ++y)
+            {
+                Texel* dest = (Texel*) &pixels[y * row_pitch];
+                const Texel* row = &src[TexelOffsetY(y, level.tiles_x)];
+
+                for (int x = 0; x < level.width; ++x)
+                {
+                    dest[x] = row[TexelOffsetX(x)];
+                }
+            }
+        }
+
+        // npot textures are not restricted, as with OES_texture_npot,
+        // all levels have to share the format and type of level 0
+        void UpdateCompleteness()
+        {
+            m_complete = false;
+
+            if (m_levels.Size() == 0 || m_levels[0].data == nullptr)
+            {
+                return;
+            }
+
+            if (IsMipmapFilter(m_p->m_min_filter))
+            {
+                int level_count = GetMipmapLevelCount(m_levels[0].width, m_levels[0].height);
+                if (m_levels.Size() < level_count)
+                {
+                    return;
+                }
+
+                for (int i = 1; i < level_count; ++i)
+                {
+                    const Level& level = m_levels[i];
+                    if (level.data == nullptr ||
+                        level.format != m_levels[0].format ||
+                        level.width != Mathf::Max(1, m_levels[0].width >> i) ||
+                        level.height != Mathf::Max(1, m_levels[0].height >> i))
+                    {
+                        return;
+                    }
+                }
+            }
+
+            m_complete = true;
+        }
+
+        // normalized coordinate folded into [0, 1] for the repeating wrap modes
+        static float WrapCoord(float s, GLenum wrap)
+        {
+            if (wrap == GL_REPEAT)
+            {
+                return s - floorf(s);
+            }
+            else if (wrap == GL_MIRRORED_REPEAT)
+            {
+                float f = (s * 0.5f - floorf(s * 0.5f)) * 2.0f;
+                return f > 1.0f ? 2.0f - f : f;
+            }
+            return s;
+        }
+
+        static int NearestIndex(float s, int size, GLenum wrap)
+        {
+            return (int) Mathf::Clamp(floorf(WrapCoord(s, wrap) * size), 0.0f, (float) (size - 1));
+        }
+
+        static void LinearIndices(float s, int size, GLenum wrap, int& i0, int& i1, float& frac)
+        {
+            float t = WrapCoord(s, wrap) * size - 0.5f;
+            float f0 = floorf(t);
+            float f1 = f0 + 1.0f;
+            frac = t - f0;
+
+            if (wrap == GL_REPEAT)
+            {
+                f0 = f0 < 0 ? size - 1.0f : f0;
+                f1 = f1 >= size ? 0.0f : f1;
+            }
+
+            i0 = (int) Mathf::Clamp(f0, 0.0f, (float) (size - 1));
+            i1 = (int) Mathf::Clamp(f1, 0.0f, (float) (size - 1));
+        }
+
+#if SGL_SSE2
+        static __m128 WrapCoord(__m128 s, GLenum wrap)
+        {
+            if (wrap == GL_REPEAT)
+            {
+                return _mm_sub_ps(s, Simd::Floor(s));
+            }
+            else if (wrap == GL_MIRRORED_REPEAT)
+            {
+                __m128 one = _mm_set1_ps(1.0f);
+                __m128 two = _mm_set1_ps(2.0f);
+                __m128 half = _mm_mul_ps(s, _mm_set1_ps(0.5f));
+                __m128 f = _mm_mul_ps(_mm_sub_ps(half, Simd::Floor(half)), two);
+                return Simd::Select(_mm_cmpgt_ps(f, one), _mm_sub_ps(two, f), f);
+            }
+            return s;
+        }
+
+        static __m128i ClampIndex(__m128 i, int size)
+        {
+            return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(i, _mm_setzero_ps()), _mm_set1_ps((float) (size - 1))));
+        }
+
+        static __m128i NearestIndex(__m128 s, int size, GLenum wrap)
+        {
+            return ClampIndex(Simd::Floor(_mm_mul_ps(WrapCoord(s, wrap), _mm_set1_ps((float) size))), size);
+        }
+
+        static void LinearIndices(__m128 s, int size, GLenum wrap, __m128i& i0, __m128i& i1, __m128& frac)
+        {
+            __m128 t = _mm_sub_ps(_mm_mul_ps(WrapCoord(s, wrap), _mm_set1_ps((float) size)), _mm_set1_ps(0.5f));
+            __m128 f0 = Simd::Floor(t);
+            __m128 f1 = _mm_add_ps(f0, _mm_set1_ps(1.0f));
+            frac = _mm_sub_ps(t, f0);
+
+            if (wrap == GL_REPEAT)
+            {
+                f0 = Simd::Select(_mm_cmplt_ps(f0, _mm_setzero_ps()), _mm_set1_ps(size - 1.0f), f0);
+                f1 = Simd::Select(_mm_cmpge_ps(f1, _mm_set1_ps((float) size)), _mm_setzero_ps(), f1);
+            }
+
+            i0 = ClampIndex(f0, size);
+            i1 = ClampIndex(f1, size);
+        }
+
+        static __m128i TexelOffsetX(__m128i x)
+        {
+#if SGL_TEXTURE_LINEAR
+            return x;
+#else
+            __m128i tile = _mm_slli_epi32(_mm_srli_epi32(x, 2), 4);
+            __m128i bit1 = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(2)), 1);
+            __m128i bit0 = _mm_and_si128(x, _mm_set1_epi32(1));
+            return _mm_or_si128(tile, _mm_or_si128(bit1, bit0));
+#endif
+        }
+
+        static __m128i TexelOffsetY(__m128i y, int tiles_x)
+        {
+#if SGL_TEXTURE_LINEAR
+            return Simd::MulLo32(y, _mm_set1_epi32(tiles_x << 2));
+#else
+            __m128i tile = _mm_slli_epi32(Simd::MulLo32(_mm_srli_epi32(y, 2), _mm_set1_epi32(tiles_x)), 4);
+            __m128i bit1 = _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(2)), 2);
+            __m128i bit0 = _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(1)), 1);
+            return _mm_or_si128(tile, _mm_or_si128(bit1, bit0));
+#endif
+        }
+#endif
+
+        // storage of 3 byte texels, loaded and stored through an unsigned int like the other sizes
+        struct Texel24
+        {
+            byte c[3];
+        };
+
+        static unsigned int LoadTexel(unsigned int t) { return t; }
+        static unsigned int LoadTexel(unsigned short t) { return t; }
+        static unsigned int LoadTexel(byte t) { return t; }
+        static unsigned int LoadTexel(const Texel24& t) { return t.c[0] | (t.c[1] << 8) | (t.c[2] << 16); }
+
+        static void StoreTexel(unsigned int v, unsigned int& t) { t = v; }
+        static void StoreTexel(unsigned int v, unsigned short& t) { t = (unsigned short) v; }
+        static void StoreTexel(unsigned int v, byte& t) { t = (byte) v; }
+        static void StoreTexel(unsigned int v, Texel24& t) { t.c[0] = (byte) v; t.c[1] = (byte) (v >> 8); t.c[2] = (byte) (v >> 16); }
+
+        // unorm channel of a packed texel, the same format code unpacks one texel or 4 sse2 lanes
+        template<int shift, int bits>
+        static float Channel(unsigned int t)
+        {
+            return ((t >> shift) & ((1 << bits) - 1)) * (1.0f / ((1 << bits) - 1));
+        }
+
+        static float Zero(unsigned int) { return 0.0f; }
+        static float One(unsigned int) { return 1.0f; }
+
+#if SGL_SSE2
+        template<int shift, int bits>
+        static __m128 Channel(__m128i t)
+        {
+            __m128i c = _mm_and_si128(_mm_srli_epi32(t, shift), _mm_set1_epi32((1 << bits) - 1));
+            return _mm_mul_ps(_mm_cvtepi32_ps(c), _mm_set1_ps(1.0f / ((1 << bits) - 1)));
+        }
+
+        static __m128 Zero(__m128i) { return _mm_setzero_ps(); }
+        static __m128 One(__m128i) { return _mm_set1_ps(1.0f); }
+#endif
+
+        // rounded 2x2 average of one channel, used by mipmap generation
+        template<int shift, int bits>
+        static unsigned int AverageChannel(const unsigned int* t)
+        {
+            unsigned int mask = (1 << bits) - 1;
+            unsigned int sum = ((t[0] >> shift) & mask) + ((t[1] >> shift) & mask) + ((t[2] >> shift) & mask) + ((t[3] >> shift) & mask);
+            return ((sum + 2) >> 2) << shift;
+        }
+
+        template<class T>
+        struct TexelStorage
+        {
+            typedef T Texel;
+
+            static unsigned int Load(const Level& level, int offset)
+            {
+                return LoadTexel(((const T*) level.data)[offset]);
+            }
+        };
+
+        // one struct per upload format and type, channels as bit fields of the texel loaded as unsigned int
+        struct FormatRGBA8: TexelStorage<unsigned int>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Channel<0, 8>(t);
+                rgba[1] = Channel<8, 8>(t);
+                rgba[2] = Channel<16, 8>(t);
+                rgba[3] = Channel<24, 8>(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<0, 8>(t) | AverageChannel<8, 8>(t) | AverageChannel<16, 8>(t) | AverageChannel<24, 8>(t);
+            }
+        };
+
+        struct FormatRGB8: TexelStorage<Texel24>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Channel<0, 8>(t);
+                rgba[1] = Channel<8, 8>(t);
+                rgba[2] = Channel<16, 8>(t);
+                rgba[3] = One(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<0, 8>(t) | AverageChannel<8, 8>(t) | AverageChannel<16, 8>(t);
+            }
+        };
+
+        struct FormatRGB565: TexelStorage<unsigned short>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Channel<11, 5>(t);
+                rgba[1] = Channel<5, 6>(t);
+                rgba[2] = Channel<0, 5>(t);
+                rgba[3] = One(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<11, 5>(t) | AverageChannel<5, 6>(t) | AverageChannel<0, 5>(t);
+            }
+        };
+
+        struct FormatRGBA4444: TexelStorage<unsigned short>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Channel<12, 4>(t);
+                rgba[1] = Channel<8, 4>(t);
+                rgba[2] = Channel<4, 4>(t);
+                rgba[3] = Channel<0, 4>(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<12, 4>(t) | AverageChannel<8, 4>(t) | AverageChannel<4, 4>(t) | AverageChannel<0, 4>(t);
+            }
+        };
+
+        struct FormatRGBA5551: TexelStorage<unsigned short>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Channel<11, 5>(t);
+                rgba[1] = Channel<6, 5>(t);
+                rgba[2] = Channel<1, 5>(t);
+                rgba[3] = Channel<0, 1>(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<11, 5>(t) | AverageChannel<6, 5>(t) | AverageChannel<1, 5>(t) | AverageChannel<0, 1>(t);
+            }
+        };
+
+        struct FormatLuminanceAlpha8: TexelStorage<unsigned short>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                C l = Channel<0, 8>(t);
+                rgba[0] = l;
+                rgba[1] = l;
+                rgba[2] = l;
+                rgba[3] = Channel<8, 8>(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<0, 8>(t) | AverageChannel<8, 8>(t);
+            }
+        };
+
+        struct FormatLuminance8: TexelStorage<byte>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                C l = Channel<0, 8>(t);
+                rgba[0] = l;
+                rgba[1] = l;
+                rgba[2] = l;
+                rgba[3] = One(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<0, 8>(t);
+            }
+        };
+
+        struct FormatAlpha8: TexelStorage<byte>
+        {
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Zero(t);
+                rgba[1] = Zero(t);
+                rgba[2] = Zero(t);
+                rgba[3] = Channel<0, 8>(t);
+            }
+
+            static unsigned int Average(const unsigned int* t)
+            {
+                return AverageChannel<0, 8>(t);
+            }
+        };
+
+        // decodes one etc1 block to rgba8 texels in the morton order of a tile
+        static void DecodeETC1(const byte* block, unsigned int* texels)
+        {
+            static const int modifiers[8][4] = {
+                { 2, 8, -2, -8 },
+                { 5, 17, -5, -17 },
+                { 9, 29, -9, -29 },
+                { 13, 42, -13, -42 },
+                { 18, 60, -18, -60 },
+                { 24, 80, -24, -80 },
+                { 33, 106, -33, -106 },
+                { 47, 183, -47, -183 },
+            };
+
+            unsigned int high = (block[0] << 24) | (block[1] << 16) | (block[2] << 8) | block[3];
+            unsigned int low = (block[4] << 24) | (block[5] << 16) | (block[6] << 8) | block[7];
+            bool flip = (high & 1) != 0;
+            int base[2][3];
+
+            if (high & 2)
+            {
+                // 555 base color and a signed 333 delta for the second sub block
+                for (int i = 0; i < 3; ++i)
+                {
+                    int c = (high >> (27 - i * 8)) & 0x1f;
+                    int d = (high >> (24 - i * 8)) & 0x7;
+                    d = d >= 4 ? d - 8 : d;
+                    int c2 = (c + d) & 0x1f;
+                    base[0][i] = (c << 3) | (c >> 2);
+                    base[1][i] = (c2 << 3) | (c2 >> 2);
+                }
+            }
+            else
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    int c = (high >> (28 - i * 8)) & 0xf;
+                    int c2 = (high >> (24 - i * 8)) & 0xf;
+                    base[0][i] = (c << 4) | c;
+                    base[1][i] = (c2 << 4) | c2;
+                }
+            }
+
+            const int* table[2] = { modifiers[(high >> 5) & 7], modifiers[(high >> 2) & 7] };
+
+            // pixel indices are column major, msb in the upper half of the low word
+            for (int x = 0; x < 4; ++x)
+            {
+                for (int y = 0; y < 4; ++y)
+                {
+                    int i = x * 4 + y;
+                    int sub = flip ? (y >> 1) : (x >> 1);
+                    int m = table[sub][(((low >> (i + 16)) & 1) << 1) | ((low >> i) & 1)];
+
+                    int r = Mathf::Clamp(base[sub][0] + m, 0, 255);
+                    int g = Mathf::Clamp(base[sub][1] + m, 0, 255);
+                    int b = Mathf::Clamp(base[sub][2] + m, 0, 255);
+                    texels[BlockTexelOffset(x, y)] = r | (g << 8) | (b << 16) | 0xff000000;
+                }
+            }
+        }
+
+        // decoded etc1 blocks keyed by block address and level serial, 4 way set associative with lru replacement
+        // in a set. contexts of a share group sample the same textures from their own threads, so each thread has its
+        // own cache shared by all textures. an upload gives its level a new serial, blocks cached for the replaced
+        // data of that level, or for freed data at the same address, no longer match and age out
+        class BlockCache
+        {
+        public:
+            static BlockCache& Current()
+            {
+                static thread_local BlockCache cache;
+                return cache;
+            }
+
+            // unique across the levels of all textures
+            static unsigned int NextSerial()
+            {
+                static std::atomic<unsigned int> serial(0);
+                return serial.fetch_add(1, std::memory_order_relaxed) + 1;
+            }
+
+            BlockCache()
+            {
+                this->Clear();
+            }
+
+            void Clear()
+            {
+                for (int i = 0; i < SETS; ++i)
+                {
+                    for (int j = 0; j < WAYS; ++j)
+                    {
+                        m_entries[i][j].block = nullptr;
+                        m_entries[i][j].serial = 0;
+                        m_entries[i][j].used = 0;
+                    }
+                }
+                m_clock = 0;
+            }
+
+            const unsigned int* Get(const byte* block, unsigned int serial)
+            {
+                // neighbour blocks of a row are 8 bytes apart and land in different sets
+                Entry* set = m_entries[((size_t) block >> 3) & (SETS - 1)];
+                Entry* victim = &set[0];
+                ++m_clock;
+
+                for (int i = 0; i < WAYS; ++i)
+                {
+                    if (set[i].block == block && set[i].serial == serial)
+                    {
+                        set[i].used = m_clock;
+                        return set[i].texels;
+                    }
+
+                    if (set[i].used < victim->used)
+                    {
+                        victim = &set[i];
+                    }
+                }
+
+                DecodeETC1(block, victim->texels);
+                victim->block = block;
+                victim->serial = serial;
+                victim->used = m_clock;
+                return victim->texels;
+            }
+
+        private:
+            enum
+            {
+                SETS = 16,
+                WAYS = 4,
+            };
+
+            struct Entry
+            {
+                const byte* block;
+                unsigned int serial;
+                unsigned int used;
+                unsigned int texels[16];
+            };
+
+            Entry m_entries[SETS][WAYS];
+            unsigned int m_clock;
+        };
+
+        struct FormatETC1
+        {
+            static unsigned int Load(const Level& level, int offset)
+            {
+#if SGL_TEXTURE_LINEAR
+                int pitch = level.tiles_x << 2;
+                int x = offset % pitch;
+                int y = offset / pitch;
+                const byte* block = &level.data[((y >> 2) * level.tiles_x + (x >> 2)) * 8];
+                return BlockCache::Current().Get(block, level.serial)[BlockTexelOffset(x, y)];
+#else
+                return BlockCache::Current().Get(&level.data[(offset >> 4) * 8], level.serial)[offset & 15];
+#endif
+            }
+
+            template<class T, class C>
+            static void Unpack(T t, C* rgba)
+            {
+                rgba[0] = Channel<0, 8>(t);
+                rgba[1] = Channel<8, 8>(t);
+                rgba[2] = Channel<16, 8>(t);
+                rgba[3] = One(t);
+            }
+        };
+
+        template<class Format>
+        static void Fetch(const Level& level, int offset, float* rgba)
+        {
+            Format::Unpack(Format::Load(level, offset), rgba);
+        }
+
+#if SGL_SSE2
+        template<class Format>
+        static void Gather(const Level& level, __m128i offsets, __m128* rgba)
+        {
+            int o[4];
+            _mm_storeu_si128((__m128i*) o, offsets);
+
+            __m128i t = _mm_set_epi32(Format::Load(level, o[3]), Format::Load(level, o[2]), Format::Load(level, o[1]), Format::Load(level, o[0]));
+            Format::Unpack(t, rgba);
+        }
+#endif
+
+        // up to BATCH_SIZE samples, groups of 4 go through sse2 and the rest lane by lane, colors planar
+        struct Batch
+        {
+            float u[BATCH_SIZE];
+            float v[BATCH_SIZE];
+            float color[4][BATCH_SIZE];
+        };
+
+        // samples lanes start to end - 1 of a batch
+        typedef void (*LevelSampler)(const Level& level, GLenum wrap_s, GLenum wrap_t, int start, int end, const float* u, const float* v, float (*color)[BATCH_SIZE]);
+
+        template<class Format>
+        static void SampleNearest(const Level& level, GLenum wrap_s, GLenum wrap_t, int start, int end, const float* u, const float* v, float (*color)[BATCH_SIZE])
+        {
+            int i = start;
+#if SGL_SSE2
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128i x = NearestIndex(_mm_loadu_ps(&u[i]), level.width, wrap_s);
+                __m128i y = NearestIndex(_mm_loadu_ps(&v[i]), level.height, wrap_t);
+
+                __m128 c[4];
+                Gather<Format>(level, _mm_add_epi32(TexelOffsetX(x), TexelOffsetY(y, level.tiles_x)), c);
+
+                for (int j = 0; j < 4; ++j)
+                {
+                    _mm_storeu_ps(&color[j][i], c[j]);
+                }
+            }
+#endif
+            for (; i < end; ++i)
+            {
+                int x = NearestIndex(u[i], level.width, wrap_s);
+                int y = NearestIndex(v[i], level.height, wrap_t);
+
+                float c[4];
+                Fetch<Format>(level, TexelOffsetX(x) + TexelOffsetY(y, level.tiles_x), c);
+
+                for (int j = 0; j < 4; ++j)
+                {
+                    color[j][i] = c[j];
+                }
+            }
+        }
+
+        template<class Format>
+        static void SampleLinear(const Level& level, GLenum wrap_s, GLenum wrap_t, int start, int end, const float* u, const float* v, float (*color)[BATCH_SIZE])
+        {
+            int i = start;
+#if SGL_SSE2
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128i x0, x1, y0, y1;
+                __m128 a, b;
+                LinearIndices(_mm_loadu_ps(&u[i]), level.width, wrap_s, x0, x1, a);
+                LinearIndices(_mm_loadu_ps(&v[i]), level.height, wrap_t, y0, y1, b);
+                x0 = TexelOffsetX(x0);
+                x1 = TexelOffsetX(x1);
+                y0 = TexelOffsetY(y0, level.tiles_x);
+                y1 = TexelOffsetY(y1, level.tiles_x);
+
+                __m128 c00[4], c10[4], c01[4], c11[4];
+                Gather<Format>(level, _mm_add_epi32(x0, y0), c00);
+                Gather<Format>(level, _mm_add_epi32(x1, y0), c10);
+                Gather<Format>(level, _mm_add_epi32(x0, y1), c01);
+                Gather<Format>(level, _mm_add_epi32(x1, y1), c11);
+
+                for (int j = 0; j < 4; ++j)
+                {
+                    __m128 top = _mm_add_ps(c00[j], _mm_mul_ps(_mm_sub_ps(c10[j], c00[j]), a));
+                    __m128 bottom = _mm_add_ps(c01[j], _mm_mul_ps(_mm_sub_ps(c11[j], c01[j]), a));
+                    _mm_storeu_ps(&color[j][i], _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), b)));
+                }
+            }
+#endif
+            for (; i < end; ++i)
+            {
+                int x0, x1, y0, y1;
+                float a, b;
+                LinearIndices(u[i], level.width, wrap_s, x0, x1, a);
+                LinearIndices(v[i], level.height, wrap_t, y0, y1, b);
+                x0 = TexelOffsetX(x0);
+                x1 = TexelOffsetX(x1);
+                y0 = TexelOffsetY(y0, level.tiles_x);
+                y1 = TexelOffsetY(y1, level.tiles_x);
+
+                float c00[4], c10[4], c01[4], c11[4];
+                Fetch<Format>(level, x0 + y0, c00);
+                Fetch<Format>(level, x1 + y0, c10);
+                Fetch<Format>(level, x0 + y1, c01);
+                Fetch<Format>(level, x1 + y1, c11);
+
+                for (int j = 0; j < 4; ++j)
+                {
+                    float top = c00[j] + (c10[j] - c00[j]) * a;
+                    float bottom = c01[j] + (c11[j] - c01[j]) * a;
+                    color[j][i] = top + (bottom - top) * b;
+                }
+            }
+        }
+
+        void SampleLevel(int level, bool linear, Batch& batch, int start, int end, float (*color)[BATCH_SIZE]) const
+        {
+            const Level& l = m_levels[level];
+            LevelSampler sampler = linear ? l.format->sample_linear : l.format->sample_nearest;
+            sampler(l, m_p->m_wrap_s, m_p->m_wrap_t, start, end, batch.u, batch.v, color);
+        }
+
+        enum
+        {
+            SELECT_LINEAR = 1,
+            SELECT_BLEND = 2,
+            SELECT_LEVEL_SHIFT = 2,
+        };
+
+        // the level a lod samples, the filter in it, and whether the next level is blended in by the lod's fraction
+        int Select(float lod) const
+        {
+            GLenum min_filter = m_p->m_min_filter;
+            GLenum mag_filter = m_p->m_mag_filter;
+
+            // switch over point from magnification to minification
+            float c = 0;
+            if (mag_filter == GL_LINEAR && (min_filter == GL_NEAREST_MIPMAP_NEAREST || min_filter == GL_NEAREST_MIPMAP_LINEAR))
+            {
+                c = 0.5f;
+            }
+
+            if (lod <= c)
+            {
+                return mag_filter == GL_LINEAR ? SELECT_LINEAR : 0;
+            }
+            else if (IsMipmapFilter(min_filter) == false)
+            {
+                return min_filter == GL_LINEAR ? SELECT_LINEAR : 0;
+            }
+
+            int max_level = GetMipmapLevelCount(m_levels[0].width, m_levels[0].height) - 1;
+            int linear = min_filter == GL_LINEAR_MIPMAP_NEAREST || min_filter == GL_LINEAR_MIPMAP_LINEAR ? SELECT_LINEAR : 0;
+
+            if (min_filter == GL_NEAREST_MIPMAP_NEAREST || min_filter == GL_LINEAR_MIPMAP_NEAREST)
+            {
+                int level = lod <= 0.5f ? 0 : (int) ceilf(lod + 0.5f) - 1;
+                return (Mathf::Min(level, max_level) << SELECT_LEVEL_SHIFT) | linear;
+            }
+
+            int level = (int) lod;
+            if (level >= max_level)
+            {
+                return (max_level << SELECT_LEVEL_SHIFT) | linear;
+            }
+            return (level << SELECT_LEVEL_SHIFT) | linear | SELECT_BLEND;
+        }
+
+        // each lane at its own lod, runs of lanes selecting the same levels are sampled together
+        void Sample(Batch& batch, int count, const float* lods) const
+        {
+            if (m_complete == false)
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    batch.color[0][i] = 0;
+                    batch.color[1][i] = 0;
+                    batch.color[2][i] = 0;
+                    batch.color[3][i] = 1;
+                }
+                return;
+            }
+
+            int selects[BATCH_SIZE];
+            for (int i = 0; i < count; ++i)
+            {
+                selects[i] = this->Select(lods[i]);
+            }
+
+            int start = 0;
+            while (start < count)
+            {
+                int select = selects[start];
+                int end = start + 1;
+                while (end < count && selects[end] == select)
+                {
+                    ++end;
+                }
+
+                int level = select >> SELECT_LEVEL_SHIFT;
+                bool linear = (select & SELECT_LINEAR) != 0;
+                this->SampleLevel(level, linear, batch, start, end, batch.color);
+
+                if (select & SELECT_BLEND)
+                {
+                    float next[4][BATCH_SIZE];
+                    this->SampleLevel(level + 1, linear, batch, start, end, next);
+
+                    for (int j = 0; j < 4; ++j)
+                    {
+                        for (int i = start; i < end; ++i)
+                        {
+                            float t = lods[i] - level;
+                            batch.color[j][i] += (next[j][i] - batch.color[j][i]) * t;
+                        }
+                    }
+                }
+
+                start = end;
+            }
+        }
+
+        // colors are returned planar
+        void SampleBatch(int count, const float* u, const float* v, const float* lods, float* r, float* g, float* b, float* a) const
+        {
+            Batch batch;
+            for (int i = 0; i < count; ++i)
+            {
+                batch.u[i] = u[i];
+                batch.v[i] = v[i];
+            }
+
+            this->Sample(batch, count, lods);
+
+            for (int i = 0; i < count; ++i)
+            {
+                r[i] = batch.color[0][i];
+                g[i] = batch.color[1][i];
+                b[i] = batch.color[2][i];
+                a[i] = batch.color[3][i];
+            }
+        }
+
+        float ComputeLod(const Vector2& ddx, const Vector2& ddy) const
+        {
+            float w = (float) m_levels[0].width;
+            float h = (float) m_levels[0].height;
+            float dx = ddx.x * w * ddx.x * w + ddx.y * h * ddx.y * h;
+            float dy = ddy.x * w * ddy.x * w + ddy.y * h * ddy.y * h;
+            float rho2 = Mathf::Max(dx, dy);
+
+            if (rho2 <= 0)
+            {
+                return -1.0f;
+            }
+
+            return 0.5f * Mathf::Log2(rho2);
+        }
+
+#if SGL_SSE2
+        // 8 rgba8 source texels of both rows to 4 dest texels per step, returns the dest texels done
+        static int DownSampleRowRGBA8(const byte* row0, const byte* row1, byte* out, int src_width)
+        {
+            __m128i zero = _mm_setzero_si128();
+            __m128i round = _mm_set1_epi16(2);
+            int x = 0;
+            for (; (x + 4) * 2 <= src_width; x += 4)
+            {
+                __m128i a0 = _mm_loadu_si128((const __m128i*) &row0[x * 8]);
+                __m128i a1 = _mm_loadu_si128((const __m128i*) &row0[x * 8 + 16]);
+                __m128i b0 = _mm_loadu_si128((const __m128i*) &row1[x * 8]);
+                __m128i b1 = _mm_loadu_si128((const __m128i*) &row1[x * 8 + 16]);
+
+                __m128i v0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+                __m128i v1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+                __m128i v2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+                __m128i v3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+                __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(v0, v1), _mm_unpackhi_epi64(v0, v1));
+                __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(v2, v3), _mm_unpackhi_epi64(v2, v3));
+                h0 = _mm_srli_epi16(_mm_add_epi16(h0, round), 2);
+                h1 = _mm_srli_epi16(_mm_add_epi16(h1, round), 2);
+
+                _mm_storeu_si128((__m128i*) &out[x * 4], _mm_packus_epi16(h0, h1));
+            }
+            return x;
+        }
+#endif
+
+        // 2x2 box filter on linear images, the last row or column of an odd sized level is dropped
+        template<class Format>
+        static void DownSample(const byte* src, int src_width, int src_height, byte* dest, int dest_width, int dest_height)
+        {
+            typedef typename Format::Texel Texel;
+
+            for (int y = 0; y < dest_height; ++y)
+            {
+                int y0 = Mathf::Min(y * 2, src_height - 1);
+                int y1 = Mathf::Min(y * 2 + 1, src_height - 1);
+                const Texel* row0 = &((const Texel*) src)[y0 * src_width];
+                const Texel* row1 = &((const Texel*) src)[y1 * src_width];
+                Texel* out = &((Texel*) dest)[y * dest_width];
+                int x = 0;
+
+#if SGL_SSE2
+                if (std::is_same<Format, FormatRGBA8>::value)
+                {
+                    x = DownSampleRowRGBA8((const byte*) row0, (const byte*) row1, (byte*) out, src_width);
+                }
+#endif
+
+                for (; x < dest_width; ++x)
+                {
+                    int x0 = Mathf::Min(x * 2, src_width - 1);
+                    int x1 = Mathf::Min(x * 2 + 1, src_width - 1);
+
+                    unsigned int t[4] = { LoadTexel(row0[x0]), LoadTexel(row0[x1]), LoadTexel(row1[x0]), LoadTexel(row1[x1]) };
+                    StoreTexel(Format::Average(t), out[x]);
+                }
+            }
+        }
+
+        // kernels of one upload format and type, picked when a level is specified
+        struct FormatInfo
+        {
+            GLenum format;
+            GLenum type;
+            int texel_size;
+            int tile_size;
+            LevelSampler sample_nearest;
+            LevelSampler sample_linear;
+            void (*tile_rect)(const byte* pixels, int row_pitch, Level& level, int x, int y, int width, int height);
+            void (*untile)(const Level& level, byte* pixels, int row_pitch);
+            void (*down_sample)(const byte* src, int src_width, int src_height, byte* dest, int dest_width, int dest_height);
+        };
+
+        template<class Format>
+        static FormatInfo MakeFormatInfo(GLenum format, GLenum type)
+        {
+            typedef typename Format::Texel Texel;
+
+            FormatInfo info = {
+                format,
+                type,
+                (int) sizeof(Texel),
+                (int) sizeof(Texel) * 16,
+                SampleNearest<Format>,
+                SampleLinear<Format>,
+                TileRect<Texel>,
+                UntileLevel<Texel>,
+                DownSample<Format>,
+            };
+            return info;
+        }
+
+        static const FormatInfo* FindFormat(GLenum format, GLenum type)
+        {
+            static const FormatInfo formats[] = {
+                MakeFormatInfo<FormatRGBA8>(GL_RGBA, GL_UNSIGNED_BYTE),
+                MakeFormatInfo<FormatRGB8>(GL_RGB, GL_UNSIGNED_BYTE),
+                MakeFormatInfo<FormatRGB565>(GL_RGB, GL_UNSIGNED_SHORT_5_6_5),
+                MakeFormatInfo<FormatRGBA4444>(GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4),
+                MakeFormatInfo<FormatRGBA5551>(GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1),
+                MakeFormatInfo<FormatLuminanceAlpha8>(GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE),
+                MakeFormatInfo<FormatLuminance8>(GL_LUMINANCE, GL_UNSIGNED_BYTE),
+                MakeFormatInfo<FormatAlpha8>(GL_ALPHA, GL_UNSIGNED_BYTE),
+            };
+
+            for (const auto& i : formats)
+            {
+                if (i.format == format && i.type == type)
+                {
+                    return &i;
+                }
+            }
+
+            return nullptr;
+        }
+
+        // compressed levels have no linear layout, neither tiling nor mipmap generation applies
+        static const FormatInfo* FindCompressedFormat(GLenum internalformat)
+        {
+            static const FormatInfo etc1 = {
+                GL_ETC1_RGB8_OES,
+                0,
+                0,
+                8,
+                SampleNearest<FormatETC1>,
+                SampleLinear<FormatETC1>,
+                nullptr,
+                nullptr,
+                nullptr,
+            };
+
+            if (internalformat == etc1.format)
+            {
+                return &etc1;
+            }
+
+            return nullptr;
+        }
+
+        bool IsRenderable() const
+        {
+            return m_levels.Size() > 0 && m_levels[0].data != nullptr && m_levels[0].format == FindFormat(GL_RGBA, GL_UNSIGNED_BYTE);
+        }
+
+        // the render buffer is a linear copy of level 0 laid out like the default framebuffer, window row y is texel row y,
+        // it is tiled back into level 0 before the texture is read after rendering. contexts of a share group may render
+        // to the texture and sample it from different threads, the buffer state changes under the texture's lock
+        byte* GetRenderBuffer()
+        {
+            std::lock_guard<std::mutex> lock(m_render_buffer_mutex);
+
+            if (this->IsRenderable() == false)
+            {
+                return nullptr;
+            }
+
+            if (m_render_buffer_valid == false)
+            {
+                const Level& level = m_levels[0];
+                int pitch = level.width * 4;
+                m_render_buffer = Memory::Realloc(m_render_buffer, pitch * level.height);
+                level.format->untile(level, m_render_buffer, pitch);
+                m_render_buffer_valid = true;
+            }
+
+            m_render_buffer_dirty = true;
+            return m_render_buffer;
+        }
+
+        void ResolveRenderBuffer()
+        {
+            std::lock_guard<std::mutex> lock(m_render_buffer_mutex);
+
+            if (m_render_buffer_dirty)
+            {
+                Level& level = m_levels[0];
+                int pitch = level.width * 4;
+                level.format->tile_rect(m_render_buffer, pitch, level, 0, 0, level.width, level.height);
+                m_render_buffer_dirty = false;
+            }
+        }
+
+        // level 0 changed outside of rendering
+        void InvalidateRenderBuffer()
+        {
+            std::lock_guard<std::mutex> lock(m_render_buffer_mutex);
+
+            m_render_buffer_valid = false;
+            m_render_buffer_dirty = false;
         }
 
         GLTexture2D* m_p;
-        byte* m_data;
+        Vector<Level> m_levels;
+        bool m_complete;
+        byte* m_render_buffer;
+        bool m_render_buffer_valid;
+        bool m_render_buffer_dirty;
+        std::mutex m_render_buffer_mutex;
     };
 
     GLTexture2D::GLTexture2D(GLuint id):
-        GLTexture(id),
+        GLTexture(id, GL_TEXTURE_2D),
         m_width(0),
         m_height(0),
         m_internalformat(0),
         m_format(0),
-        m_type(0)
+        m_type(0),
+        m_min_filter(GL_NEAREST_MIPMAP_LINEAR),
+        m_mag_filter(GL_LINEAR),
+        m_wrap_s(GL_REPEAT),
+        m_wrap_t(GL_REPEAT)
     {
         m_private = new GLTexture2DPrivate(this);
     }
@@ -57,35 +1190,256 @@ namespace sgl
         delete m_private;
     }
 
-    void GLTexture2D::TexImage2D(GLint level, GLint internalformat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+    void GLTexture2D::TexImage2D(GLint level, GLint internalformat, GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpack_alignment, const void* pixels)
     {
-        if (internalformat == GL_RGBA && format == GL_RGBA && type == GL_UNSIGNED_BYTE)
+        if (level < 0 || width < 0 || height < 0)
         {
-            m_width = width;
-            m_height = height;
-            m_internalformat = internalformat;
-            m_format = format;
-            m_type = type;
+            return;
+        }
+
+        // internal format has to match the upload format in gles2, no conversion happens
+        const GLTexture2DPrivate::FormatInfo* info = GLTexture2DPrivate::FindFormat(format, type);
+        if (info != nullptr && internalformat == (GLint) format)
+        {
+            if (level == 0)
+            {
+                m_private->InvalidateRenderBuffer();
+                m_width = width;
+                m_height = height;
+                m_internalformat = internalformat;
+                m_format = format;
+                m_type = type;
+            }
 
-            int size = width * height * 4;
-            m_private->m_data = Memory::Realloc(m_private->m_data, size);
+            GLTexture2DPrivate::Level& dest = m_private->SpecifyLevel(level, width, height, info);
             if (pixels)
             {
-                Memory::Copy(m_private->m_data, pixels, size);
+                int row_pitch = GLTexture2DPrivate::GetRowPitch(width, info->texel_size, unpack_alignment);
+                info->tile_rect((const byte*) pixels, row_pitch, dest, 0, 0, width, height);
+            }
+
+            m_private->UpdateCompleteness();
+        }
+    }
+
+    int GLTexture2D::GetImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpack_alignment)
+    {
+        const GLTexture2DPrivate::FormatInfo* info = GLTexture2DPrivate::FindFormat(format, type);
+        if (info == nullptr || width <= 0 || height <= 0)
+        {
+            return 0;
+        }
+
+        // the last row is not padded
+        return GLTexture2DPrivate::GetRowPitch(width, info->texel_size, unpack_alignment) * (height - 1) + width * info->texel_size;
+    }
+
+    void GLTexture2D::TexSubImage2D(GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpack_alignment, const void* pixels)
+    {
+        auto& levels = m_private->m_levels;
+        if (level < 0 || level >= levels.Size() || levels[level].data == nullptr || pixels == nullptr)
+        {
+            return;
+        }
+
+        // only the texels of the rect in this level are written, other levels and the completeness stay as they are
+        GLTexture2DPrivate::Level& dest = levels[level];
+        const GLTexture2DPrivate::FormatInfo* info = GLTexture2DPrivate::FindFormat(format, type);
+        if (info != nullptr && info == dest.format &&
+            xoffset >= 0 && yoffset >= 0 && width >= 0 && height >= 0 &&
+            xoffset + width <= dest.width && yoffset + height <= dest.height)
+        {
+            if (level == 0)
+            {
+                m_private->ResolveRenderBuffer();
+                m_private->InvalidateRenderBuffer();
+            }
+
+            int row_pitch = GLTexture2DPrivate::GetRowPitch(width, info->texel_size, unpack_alignment);
+            info->tile_rect((const byte*) pixels, row_pitch, dest, xoffset, yoffset, width, height);
+        }
+    }
+
+    void GLTexture2D::CompressedTexImage2D(GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei image_size, const void* data)
+    {
+        if (level < 0 || width < 0 || height < 0)
+        {
+            return;
+        }
+
+        const GLTexture2DPrivate::FormatInfo* info = GLTexture2DPrivate::FindCompressedFormat(internalformat);
+        if (info != nullptr && image_size == GLTexture2DPrivate::GetTiledSize(width, height, info->tile_size))
+        {
+            if (level == 0)
+            {
+                m_private->InvalidateRenderBuffer();
+                m_width = width;
+                m_height = height;
+                m_internalformat = internalformat;
+                m_format = internalformat;
+                m_type = 0;
             }
+
+            // blocks are already in tile order, a new serial keeps the caches from returning blocks of the replaced data
+            GLTexture2DPrivate::Level& dest = m_private->SpecifyLevel(level, width, height, info);
+            if (data)
+            {
+                Memory::Copy(dest.data, data, image_size);
+            }
+            dest.serial = GLTexture2DPrivate::BlockCache::NextSerial();
+
+            m_private->UpdateCompleteness();
+        }
+    }
+
+    void GLTexture2D::GenerateMipmap()
+    {
+        auto& levels = m_private->m_levels;
+        if (levels.Size() == 0 || levels[0].data == nullptr)
+        {
+            return;
+        }
+
+        m_private->ResolveRenderBuffer();
+
+        // compressed levels can't be filtered, as in gles2
+        const GLTexture2DPrivate::FormatInfo* info = levels[0].format;
+        if (info->down_sample == nullptr)
+        {
+            return;
+        }
+
+        int level_count = GLTexture2DPrivate::GetMipmapLevelCount(levels[0].width, levels[0].height);
+        while (levels.Size() < level_count)
+        {
+            levels.Add({ 0, 0, 0, nullptr, nullptr, 0 });
+        }
+
+        // filter in linear layout, each level is tiled once it is built
+        byte* src = Memory::Alloc<byte>(levels[0].width * levels[0].height * info->texel_size);
+        byte* dest = Memory::Alloc<byte>(Mathf::Max(1, levels[0].width >> 1) * Mathf::Max(1, levels[0].height >> 1) * info->texel_size);
+        info->untile(levels[0], src, levels[0].width * info->texel_size);
+
+        for (int i = 1; i < level_count; ++i)
+        {
+            const GLTexture2DPrivate::Level& prev = levels[i - 1];
+            GLTexture2DPrivate::Level& level = levels[i];
+            GLTexture2DPrivate::AllocLevel(level, Mathf::Max(1, levels[0].width >> i), Mathf::Max(1, levels[0].height >> i), info);
+
+            info->down_sample(src, prev.width, prev.height, dest, level.width, level.height);
+            info->tile_rect(dest, level.width * info->texel_size, level, 0, 0, level.width, level.height);
+
+            std::swap(src, dest);
+        }
+
+        Memory::Free(src);
+        Memory::Free(dest);
+
+        m_private->UpdateCompleteness();
+    }
+
+    void GLTexture2D::SetParameter(GLenum pname, GLint param)
+    {
+        switch (pname)
+        {
+            case GL_TEXTURE_MIN_FILTER:
+                if (param == GL_NEAREST || param == GL_LINEAR || GLTexture2DPrivate::IsMipmapFilter(param))
+                {
+                    m_min_filter = param;
+                    m_private->UpdateCompleteness();
+                }
+                break;
+            case GL_TEXTURE_MAG_FILTER:
+                if (param == GL_NEAREST || param == GL_LINEAR)
+                {
+                    m_mag_filter = param;
+                }
+                break;
+            case GL_TEXTURE_WRAP_S:
+            case GL_TEXTURE_WRAP_T:
+                if (param == GL_REPEAT || param == GL_CLAMP_TO_EDGE || param == GL_MIRRORED_REPEAT)
+                {
+                    if (pname == GL_TEXTURE_WRAP_S)
+                    {
+                        m_wrap_s = param;
+                    }
+                    else
+                    {
+                        m_wrap_t = param;
+                    }
+                }
+                break;
         }
     }
 
-    Vector4 GLTexture2D::Sample(const Vector2& uv) const
+    GLint GLTexture2D::GetParameter(GLenum pname) const
+    {
+        switch (pname)
+        {
+            case GL_TEXTURE_MIN_FILTER:
+                return m_min_filter;
+            case GL_TEXTURE_MAG_FILTER:
+                return m_mag_filter;
+            case GL_TEXTURE_WRAP_S:
+                return m_wrap_s;
+            case GL_TEXTURE_WRAP_T:
+                return m_wrap_t;
+        }
+
+        return 0;
+    }
+
+    bool GLTexture2D::IsRenderable() const
+    {
+        return m_private->IsRenderable();
+    }
+
+    unsigned char* GLTexture2D::GetRenderBuffer()
+    {
+        return m_private->GetRenderBuffer();
+    }
+
+    void GLTexture2D::ResolveRenderBuffer()
+    {
+        m_private->ResolveRenderBuffer();
+    }
+
+    void GLTexture2D::SampleBatch(int count, const float* u, const float* v, const Vector2& ddx, const Vector2& ddy, float* r, float* g, float* b, float* a) const
+    {
+        assert(count > 0 && count <= BATCH_SIZE);
+
+        float lods[BATCH_SIZE];
+        float lod = m_private->ComputeLod(ddx, ddy);
+        for (int i = 0; i < count; ++i)
+        {
+            lods[i] = lod;
+        }
+
+        m_private->SampleBatch(count, u, v, lods, r, g, b, a);
+    }
+
+    void GLTexture2D::SampleBatch(int count, const float* u, const float* v, const Vector2* ddx, const Vector2* ddy, float* r, float* g, float* b, float* a) const
+    {
+        assert(count > 0 && count <= BATCH_SIZE);
+
+        float lods[BATCH_SIZE];
+        for (int i = 0; i < count; ++i)
+        {
+            lods[i] = m_private->ComputeLod(ddx[i], ddy[i]);
+        }
+
+        m_private->SampleBatch(count, u, v, lods, r, g, b, a);
+    }
+
+    Vector4 GLTexture2D::Sample(const Vector2& uv, const Vector2& ddx, const Vector2& ddy) const
     {
-        int x = (int) ((m_width - 1) * Mathf::Clamp01(uv.x));
-        int y = (int) ((m_height - 1) * Mathf::Clamp01(uv.y));
+        GLTexture2DPrivate::Batch batch;
+        batch.u[0] = uv.x;
+        batch.v[0] = uv.y;
 
-        int r = m_private->m_data[y * m_width * 4 + x * 4 + 0];
-        int g = m_private->m_data[y * m_width * 4 + x * 4 + 1];
-        int b = m_private->m_data[y * m_width * 4 + x * 4 + 2];
-        int a = m_private->m_data[y * m_width * 4 + x * 4 + 3];
+        float lod = m_private->ComputeLod(ddx, ddy);
+        m_private->Sample(batch, 1, &lod);
 
-        return Vector4(r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f);
+        return Vector4(batch.color[0][0], batch.color[1][0], batch.color[2][0], batch.color[3][0]);
     }
 }
@@ -27,13 +27,37 @@ namespace sgl
     class GLTexture2D: public GLTexture
     {
     public:
+        enum
+        {
+            BATCH_SIZE = 16
+        };
+
         GLTexture2D(GLuint id);
         virtual ~GLTexture2D();
 
-        void TexImage2D(GLint level, GLint internalformat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+        void TexImage2D(GLint level, GLint internalformat, GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpack_alignment, const void* pixels);
+        void TexSubImage2D(GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpack_alignment, const void* pixels);
+        void CompressedTexImage2D(GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei image_size, const void* data);
+        void GenerateMipmap();
+        void SetParameter(GLenum pname, GLint param);
+        GLint GetParameter(GLenum pname) const;
         int GetWidth() const { return m_width; }
         int GetHeight() const { return m_height; }
-        Viry3D::Vector4 Sample(const Viry3D::Vector2& uv) const;
+        // level 0 in rgba8 can be a color attachment
+        bool IsRenderable() const;
+        // linear rgba8 color buffer of level 0, taken back into the texture layout by ResolveRenderBuffer
+        unsigned char* GetRenderBuffer();
+        // tiles the pixels rendered since GetRenderBuffer back into level 0, before a draw samples the texture
+        void ResolveRenderBuffer();
+        // ddx and ddy are the screen space derivatives of uv, zero when unknown. level 0 is read as last resolved
+        Viry3D::Vector4 Sample(const Viry3D::Vector2& uv, const Viry3D::Vector2& ddx, const Viry3D::Vector2& ddy) const;
+        // samples a quad or a span of up to BATCH_SIZE fragments sharing one lod, colors are returned planar
+        void SampleBatch(int count, const float* u, const float* v, const Viry3D::Vector2& ddx, const Viry3D::Vector2& ddy, float* r, float* g, float* b, float* a) const;
+        // each fragment with its own derivatives, fragments in a row that select the same levels are sampled together
+        void SampleBatch(int count, const float* u, const float* v, const Viry3D::Vector2* ddx, const Viry3D::Vector2* ddy, float* r, float* g, float* b, float* a) const;
+        // bytes of a client image in an upload format, rows start at multiples of unpack_alignment.
+        // 0 for formats that cannot be uploaded
+        static int GetImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint unpack_alignment);
 
     private:
         friend class GLTexture2DPrivate;
@@ -43,5 +67,9 @@ namespace sgl
         GLint m_internalformat;
         GLenum m_format;
         GLenum m_type;
+        GLenum m_min_filter;
+        GLenum m_mag_filter;
+        GLenum m_wrap_s;
+        GLenum m_wrap_t;
     };
 }
@@ -0,0 +1,911 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLTileBuffer.h"
+#include "GLSimd.h"
+#include "memory/Memory.h"
+#include "math/Mathf.h"
+
+using namespace Viry3D;
+
+namespace sgl
+{
+    // count 32 bit values, color and depth clears both go through here
+    static void Fill32(void* dest, const void* value, int count)
+    {
+        unsigned int v;
+        Memory::Copy(&v, value, 4);
+
+        unsigned int* p = (unsigned int*) dest;
+        int i = 0;
+#if SGL_SSE2
+        __m128i v4 = _mm_set1_epi32((int) v);
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm_storeu_si128((__m128i*) &p[i + 0], v4);
+            _mm_storeu_si128((__m128i*) &p[i + 4], v4);
+            _mm_storeu_si128((__m128i*) &p[i + 8], v4);
+            _mm_storeu_si128((__m128i*) &p[i + 12], v4);
+        }
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_si128((__m128i*) &p[i], v4);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            p[i] = v;
+        }
+    }
+
+    // count 16 bit values, unorm16 depth clears
+    static void Fill16(unsigned short* dest, unsigned short value, int count)
+    {
+        int i = 0;
+#if SGL_SSE2
+        __m128i v8 = _mm_set1_epi16((short) value);
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm_storeu_si128((__m128i*) &dest[i], v8);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = value;
+        }
+    }
+
+    // count 32 bit values, the bits outside the mask are kept
+    static void FillMasked32(unsigned int* dest, unsigned int value, unsigned int mask, int count)
+    {
+        value &= mask;
+
+        int i = 0;
+#if SGL_SSE2
+        __m128i v4 = _mm_set1_epi32((int) value);
+        __m128i mask4 = _mm_set1_epi32((int) mask);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i d = _mm_loadu_si128((const __m128i*) &dest[i]);
+            _mm_storeu_si128((__m128i*) &dest[i], _mm_or_si128(_mm_andnot_si128(mask4, d), v4));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = (dest[i] & ~mask) | value;
+        }
+    }
+
+    // depth of 24_8 words to tile values
+    static void UnpackDepth24(unsigned int* dest, const unsigned int* src, int count)
+    {
+        int i = 0;
+#if SGL_SSE2
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i*) &src[i]);
+            _mm_storeu_si128((__m128i*) &dest[i], _mm_srli_epi32(s, 8));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = src[i] >> 8;
+        }
+    }
+
+    // tile values into the depth of 24_8 words, their stencil is kept
+    static void PackDepth24(unsigned int* dest, const unsigned int* src, int count)
+    {
+        int i = 0;
+#if SGL_SSE2
+        __m128i stencil_mask = _mm_set1_epi32(0xff);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i*) &src[i]);
+            __m128i d = _mm_loadu_si128((const __m128i*) &dest[i]);
+            _mm_storeu_si128((__m128i*) &dest[i], _mm_or_si128(_mm_slli_epi32(s, 8), _mm_and_si128(d, stencil_mask)));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = (src[i] << 8) | (dest[i] & 0xff);
+        }
+    }
+
+    // stencil of 24_8 words to tile values
+    static void UnpackStencil8(unsigned char* dest, const unsigned int* src, int count)
+    {
+        int i = 0;
+#if SGL_SSE2
+        __m128i stencil_mask = _mm_set1_epi32(0xff);
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i s0 = _mm_and_si128(_mm_loadu_si128((const __m128i*) &src[i + 0]), stencil_mask);
+            __m128i s1 = _mm_and_si128(_mm_loadu_si128((const __m128i*) &src[i + 4]), stencil_mask);
+            __m128i s2 = _mm_and_si128(_mm_loadu_si128((const __m128i*) &src[i + 8]), stencil_mask);
+            __m128i s3 = _mm_and_si128(_mm_loadu_si128((const __m128i*) &src[i + 12]), stencil_mask);
+            __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(s0, s1), _mm_packs_epi32(s2, s3));
+            _mm_storeu_si128((__m128i*) &dest[i], bytes);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = (unsigned char) src[i];
+        }
+    }
+
+    // tile values into the stencil of 24_8 words, their depth is kept
+    static void PackStencil8(unsigned int* dest, const unsigned char* src, int count)
+    {
+        int i = 0;
+#if SGL_SSE2
+        __m128i zero = _mm_setzero_si128();
+        __m128i depth_mask = _mm_set1_epi32((int) 0xffffff00);
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) &src[i]);
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            __m128i s[4] = {
+                _mm_unpacklo_epi16(lo, zero),
+                _mm_unpackhi_epi16(lo, zero),
+                _mm_unpacklo_epi16(hi, zero),
+                _mm_unpackhi_epi16(hi, zero),
+            };
+            for (int j = 0; j < 4; ++j)
+            {
+                __m128i d = _mm_loadu_si128((const __m128i*) &dest[i + j * 4]);
+                _mm_storeu_si128((__m128i*) &dest[i + j * 4], _mm_or_si128(_mm_and_si128(d, depth_mask), s[j]));
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            dest[i] = (dest[i] & 0xffffff00) | src[i];
+        }
+    }
+
+    // box filter of MAX_SAMPLES sample planes of rgba8 pixels, rounded to nearest
+    static void ResolveColor(unsigned char* dest, const unsigned char* src, int count)
+    {
+        const int plane = GLTileBuffer::TILE_PIXELS * 4;
+        const int n = count * 4;
+
+        int i = 0;
+#if SGL_SSE2
+        __m128i zero = _mm_setzero_si128();
+        __m128i two = _mm_set1_epi16(2);
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i sum_lo = two;
+            __m128i sum_hi = two;
+            for (int j = 0; j < GLTileBuffer::MAX_SAMPLES; ++j)
+            {
+                __m128i s = _mm_loadu_si128((const __m128i*) &src[j * plane + i]);
+                sum_lo = _mm_add_epi16(sum_lo, _mm_unpacklo_epi8(s, zero));
+                sum_hi = _mm_add_epi16(sum_hi, _mm_unpackhi_epi8(s, zero));
+            }
+            __m128i average = _mm_packus_epi16(_mm_srli_epi16(sum_lo, 2), _mm_srli_epi16(sum_hi, 2));
+            _mm_storeu_si128((__m128i*) &dest[i], average);
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            int sum = 2;
+            for (int j = 0; j < GLTileBuffer::MAX_SAMPLES; ++j)
+            {
+                sum += src[j * plane + i];
+            }
+            dest[i] = (unsigned char) (sum >> 2);
+        }
+    }
+
+    static void RowBounds(const float* row, int w, float& depth_min, float& depth_max)
+    {
+        int j = 0;
+#if SGL_SSE2
+        if (w >= 4)
+        {
+            __m128 min4 = _mm_loadu_ps(row);
+            __m128 max4 = min4;
+            for (j = 4; j + 4 <= w; j += 4)
+            {
+                __m128 d = _mm_loadu_ps(&row[j]);
+                min4 = _mm_min_ps(min4, d);
+                max4 = _mm_max_ps(max4, d);
+            }
+            float mins[4];
+            float maxs[4];
+            _mm_storeu_ps(mins, min4);
+            _mm_storeu_ps(maxs, max4);
+            for (int k = 0; k < 4; ++k)
+            {
+                depth_min = Mathf::Min(depth_min, mins[k]);
+                depth_max = Mathf::Max(depth_max, maxs[k]);
+            }
+        }
+#endif
+        for (; j < w; ++j)
+        {
+            depth_min = Mathf::Min(depth_min, row[j]);
+            depth_max = Mathf::Max(depth_max, row[j]);
+        }
+    }
+
+    static void RowBounds(const unsigned short* row, int w, unsigned int& depth_min, unsigned int& depth_max)
+    {
+        int j = 0;
+#if SGL_SSE2
+        if (w >= 8)
+        {
+            // flipping the sign bit makes the signed min and max order unsigned values
+            __m128i sign = _mm_set1_epi16((short) 0x8000);
+            __m128i min8 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) row), sign);
+            __m128i max8 = min8;
+            for (j = 8; j + 8 <= w; j += 8)
+            {
+                __m128i d = _mm_xor_si128(_mm_loadu_si128((const __m128i*) &row[j]), sign);
+                min8 = _mm_min_epi16(min8, d);
+                max8 = _mm_max_epi16(max8, d);
+            }
+            unsigned short mins[8];
+            unsigned short maxs[8];
+            _mm_storeu_si128((__m128i*) mins, _mm_xor_si128(min8, sign));
+            _mm_storeu_si128((__m128i*) maxs, _mm_xor_si128(max8, sign));
+            for (int k = 0; k < 8; ++k)
+            {
+                depth_min = Mathf::Min(depth_min, (unsigned int) mins[k]);
+                depth_max = Mathf::Max(depth_max, (unsigned int) maxs[k]);
+            }
+        }
+#endif
+        for (; j < w; ++j)
+        {
+            depth_min = Mathf::Min(depth_min, (unsigned int) row[j]);
+            depth_max = Mathf::Max(depth_max, (unsigned int) row[j]);
+        }
+    }
+
+    static void RowBounds(const unsigned int* row, int w, unsigned int& depth_min, unsigned int& depth_max)
+    {
+        int j = 0;
+#if SGL_SSE2
+        if (w >= 4)
+        {
+            // 24 bit values order the same as signed ints
+            __m128i min4 = _mm_loadu_si128((const __m128i*) row);
+            __m128i max4 = min4;
+            for (j = 4; j + 4 <= w; j += 4)
+            {
+                __m128i d = _mm_loadu_si128((const __m128i*) &row[j]);
+                min4 = Simd::Select(_mm_cmplt_epi32(d, min4), d, min4);
+                max4 = Simd::Select(_mm_cmpgt_epi32(d, max4), d, max4);
+            }
+            unsigned int mins[4];
+            unsigned int maxs[4];
+            _mm_storeu_si128((__m128i*) mins, min4);
+            _mm_storeu_si128((__m128i*) maxs, max4);
+            for (int k = 0; k < 4; ++k)
+            {
+                depth_min = Mathf::Min(depth_min, mins[k]);
+                depth_max = Mathf::Max(depth_max, maxs[k]);
+            }
+        }
+#endif
+        for (; j < w; ++j)
+        {
+            depth_min = Mathf::Min(depth_min, row[j]);
+            depth_max = Mathf::Max(depth_max, row[j]);
+        }
+    }
+
+    GLTileBuffer::GLTileBuffer():
+        m_color_buffer(nullptr),
+        m_depth_buffer(nullptr),
+        m_depth_format(GL_DEPTH_COMPONENT32_OES),
+        m_stencil_buffer(nullptr),
+        m_samples(1),
+        m_width(0),
+        m_height(0),
+        m_tiles_x(0),
+        m_tiles_y(0),
+        m_tiles(nullptr),
+        m_tile_data(nullptr),
+        m_tile_data_size(0)
+    {
+    }
+
+    GLTileBuffer::~GLTileBuffer()
+    {
+        Memory::SafeFree(m_tiles);
+        Memory::SafeFree(m_tile_data);
+    }
+
+    void GLTileBuffer::Bind(unsigned char* color_buffer, void* depth_buffer, GLenum depth_format, unsigned char* stencil_buffer, int width, int height, int samples)
+    {
+        if (m_tiles != nullptr &&
+            m_color_buffer == color_buffer &&
+            m_depth_buffer == depth_buffer &&
+            m_depth_format == depth_format &&
+            m_stencil_buffer == stencil_buffer &&
+            m_samples == samples &&
+            m_width == width &&
+            m_height == height)
+        {
+            return;
+        }
+
+        this->Unbind();
+
+        m_color_buffer = color_buffer;
+        m_depth_buffer = depth_buffer;
+        m_depth_format = depth_format;
+        m_stencil_buffer = stencil_buffer;
+        m_samples = samples;
+        m_width = width;
+        m_height = height;
+
+        int tiles_x = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+        int tiles_y = (height + TILE_SIZE - 1) >> TILE_SHIFT;
+        if (m_tiles == nullptr || tiles_x * tiles_y > m_tiles_x * m_tiles_y)
+        {
+            Memory::SafeFree(m_tiles);
+            m_tiles = Memory::Alloc<Tile>(sizeof(Tile) * tiles_x * tiles_y);
+        }
+        m_tiles_x = tiles_x;
+        m_tiles_y = tiles_y;
+
+        // single sampled tiles take a quarter of the multisampled ones, the planes stay 16 byte aligned
+        int stride = this->GetTileStride();
+        int data_size = stride * tiles_x * tiles_y;
+        if (m_tile_data == nullptr || data_size > m_tile_data_size)
+        {
+            Memory::SafeFree(m_tile_data);
+            m_tile_data = Memory::Alloc<unsigned char>(data_size);
+            m_tile_data_size = data_size;
+        }
+        for (int i = 0; i < tiles_x * tiles_y; ++i)
+        {
+            unsigned char* data = &m_tile_data[i * stride];
+            m_tiles[i].color = data;
+            m_tiles[i].depth = (float*) &data[TILE_PIXELS * m_samples * 4];
+            m_tiles[i].stencil = &data[TILE_PIXELS * m_samples * (4 + this->GetDepthValueSize())];
+        }
+        m_states.Resize(tiles_x * tiles_y);
+        m_clear_values.Resize(tiles_x * tiles_y);
+
+        // the linear buffers hold everything
+        for (int i = 0; i < m_states.Size(); ++i)
+        {
+            m_states[i].loaded = 0;
+            m_states[i].dirty = 0;
+            m_states[i].cleared = 0;
+        }
+    }
+
+    void GLTileBuffer::Unbind()
+    {
+        if (m_tiles != nullptr)
+        {
+            this->Store(ALL);
+        }
+
+        m_color_buffer = nullptr;
+        m_depth_buffer = nullptr;
+        m_stencil_buffer = nullptr;
+    }
+
+    void GLTileBuffer::Swap(unsigned char* color_buffer, void* depth_buffer, GLenum depth_format, unsigned char* stencil_buffer, int width, int height, int samples)
+    {
+        if (m_tiles == nullptr || m_width != width || m_height != height || m_depth_format != depth_format || m_samples != samples)
+        {
+            // the old buffers may be gone with their size, nothing is stored to them
+            m_color_buffer = nullptr;
+            m_depth_buffer = nullptr;
+            m_stencil_buffer = nullptr;
+            this->Bind(color_buffer, depth_buffer, depth_format, stencil_buffer, width, height, samples);
+            return;
+        }
+
+        // the tiles keep their pixels for the new buffers, the contents of a back buffer after a swap are undefined
+        this->Store(COLOR);
+
+        for (int i = 0; i < m_states.Size(); ++i)
+        {
+            m_states[i].dirty = 0;
+        }
+
+        m_color_buffer = color_buffer;
+        m_depth_buffer = depth_buffer;
+        m_stencil_buffer = stencil_buffer;
+    }
+
+    void GLTileBuffer::Store(int buffers)
+    {
+        for (int i = 0; i < m_states.Size(); ++i)
+        {
+            TileState& state = m_states[i];
+
+            int dirty = state.dirty & buffers;
+            if (dirty != 0)
+            {
+                this->StoreTile(i, dirty);
+                state.dirty &= ~dirty;
+            }
+
+            int cleared = state.cleared & buffers;
+            if (cleared != 0)
+            {
+                this->FillLinear(i, cleared);
+                state.cleared &= ~cleared;
+            }
+        }
+    }
+
+    void GLTileBuffer::Clear(int buffers, const ClearValue& value, int min_x, int min_y, int max_x, int max_y)
+    {
+        for (int tile_y = min_y >> TILE_SHIFT; tile_y <= max_y >> TILE_SHIFT; ++tile_y)
+        {
+            for (int tile_x = min_x >> TILE_SHIFT; tile_x <= max_x >> TILE_SHIFT; ++tile_x)
+            {
+                int index = tile_y * m_tiles_x + tile_x;
+                int x, y, w, h;
+                this->GetTileRect(index, x, y, w, h);
+
+                int x0 = Mathf::Max(min_x, x);
+                int y0 = Mathf::Max(min_y, y);
+                int x1 = Mathf::Min(max_x, x + w - 1);
+                int y1 = Mathf::Min(max_y, y + h - 1);
+
+                if (x0 == x && y0 == y && x1 == x + w - 1 && y1 == y + h - 1)
+                {
+                    TileState& state = m_states[index];
+                    state.loaded &= ~buffers;
+                    state.dirty &= ~buffers;
+                    state.cleared |= buffers;
+
+                    ClearValue& clear = m_clear_values[index];
+                    if (buffers & COLOR)
+                    {
+                        Memory::Copy(clear.color, value.color, 4);
+                    }
+                    if (buffers & DEPTH)
+                    {
+                        clear.depth = value.depth;
+                    }
+                    if (buffers & STENCIL)
+                    {
+                        clear.stencil = value.stencil;
+                    }
+                }
+                else
+                {
+                    Tile* tile = this->Touch(tile_x, tile_y, buffers);
+                    float depth = value.depth;
+
+                    for (int sample = 0; sample < m_samples; ++sample)
+                    {
+                        for (int i = y0; i <= y1; ++i)
+                        {
+                            int start = SampleIndex(PixelIndex(x0, i), sample);
+                            int count = x1 - x0 + 1;
+
+                            if (buffers & COLOR)
+                            {
+                                Fill32(&tile->color[start * 4], value.color, count);
+                            }
+                            if (buffers & DEPTH)
+                            {
+                                depth = this->FillDepth(tile, start, value.depth, count);
+                            }
+                            if (buffers & STENCIL)
+                            {
+                                Memory::Set(&tile->stencil[start], value.stencil, count);
+                            }
+                        }
+                    }
+
+                    if (buffers & DEPTH)
+                    {
+                        tile->depth_min = Mathf::Min(tile->depth_min, depth);
+                        tile->depth_max = Mathf::Max(tile->depth_max, depth);
+                    }
+                }
+            }
+        }
+    }
+
+    void GLTileBuffer::ClearMasked(int buffers, const ClearValue& value, const ClearValue& write_mask, int min_x, int min_y, int max_x, int max_y)
+    {
+        unsigned int color_mask;
+        unsigned int color_bits;
+        Memory::Copy(&color_mask, write_mask.color, 4);
+        Memory::Copy(&color_bits, value.color, 4);
+        color_bits &= color_mask;
+        unsigned char stencil_mask = write_mask.stencil;
+        unsigned char stencil_bits = value.stencil & stencil_mask;
+
+        for (int tile_y = min_y >> TILE_SHIFT; tile_y <= max_y >> TILE_SHIFT; ++tile_y)
+        {
+            for (int tile_x = min_x >> TILE_SHIFT; tile_x <= max_x >> TILE_SHIFT; ++tile_x)
+            {
+                int index = tile_y * m_tiles_x + tile_x;
+                int x, y, w, h;
+                this->GetTileRect(index, x, y, w, h);
+
+                int x0 = Mathf::Max(min_x, x);
+                int y0 = Mathf::Max(min_y, y);
+                int x1 = Mathf::Min(max_x, x + w - 1);
+                int y1 = Mathf::Min(max_y, y + h - 1);
+
+                // a covered tile still holding its clear value just gets a new one
+                int pixel_buffers = buffers;
+                if (x0 == x && y0 == y && x1 == x + w - 1 && y1 == y + h - 1)
+                {
+                    ClearValue& clear = m_clear_values[index];
+                    int merged = buffers & m_states[index].cleared;
+
+                    if (merged & COLOR)
+                    {
+                        unsigned int color;
+                        Memory::Copy(&color, clear.color, 4);
+                        color = (color & ~color_mask) | color_bits;
+                        Memory::Copy(clear.color, &color, 4);
+                    }
+                    if (merged & STENCIL)
+                    {
+                        clear.stencil = (clear.stencil & ~stencil_mask) | stencil_bits;
+                    }
+
+                    pixel_buffers &= ~merged;
+                }
+
+                if (pixel_buffers == 0)
+                {
+                    continue;
+                }
+
+                Tile* tile = this->Touch(tile_x, tile_y, pixel_buffers);
+
+                for (int sample = 0; sample < m_samples; ++sample)
+                {
+                    for (int i = y0; i <= y1; ++i)
+                    {
+                        int start = SampleIndex(PixelIndex(x0, i), sample);
+                        int count = x1 - x0 + 1;
+
+                        if (pixel_buffers & COLOR)
+                        {
+                            FillMasked32((unsigned int*) &tile->color[start * 4], color_bits, color_mask, count);
+                        }
+                        if (pixel_buffers & STENCIL)
+                        {
+                            unsigned char* stencil = &tile->stencil[start];
+                            for (int j = 0; j < count; ++j)
+                            {
+                                stencil[j] = (stencil[j] & ~stencil_mask) | stencil_bits;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void GLTileBuffer::GetTileRect(int index, int& x, int& y, int& w, int& h) const
+    {
+        x = (index % m_tiles_x) << TILE_SHIFT;
+        y = (index / m_tiles_x) << TILE_SHIFT;
+        w = Mathf::Min((int) TILE_SIZE, m_width - x);
+        h = Mathf::Min((int) TILE_SIZE, m_height - y);
+    }
+
+    void GLTileBuffer::Load(int index, int buffers)
+    {
+        TileState& state = m_states[index];
+        Tile& tile = m_tiles[index];
+        int x, y, w, h;
+        this->GetTileRect(index, x, y, w, h);
+
+        // a pending clear is filled in the tile, which then differs from the linear buffer
+        int cleared = buffers & state.cleared;
+        if (cleared != 0)
+        {
+            this->FillTile(index, cleared);
+            state.cleared &= ~cleared;
+            state.dirty |= cleared;
+        }
+
+        int linear = buffers & ~cleared;
+        if (linear != 0)
+        {
+            for (int i = 0; i < h; ++i)
+            {
+                int src = (y + i) * m_width + x;
+                int dest = i << TILE_SHIFT;
+
+                if ((linear & COLOR) && m_color_buffer)
+                {
+                    Memory::Copy(&tile.color[dest * 4], &m_color_buffer[src * 4], w * 4);
+                }
+                if ((linear & DEPTH) && m_depth_buffer)
+                {
+                    switch (m_depth_format)
+                    {
+                        case GL_DEPTH_COMPONENT16:
+                            Memory::Copy(&tile.depth16[dest], &((unsigned short*) m_depth_buffer)[src], w * sizeof(unsigned short));
+                            break;
+                        case GL_DEPTH24_STENCIL8_OES:
+                            UnpackDepth24(&tile.depth24[dest], &((unsigned int*) m_depth_buffer)[src], w);
+                            break;
+                        default:
+                            Memory::Copy(&tile.depth[dest], &((float*) m_depth_buffer)[src], w * sizeof(float));
+                            break;
+                    }
+                }
+                if ((linear & STENCIL) && m_stencil_buffer)
+                {
+                    if (this->IsStencilPacked())
+                    {
+                        UnpackStencil8(&tile.stencil[dest], &((unsigned int*) m_depth_buffer)[src], w);
+                    }
+                    else
+                    {
+                        Memory::Copy(&tile.stencil[dest], &m_stencil_buffer[src], w);
+                    }
+                }
+            }
+
+            if (m_samples > 1)
+            {
+                this->ReplicateSamples(tile, linear);
+            }
+
+            if (linear & DEPTH)
+            {
+                this->UpdateDepthBounds(index % m_tiles_x, index / m_tiles_x);
+            }
+        }
+
+        state.loaded |= buffers;
+    }
+
+    void GLTileBuffer::UpdateDepthBounds(int tile_x, int tile_y)
+    {
+        int index = tile_y * m_tiles_x + tile_x;
+        Tile& tile = m_tiles[index];
+
+        // no depth buffer, nothing can be rejected
+        if (m_depth_buffer == nullptr)
+        {
+            tile.depth_min = Mathf::MinFloatValue;
+            tile.depth_max = Mathf::MaxFloatValue;
+            return;
+        }
+
+        int x, y, w, h;
+        this->GetTileRect(index, x, y, w, h);
+
+        if (m_depth_format == GL_DEPTH_COMPONENT16 || m_depth_format == GL_DEPTH24_STENCIL8_OES)
+        {
+            unsigned int depth_min = 0xffffffff;
+            unsigned int depth_max = 0;
+            for (int sample = 0; sample < m_samples; ++sample)
+            {
+                for (int i = 0; i < h; ++i)
+                {
+                    int start = SampleIndex(i << TILE_SHIFT, sample);
+                    if (m_depth_format == GL_DEPTH_COMPONENT16)
+                    {
+                        RowBounds(&tile.depth16[start], w, depth_min, depth_max);
+                    }
+                    else
+                    {
+                        RowBounds(&tile.depth24[start], w, depth_min, depth_max);
+                    }
+                }
+            }
+
+            if (m_depth_format == GL_DEPTH_COMPONENT16)
+            {
+                tile.depth_min = DepthUnorm16::ToFloat((unsigned short) depth_min);
+                tile.depth_max = DepthUnorm16::ToFloat((unsigned short) depth_max);
+            }
+            else
+            {
+                tile.depth_min = DepthUnorm24::ToFloat(depth_min);
+                tile.depth_max = DepthUnorm24::ToFloat(depth_max);
+            }
+            return;
+        }
+
+        float depth_min = Mathf::MaxFloatValue;
+        float depth_max = Mathf::MinFloatValue;
+        for (int sample = 0; sample < m_samples; ++sample)
+        {
+            for (int i = 0; i < h; ++i)
+            {
+                RowBounds(&tile.depth[SampleIndex(i << TILE_SHIFT, sample)], w, depth_min, depth_max);
+            }
+        }
+
+        tile.depth_min = depth_min;
+        tile.depth_max = depth_max;
+    }
+
+    void GLTileBuffer::StoreTile(int index, int buffers)
+    {
+        const Tile& tile = m_tiles[index];
+        int x, y, w, h;
+        this->GetTileRect(index, x, y, w, h);
+
+        for (int i = 0; i < h; ++i)
+        {
+            int dest = (y + i) * m_width + x;
+            int src = i << TILE_SHIFT;
+
+            if ((buffers & COLOR) && m_color_buffer)
+            {
+                if (m_samples > 1)
+                {
+                    ResolveColor(&m_color_buffer[dest * 4], &tile.color[src * 4], w);
+                }
+                else
+                {
+                    Memory::Copy(&m_color_buffer[dest * 4], &tile.color[src * 4], w * 4);
+                }
+            }
+            if ((buffers & DEPTH) && m_depth_buffer)
+            {
+                switch (m_depth_format)
+                {
+                    case GL_DEPTH_COMPONENT16:
+                        Memory::Copy(&((unsigned short*) m_depth_buffer)[dest], &tile.depth16[src], w * sizeof(unsigned short));
+                        break;
+                    case GL_DEPTH24_STENCIL8_OES:
+                        PackDepth24(&((unsigned int*) m_depth_buffer)[dest], &tile.depth24[src], w);
+                        break;
+                    default:
+                        Memory::Copy(&((float*) m_depth_buffer)[dest], &tile.depth[src], w * sizeof(float));
+                        break;
+                }
+            }
+            if ((buffers & STENCIL) && m_stencil_buffer)
+            {
+                if (this->IsStencilPacked())
+                {
+                    PackStencil8(&((unsigned int*) m_depth_buffer)[dest], &tile.stencil[src], w);
+                }
+                else
+                {
+                    Memory::Copy(&m_stencil_buffer[dest], &tile.stencil[src], w);
+                }
+            }
+        }
+    }
+
+    void GLTileBuffer::FillTile(int index, int buffers)
+    {
+        Tile& tile = m_tiles[index];
+        const ClearValue& value = m_clear_values[index];
+
+        // the sample planes are contiguous
+        int count = TILE_PIXELS * m_samples;
+
+        if (buffers & COLOR)
+        {
+            Fill32(tile.color, value.color, count);
+        }
+        if (buffers & DEPTH)
+        {
+            float depth = this->FillDepth(&tile, 0, value.depth, count);
+            tile.depth_min = depth;
+            tile.depth_max = depth;
+        }
+        if (buffers & STENCIL)
+        {
+            Memory::Set(tile.stencil, value.stencil, count);
+        }
+    }
+
+    void GLTileBuffer::FillLinear(int index, int buffers)
+    {
+        const ClearValue& value = m_clear_values[index];
+        int x, y, w, h;
+        this->GetTileRect(index, x, y, w, h);
+
+        for (int i = 0; i < h; ++i)
+        {
+            int dest = (y + i) * m_width + x;
+
+            if ((buffers & COLOR) && m_color_buffer)
+            {
+                Fill32(&m_color_buffer[dest * 4], value.color, w);
+            }
+            if ((buffers & DEPTH) && m_depth_buffer)
+            {
+                switch (m_depth_format)
+                {
+                    case GL_DEPTH_COMPONENT16:
+                        Fill16(&((unsigned short*) m_depth_buffer)[dest], DepthUnorm16::Quantize(value.depth), w);
+                        break;
+                    case GL_DEPTH24_STENCIL8_OES:
+                        FillMasked32(&((unsigned int*) m_depth_buffer)[dest], DepthUnorm24::Quantize(value.depth) << 8, 0xffffff00, w);
+                        break;
+                    default:
+                        Fill32(&((float*) m_depth_buffer)[dest], &value.depth, w);
+                        break;
+                }
+            }
+            if ((buffers & STENCIL) && m_stencil_buffer)
+            {
+                if (this->IsStencilPacked())
+                {
+                    FillMasked32(&((unsigned int*) m_depth_buffer)[dest], value.stencil, 0xff, w);
+                }
+                else
+                {
+                    Memory::Set(&m_stencil_buffer[dest], value.stencil, w);
+                }
+            }
+        }
+    }
+
+    float GLTileBuffer::FillDepth(Tile* tile, int start, float depth, int count) const
+    {
+        switch (m_depth_format)
+        {
+            case GL_DEPTH_COMPONENT16:
+            {
+                DepthUnorm16::Value value = DepthUnorm16::Quantize(depth);
+                Fill16(&tile->depth16[start], value, count);
+                return DepthUnorm16::ToFloat(value);
+            }
+            case GL_DEPTH24_STENCIL8_OES:
+            {
+                DepthUnorm24::Value value = DepthUnorm24::Quantize(depth);
+                Fill32(&tile->depth24[start], &value, count);
+                return DepthUnorm24::ToFloat(value);
+            }
+            default:
+                Fill32(&tile->depth[start], &depth, count);
+                return depth;
+        }
+    }
+
+    void GLTileBuffer::ReplicateSamples(Tile& tile, int buffers) const
+    {
+        for (int sample = 1; sample < m_samples; ++sample)
+        {
+            int start = SampleIndex(0, sample);
+
+            if (buffers & COLOR)
+            {
+                Memory::Copy(&tile.color[start * 4], tile.color, TILE_PIXELS * 4);
+            }
+            if (buffers & DEPTH)
+            {
+                int size = this->GetDepthValueSize();
+                Memory::Copy((char*) tile.depth + start * size, tile.depth, TILE_PIXELS * size);
+            }
+            if (buffers & STENCIL)
+            {
+                Memory::Copy(&tile.stencil[start], tile.stencil, TILE_PIXELS);
+            }
+        }
+    }
+}
@@ -0,0 +1,184 @@
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "GLES2/gl2.h"
+#include "GLES2/gl2ext.h"
+#include "container/Vector.h"
+#include "math/Mathf.h"
+
+namespace sgl
+{
+    // working copy of the bound color, depth and stencil buffers, stored tile by tile so the pixels
+    // a tile's triangles touch stay together in cache. tiles are loaded from the linear buffers when
+    // first touched and stored back only when the linear layout is needed
+    class GLTileBuffer
+    {
+    public:
+        enum
+        {
+            TILE_SHIFT = 5,
+            TILE_SIZE = 1 << TILE_SHIFT,
+            TILE_PIXELS = TILE_SIZE * TILE_SIZE,
+            MAX_SAMPLES = 4,
+        };
+
+        enum Buffer
+        {
+            COLOR = 1,
+            DEPTH = 2,
+            STENCIL = 4,
+            ALL = COLOR | DEPTH | STENCIL,
+        };
+
+        // a multisampled tile keeps one plane of pixels per sample, see SampleIndex. the planes of every
+        // tile are in one allocation sized for the bound sample count and depth format, see GetTileStride
+        struct Tile
+        {
+            unsigned char* color;
+            // in the format of the bound depth buffer, see DepthFloat32, DepthUnorm16 and DepthUnorm24
+            union
+            {
+                float* depth;
+                unsigned short* depth16;
+                unsigned int* depth24;
+            };
+            // split from the depth buffer words when it is packed with depth
+            unsigned char* stencil;
+            // bounds of the depth values in 0..1, valid while depth is loaded, writes only widen them
+            float depth_min;
+            float depth_max;
+        };
+
+        // depth formats of the tiles. unorm values round to nearest, a bound converted back to a float
+        // quantizes to the same value again, so depth bounds tests stay exact
+        struct DepthFloat32
+        {
+            typedef float Value;
+            static Value Quantize(float depth) { return depth; }
+            static float ToFloat(Value value) { return value; }
+            static Value* Values(Tile* tile) { return tile->depth; }
+        };
+
+        struct DepthUnorm16
+        {
+            typedef unsigned short Value;
+            static Value Quantize(float depth) { return (Value) (Viry3D::Mathf::Clamp01(depth) * 65535.0f + 0.5f); }
+            static float ToFloat(Value value) { return value / 65535.0f; }
+            static Value* Values(Tile* tile) { return tile->depth16; }
+        };
+
+        // the 24 high bits of a GL_UNSIGNED_INT_24_8_OES word, tiles hold them shifted down
+        struct DepthUnorm24
+        {
+            typedef unsigned int Value;
+            static Value Quantize(float depth) { return (Value) (Viry3D::Mathf::Clamp01(depth) * 16777215.0 + 0.5); }
+            static float ToFloat(Value value) { return (float) (value / 16777215.0); }
+            static Value* Values(Tile* tile) { return tile->depth24; }
+        };
+
+        struct ClearValue
+        {
+            unsigned char color[4];
+            float depth;
+            unsigned char stencil;
+        };
+
+        GLTileBuffer();
+        ~GLTileBuffer();
+        // stores the dirty tiles of the previous buffers if they change. depth_format is GL_DEPTH_COMPONENT32_OES
+        // for floats, GL_DEPTH_COMPONENT16, or GL_DEPTH24_STENCIL8_OES for 24_8 words, which also hold the
+        // stencil when stencil_buffer is the depth buffer. depth_buffer and stencil_buffer may be null for color
+        // only targets, those tile buffers are then never loaded or stored and depth_format is ignored.
+        // with MAX_SAMPLES samples the tiles are multisampled over single sampled linear buffers: loads replicate
+        // a pixel to its samples, color stores resolve them with a box filter, depth and stencil stores keep the first sample
+        void Bind(unsigned char* color_buffer, void* depth_buffer, GLenum depth_format, unsigned char* stencil_buffer, int width, int height, int samples);
+        // stores every dirty tile and forgets the buffers, before they are freed or read elsewhere
+        void Unbind();
+        // new linear buffers of the same size after a swap, depth and stencil contents are undefined from then on
+        void Swap(unsigned char* color_buffer, void* depth_buffer, GLenum depth_format, unsigned char* stencil_buffer, int width, int height, int samples);
+        bool IsBound(const unsigned char* color_buffer) const { return m_color_buffer == color_buffer && m_tiles != nullptr; }
+        // writes the given buffers back to the linear layout, pending clears are filled there
+        void Store(int buffers);
+        // a tile covered by the inclusive rect only records the clear, it is filled when touched or stored
+        void Clear(int buffers, const ClearValue& value, int min_x, int min_y, int max_x, int max_y);
+        // color or stencil clear under write masks, the masked out bits of each pixel are kept
+        void ClearMasked(int buffers, const ClearValue& value, const ClearValue& write_mask, int min_x, int min_y, int max_x, int max_y);
+        int GetWidth() const { return m_width; }
+        int GetHeight() const { return m_height; }
+        int GetTilesX() const { return m_tiles_x; }
+        int GetTilesY() const { return m_tiles_y; }
+        GLenum GetDepthFormat() const { return m_depth_format; }
+        int GetSamples() const { return m_samples; }
+        // makes the given buffers of a tile current before they are read or written
+        Tile* Touch(int tile_x, int tile_y, int buffers)
+        {
+            int index = tile_y * m_tiles_x + tile_x;
+            TileState& state = m_states[index];
+            int missing = buffers & ~state.loaded;
+            if (missing != 0)
+            {
+                this->Load(index, missing);
+            }
+            state.dirty |= buffers;
+            return &m_tiles[index];
+        }
+        // tightens the depth bounds of a loaded tile after its depth values were written
+        void UpdateDepthBounds(int tile_x, int tile_y);
+        static int PixelIndex(int x, int y) { return ((y & (TILE_SIZE - 1)) << TILE_SHIFT) | (x & (TILE_SIZE - 1)); }
+        static int SampleIndex(int pixel_index, int sample) { return sample * TILE_PIXELS + pixel_index; }
+
+    private:
+        // per buffer bits: loaded means the tile holds it, cleared means it is the tile's clear value, neither means the linear buffer holds it
+        struct TileState
+        {
+            unsigned char loaded;
+            unsigned char dirty;
+            unsigned char cleared;
+        };
+
+        void GetTileRect(int index, int& x, int& y, int& w, int& h) const;
+        void Load(int index, int buffers);
+        void StoreTile(int index, int buffers);
+        void FillTile(int index, int buffers);
+        void FillLinear(int index, int buffers);
+        // copies the first sample of each pixel to the others
+        void ReplicateSamples(Tile& tile, int buffers) const;
+        int GetDepthValueSize() const { return m_depth_format == GL_DEPTH_COMPONENT16 ? 2 : 4; }
+        // bytes of the color, depth and stencil planes of one tile
+        int GetTileStride() const { return TILE_PIXELS * m_samples * (4 + this->GetDepthValueSize() + 1); }
+        // fills count depth values of a tile from start, returns the value as stored
+        float FillDepth(Tile* tile, int start, float depth, int count) const;
+        bool IsStencilPacked() const { return m_depth_format == GL_DEPTH24_STENCIL8_OES && m_stencil_buffer != nullptr && (void*) m_stencil_buffer == m_depth_buffer; }
+
+        unsigned char* m_color_buffer;
+        void* m_depth_buffer;
+        GLenum m_depth_format;
+        unsigned char* m_stencil_buffer;
+        int m_samples;
+        int m_width;
+        int m_height;
+        int m_tiles_x;
+        int m_tiles_y;
+        Tile* m_tiles;
+        unsigned char* m_tile_data;
+        int m_tile_data_size;
+        Viry3D::Vector<TileState> m_states;
+        Viry3D::Vector<ClearValue> m_clear_values;
+    };
+}
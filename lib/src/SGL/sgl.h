@@ -0,0 +1,122 @@
+#ifndef __sgl_h_
+#define __sgl_h_ 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* soft-gles2
+* Copyright 2014-2018 by Stack - stackos@qq.com
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/* soft-gles2 contexts and surfaces, an egl like subset for rendering without a window.
+ * Every thread has its own current context, which the gl functions act on. A context is
+ * current on one thread at a time and a surface is current to one context at a time.
+ * Contexts made with a share context share its renderbuffers, shaders, programs, buffers
+ * and textures, framebuffers are never shared. Destroying a current context or surface
+ * takes effect when it is no longer current.
+ * A pbuffer surface has 1 to 3 color buffers sharing one depth and stencil buffer. Swapping
+ * presents the back buffer to the frame outputs of the surface and draws on in the next one,
+ * no pixels are copied. A presented frame stays unchanged until as many frames more as the
+ * surface has buffers less one are presented, the outputs get it on the thread the gl calls
+ * of the context run on, which is a render thread of its own for a deferred context. */
+
+#include <GLES2/gl2.h>
+
+#ifndef SGL_APICALL
+#define SGL_APICALL KHRONOS_APICALL
+#endif
+
+typedef struct SGLContext_T *SGLContext;
+typedef struct SGLSurface_T *SGLSurface;
+
+#define SGL_NO_CONTEXT                    ((SGLContext)0)
+#define SGL_NO_SURFACE                    ((SGLSurface)0)
+
+/* attrib_list entries are pairs of an attribute and its value, ended by SGL_NONE */
+#define SGL_NONE                          0x3038
+#define SGL_SAMPLES                       0x3031
+#define SGL_HEIGHT                        0x3056
+#define SGL_WIDTH                         0x3057
+/* surface, GL_DEPTH24_STENCIL8_OES by default, GL_DEPTH_COMPONENT32_OES or GL_DEPTH_COMPONENT16 */
+#define SGL_DEPTH_FORMAT                  0x3200
+/* context, GL_TRUE runs its gl calls on a render thread of its own */
+#define SGL_DEFERRED                      0x3201
+/* surface, 2 by default */
+#define SGL_BUFFER_COUNT                  0x3202
+
+/* a presented frame of rgba8 pixels. pixels points to the top row and pitch is the bytes from a
+ * row to the one below it, which is negative as the surface keeps its rows from the bottom up.
+ * serial counts the frames the surface presented before it */
+typedef struct SGLFrame
+{
+    const GLubyte *pixels;
+    GLint width;
+    GLint height;
+    GLint pitch;
+    GLuint serial;
+} SGLFrame;
+
+typedef void (GL_APIENTRYP SGLFRAMEPROC) (const SGLFrame *frame, void *user_data);
+
+/* a frame ring is a named shared memory object, shm_open on linux and a file mapping on windows,
+ * made by sglAddFrameRing and removed with its surface. the header is followed by slot_count
+ * slots of slot_size bytes, a slot header followed by its pixels in rows from the top down,
+ * pitch bytes apart. the newest frame is in slot (frame_count - 1) % slot_count. the sequence
+ * of a slot is odd while it is written, a reader copies a slot when its sequence is even and
+ * keeps the copy if the sequence has not changed */
+#define SGL_FRAME_RING_MAGIC              0x52474c53
+
+typedef struct SGLFrameRingHeader
+{
+    volatile GLuint magic;
+    GLint width;
+    GLint height;
+    GLint pitch;
+    GLint slot_count;
+    GLint slot_size;
+    volatile GLuint frame_count;
+    GLuint reserved;
+} SGLFrameRingHeader;
+
+typedef struct SGLFrameRingSlot
+{
+    volatile GLuint sequence;
+    GLuint serial;
+} SGLFrameRingSlot;
+
+SGL_APICALL SGLContext GL_APIENTRY sglCreateContext (SGLContext share_context, const GLint *attrib_list);
+SGL_APICALL GLboolean GL_APIENTRY sglDestroyContext (SGLContext ctx);
+SGL_APICALL SGLSurface GL_APIENTRY sglCreatePbufferSurface (const GLint *attrib_list);
+SGL_APICALL GLboolean GL_APIENTRY sglDestroySurface (SGLSurface surface);
+SGL_APICALL GLboolean GL_APIENTRY sglQuerySurface (SGLSurface surface, GLint attribute, GLint *value);
+/* a context without a surface draws to nothing until it gets one */
+SGL_APICALL GLboolean GL_APIENTRY sglMakeCurrent (SGLSurface surface, SGLContext ctx);
+SGL_APICALL SGLContext GL_APIENTRY sglGetCurrentContext (void);
+SGL_APICALL SGLSurface GL_APIENTRY sglGetCurrentSurface (void);
+/* the surface has to be current to the calling thread. a deferred context records the swap and
+ * returns once no more frames than the surface has buffers less one are waiting to be presented */
+SGL_APICALL GLboolean GL_APIENTRY sglSwapBuffers (SGLSurface surface);
+SGL_APICALL GLboolean GL_APIENTRY sglAddFrameCallback (SGLSurface surface, SGLFRAMEPROC callback, void *user_data);
+SGL_APICALL GLboolean GL_APIENTRY sglAddFrameRing (SGLSurface surface, const char *name, GLint slot_count);
+/* every interval-th frame written to a binary ppm file, path_format takes the serial of the frame as %u */
+SGL_APICALL GLboolean GL_APIENTRY sglAddFrameWriter (SGLSurface surface, const char *path_format, GLint interval);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,12 +17,18 @@
 
 #include "exec_cmd.h"
 #include "io/File.h"
+
+#if VR_WINDOWS
 #include <Windows.h>
+#else
+#include <stdlib.h>
+#endif
 
 using namespace Viry3D;
 
 namespace sgl
 {
+#if VR_WINDOWS
     void exec_cmd(const String& path, const String& exe, const String& param, const String& output)
     {
         File::WriteAllText(output, "");
@@ -67,4 +73,12 @@ namespace sgl
 
         CloseHandle(hOutput);
     }
+#else
+    // an empty path runs exe from the path, compilers report errors on stderr so both go to output
+    void exec_cmd(const String& path, const String& exe, const String& param, const String& output)
+    {
+        String cmd = (path.Size() > 0 ? path + "/" + exe : exe) + " " + param + " > " + output + " 2>&1";
+        system(cmd.CString());
+    }
+#endif
 }
@@ -125,27 +125,18 @@ namespace Viry3D
 		}
 		else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
 		{
-			bpp = png_get_bit_depth(png_ptr, info_ptr) * 4;
+			bpp = png_get_bit_depth(png_ptr, info_ptr) * 2;
 
 			png_bytep* row_pointers = png_get_rows(png_ptr, info_ptr);
 
-			colors = ByteBuffer(width * height * 4);
+			colors = ByteBuffer(width * height * 2);
 
-			byte* pPixel = colors.Bytes();
+			unsigned char *pPixel = colors.Bytes();
 
 			for (int i = 0; i < height; i++)
 			{
-				for (int j = 0; j < width; j++)
-				{
-					png_byte g = row_pointers[i][j * 2];
-					png_byte a = row_pointers[i][j * 2 + 1];
-					pPixel[0] = g;
-					pPixel[1] = g;
-					pPixel[2] = g;
-					pPixel[3] = a;
-
-					pPixel += 4;
-				}
+				memcpy(pPixel, row_pointers[i], width * 2);
+				pPixel += width * 2;
 			}
 		}
 
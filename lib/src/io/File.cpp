@@ -23,6 +23,8 @@
 
 #if VR_WINDOWS
 #include <Windows.h>
+#else
+#include <stdio.h>
 #endif
 
 namespace Viry3D
@@ -87,6 +89,8 @@ namespace Viry3D
     {
 #if VR_WINDOWS
         ::DeleteFile(path.CString());
+#else
+        ::remove(path.CString());
 #endif
     }
 